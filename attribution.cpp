@@ -0,0 +1,157 @@
+#include "attribution.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Subroutine giving the slot of an attribution table where the search for a key starts.
+ * @table Address of the table
+ * @key Region number or PC
+ */
+static inline unsigned long int attribution_slot(const struct attribution_table_struct *table, uint64_t key){
+    return (unsigned long int)((key * 0x9E3779B97F4A7C15UL) >> table->table_shift) & table->table_mask;
+}
+
+/**
+ * Subroutine for initializing an attribution table. The table grows when needed.
+ * @table Address of the table
+ * Returns false if out of memory. free_attribution_table() frees what was allocated
+ */
+bool setup_attribution_table(struct attribution_table_struct *table){
+    table->table_shift = 64 - 10;
+    table->table_mask = (1UL << 10) - 1;
+    table->keys = (uint64_t *) calloc(table->table_mask + 1, sizeof(uint64_t));
+    table->counters = (struct attribution_entry_t *) calloc(table->table_mask + 1, sizeof(struct attribution_entry_t));
+    table->nb_keys = 0;
+    return (table->keys != NULL) and (table->counters != NULL);
+}
+
+/**
+ * Subroutine to free an attribution table.
+ * @table Address of the table
+ */
+void free_attribution_table(struct attribution_table_struct *table){
+    free(table->keys);
+    free(table->counters);
+    table->keys = NULL;
+    table->counters = NULL;
+}
+
+/**
+ * Subroutine to add the events of an access to the counters of a key.
+ * @table Address of the table
+ * @key Region number or PC
+ * @events Events of the access (its key is not used)
+ */
+void attribution_count(struct attribution_table_struct *table, uint64_t key, const struct attribution_entry_t *events){
+    unsigned long int slot = attribution_slot(table, key);
+    while ((table->keys[slot] != 0) and (table->keys[slot] != key + 1)){
+        slot = (slot + 1) & table->table_mask;
+    }
+    if (table->keys[slot] == 0){
+        if (2 * (table->nb_keys + 1) > table->table_mask + 1){
+            // Table half full. Double it and insert every key again
+            unsigned long int old_size = table->table_mask + 1;
+            uint64_t *old_keys = table->keys;
+            struct attribution_entry_t *old_counters = table->counters;
+            table->table_mask = 2 * old_size - 1;
+            table->table_shift -= 1;
+            table->keys = (uint64_t *) calloc(2 * old_size, sizeof(uint64_t));
+            table->counters = (struct attribution_entry_t *) calloc(2 * old_size, sizeof(struct attribution_entry_t));
+            unsigned long int i = 0;
+            for (i = 0; i < old_size; i++){
+                if (old_keys[i] == 0)
+                    continue;
+                unsigned long int new_slot = attribution_slot(table, old_keys[i] - 1);
+                while (table->keys[new_slot] != 0){
+                    new_slot = (new_slot + 1) & table->table_mask;
+                }
+                table->keys[new_slot] = old_keys[i];
+                table->counters[new_slot] = old_counters[i];
+            }
+            free(old_keys);
+            free(old_counters);
+            slot = attribution_slot(table, key);
+            while (table->keys[slot] != 0){
+                slot = (slot + 1) & table->table_mask;
+            }
+        }
+        table->keys[slot] = key + 1;
+        table->counters[slot].key = key;
+        table->nb_keys += 1;
+    }
+    table->counters[slot].l1_misses += events->l1_misses;
+    table->counters[slot].vc_misses += events->vc_misses;
+    table->counters[slot].l2_misses += events->l2_misses;
+    table->counters[slot].write_backs += events->write_backs;
+}
+
+/**
+ * Subroutine giving the number of events of an entry, used to rank the entries.
+ * @entry The entry
+ */
+static inline uint64_t attribution_events(const struct attribution_entry_t *entry){
+    return entry->l1_misses + entry->l2_misses + entry->write_backs;
+}
+
+/**
+ * Subroutine to compare two entries for qsort(): the entry with the most events first, then the smallest key.
+ */
+static int compare_attribution_entries(const void *first, const void *second){
+    const struct attribution_entry_t *a = (const struct attribution_entry_t *) first;
+    const struct attribution_entry_t *b = (const struct attribution_entry_t *) second;
+    if (attribution_events(a) != attribution_events(b))
+        return (attribution_events(a) > attribution_events(b)) ? -1 : 1;
+    if (a->key != b->key)
+        return (a->key < b->key) ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Subroutine to get the top-K entries of a table: the k entries with the most events (l1 misses, l2 misses and
+ * write backs), worst first. A min-heap of k entries is kept while the table is scanned, so that a large table
+ * is not sorted.
+ * @table Address of the table
+ * @k Number of entries wanted
+ * @entries Array of at least k entries, filled with the result
+ * Returns the number of entries filled (less than k if the table has less keys)
+ */
+unsigned int attribution_top(const struct attribution_table_struct *table, unsigned int k,
+                             struct attribution_entry_t *entries){
+    unsigned int nb_entries = 0;
+    unsigned long int slot = 0;
+    if ((k == 0) or (table->keys == NULL))
+        return 0;
+    for (slot = 0; slot <= table->table_mask; slot++){
+        if (table->keys[slot] == 0)
+            continue;
+        const struct attribution_entry_t *entry = &table->counters[slot];
+        unsigned int position = 0;
+        if (nb_entries < k){
+            // Sift up
+            position = nb_entries;
+            nb_entries += 1;
+            while ((position > 0) and (compare_attribution_entries(entry, &entries[(position - 1) / 2]) > 0)){
+                entries[position] = entries[(position - 1) / 2];
+                position = (position - 1) / 2;
+            }
+            entries[position] = *entry;
+            continue;
+        }
+        // entries[0] has the fewest events of the k entries kept: it is dropped if the new entry has more
+        if (compare_attribution_entries(entry, &entries[0]) >= 0)
+            continue;
+        // Sift down
+        while (2 * position + 1 < nb_entries){
+            unsigned int child = 2 * position + 1;
+            if ((child + 1 < nb_entries) and (compare_attribution_entries(&entries[child + 1], &entries[child]) > 0))
+                child += 1;
+            if (compare_attribution_entries(&entries[child], entry) <= 0)
+                break;
+            entries[position] = entries[child];
+            position = child;
+        }
+        entries[position] = *entry;
+    }
+    qsort(entries, nb_entries, sizeof(struct attribution_entry_t), compare_attribution_entries);
+    return nb_entries;
+}
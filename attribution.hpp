@@ -0,0 +1,26 @@
+#ifndef ATTRIBUTION_HPP
+#define ATTRIBUTION_HPP
+
+#include "cachesim_api.h"
+
+/** Miss attribution table: counters per key (address region or PC), in an open addressed (linear probing) table */
+struct attribution_table_struct {
+    /** Key + 1 of each slot. 0 for an empty slot */
+    uint64_t *keys;
+    /** Counters of each slot */
+    struct attribution_entry_t *counters;
+    /** Number of slots in the table minus one (power of two minus one) */
+    unsigned long int table_mask : 64;
+    /** Shift applied to the multiplicative hash of a key to get a slot */
+    unsigned int table_shift : 7;
+    /** Number of keys in the table */
+    unsigned long int nb_keys : 64;
+};
+
+bool setup_attribution_table(struct attribution_table_struct *table);
+void free_attribution_table(struct attribution_table_struct *table);
+void attribution_count(struct attribution_table_struct *table, uint64_t key, const struct attribution_entry_t *events);
+unsigned int attribution_top(const struct attribution_table_struct *table, unsigned int k,
+                             struct attribution_entry_t *entries);
+
+#endif /* ATTRIBUTION_HPP */
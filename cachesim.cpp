@@ -2,108 +2,1055 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <time.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <type_traits>
 
-// Cache declaration
-struct victim_cache_struct victim_cache;
-struct cache_struct l1_cache;
-struct cache_struct l2_cache;
-struct cache_mask_struct l1_cache_mask;
-struct cache_mask_struct l2_cache_mask;
+// Hierarchy simulated by the driver interface (setup_cache(), cache_access(), ...)
+static CacheHierarchy *default_hierarchy = NULL;
+/** A compressed l2 is sampled every COMPRESSION_SAMPLE_PERIOD blocks compressed */
+static const unsigned long int COMPRESSION_SAMPLE_PERIOD = 1024;
+/** Counters of the presence filter per block of the cache */
+static const unsigned long int PRESENCE_FILTER_COUNTERS_PER_BLOCK = 8;
+/** LRU block given by search_in_cache() for a block ruled out by the presence filter in a full set: the LRU block
+is only searched by set_Least_Recently_used_index(), when the set is replaced */
+static const unsigned long int LRU_BLOCK_NOT_SEARCHED = ~0UL;
+/** Arenas of at least HUGE_PAGE_SIZE bytes are backed by (transparent) huge pages */
+static const size_t HUGE_PAGE_SIZE = 2UL << 20;
 
 /**
- * Subroutine for initializing the cache. You many add and initialize any global or heap
- * variables as needed.
- * XXX: You're responsible for completing this routine
+ * Subroutine to print the marker of an access (H1****, M1MvM2, ...), or a part of it, on the standard output or in
+ * the marker buffer of the hierarchy.
+ * @hierarchy Address of the cache hierarchy
+ * @marker The marker
+ */
+static inline void print_marker(CacheHierarchy *hierarchy, const char *marker){
+    if (hierarchy->markers_silent)
+        return;
+    if (hierarchy->markers == NULL){
+        fputs(marker, stdout);
+        return;
+    }
+    while ((*marker != '\0') and (hierarchy->markers_length + 1 < ACCESS_MARKERS_LENGTH)){
+        hierarchy->markers[hierarchy->markers_length] = *marker;
+        hierarchy->markers_length += 1;
+        marker += 1;
+    }
+    hierarchy->markers[hierarchy->markers_length] = '\0';
+}
+
+/**
+ * Subroutine to empty the marker buffer of a hierarchy before one of its accesses (ACCESS_MARKERS_BUFFER). A buffer
+ * given by the caller (parallel simulation) is emptied by the caller.
+ * @hierarchy Address of the cache hierarchy
+ */
+static inline void clear_markers(CacheHierarchy *hierarchy){
+    if (hierarchy->markers == hierarchy->marker_buffer){
+        hierarchy->markers_length = 0;
+        hierarchy->marker_buffer[0] = '\0';
+    }
+}
+
+/**
+ * Subroutine giving the random key of a cache level from the seed of its hierarchy (splitmix64), so that any seed
+ * (0 included) gives usable keys.
+ * @seed The seed
+ * @level Number of the level in the hierarchy
+ */
+static uint64_t random_key(uint64_t seed, unsigned int level){
+    uint64_t z = seed + (level + 1) * 0x9E3779B97F4A7C15UL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Subroutine giving the next pseudo random number in [0, n) of a set (multiply-shift reduction of the top 32 bits).
+ * The generator is counter based: the number only depends on the key of the cache, the set and the number of
+ * draws the set made before. The random choices of a set thus only depend on the seed and on the accesses to that
+ * set, whatever the accesses to the other sets.
+ * @cache The cache
+ * @line The set
+ * @n Upper bound, at most 2^32
+ */
+static inline unsigned long int random_below(const struct cache_struct *cache, struct cache_line_struct *line,
+                    unsigned long int n){
+    uint64_t z = cache->random_key + (uint64_t)(line - cache->cache_lines) * 0xD1B54A32D192ED03UL
+                 + (uint64_t) line->random_draws * 0x9E3779B97F4A7C15UL;
+    line->random_draws += 1;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+    z ^= z >> 31;
+    return (unsigned long int)(((z >> 32) * n) >> 32);
+}
+
+/**
+ * Subroutine to allocate a zeroed arena. Large arenas are backed by huge pages when the system allows it, so that
+ * the sets of a large cache do not take one TLB entry per 4KB.
+ * @size Number of bytes
+ * Returns NULL if out of memory
+ */
+static void *allocate_arena(size_t size){
+    void *arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    if (size >= HUGE_PAGE_SIZE)
+        madvise(arena, size, MADV_HUGEPAGE);
+#endif
+    return arena;
+}
+
+/**
+ * Subroutine to free an arena given by allocate_arena().
+ * @arena The arena (NULL does nothing)
+ * @size Number of bytes given to allocate_arena()
+ */
+static void free_arena(void *arena, size_t size){
+    if (arena != NULL)
+        munmap(arena, size);
+}
+
+/**
+ * Subroutine for the multiply-shift reduction of a 32 bits hash to a set number in [0, nb_sets).
+ * Used instead of a modulo when the number of sets is not a power of two.
+ * @hash well mixed 32 bits hash of the block address
+ * @nb_sets number of sets of the cache
+ */
+static inline unsigned long int reduce_to_set(uint32_t hash, unsigned long int nb_sets){
+    return (unsigned long int)(((uint64_t)hash * nb_sets) >> 32);
+}
+
+/**
+ * Subroutine giving the set of a block in one way of a skewed associative cache.
+ * @cache The skewed cache
+ * @block_address The block address (memory address without the offset bits)
+ * @way The way in which the block is searched
+ */
+static inline unsigned long int skewed_set(const struct cache_struct *cache, uint64_t block_address,
+                    unsigned long int way){
+    return reduce_to_set((uint32_t)((block_address * cache->skew_multipliers[way]) >> 32), cache->nb_cache_lines);
+}
+
+/**
+ * Subroutine giving the address of a block in the cache. All the block accesses go through here so that skewed caches,
+ * where the set depends on the way, are handled.
+ * @cache The cache
+ * @index_ The index given by cache_index() (the block address for skewed caches)
+ * @way The block number in the set
+ */
+static inline struct block_struct *cache_block(struct cache_struct *cache, unsigned long int index_,
+                    unsigned long int way){
+    if (cache->index_function == INDEX_SKEWED)
+        return &cache->cache_lines[skewed_set(cache, index_, way)].blocks[way];
+    return &cache->cache_lines[index_].blocks[way];
+}
+
+/**
+ * Subroutine giving the cache line (set) holding the replacement information of an index.
+ * Skewed caches use the set of the first way.
+ * @cache The cache
+ * @index_ The index given by cache_index()
+ */
+static inline struct cache_line_struct *cache_line(struct cache_struct *cache, unsigned long int index_){
+    if (cache->index_function == INDEX_SKEWED)
+        return &cache->cache_lines[skewed_set(cache, index_, 0)];
+    return &cache->cache_lines[index_];
+}
+
+/**
+ * Subroutine to get the cache index from a memory address.
+ * @cache The cache
+ * @cache_mask The masks associated with the cache
+ * @address The memory address
+ */
+static inline unsigned long int cache_index(const struct cache_struct *cache,
+                    const struct cache_mask_struct *cache_mask, uint64_t address){
+    if (not cache->hashed_index)
+        return (address & cache_mask->index_mask) >> cache_mask->offset_mask_bit_length;
+    uint64_t block_address = address >> cache_mask->offset_mask_bit_length;
+    if (cache->index_function == INDEX_SKEWED){
+        // The set depends on the way. It is computed for each block by cache_block()
+        return block_address;
+    }
+    if (cache->index_function == INDEX_XOR){
+        block_address ^= (block_address >> cache_mask->index_mask_bit_length) ^
+                         (block_address >> (2 * cache_mask->index_mask_bit_length));
+        if ((cache->nb_cache_lines & (cache->nb_cache_lines - 1)) == 0)
+            return block_address & (cache->nb_cache_lines - 1);
+    }
+    return reduce_to_set((uint32_t)((block_address * 0x9E3779B97F4A7C15UL) >> 32), cache->nb_cache_lines);
+}
+
+/**
+ * Subroutine to get the cache tag from a memory address.
+ * @cache The cache
+ * @cache_mask The masks associated with the cache
+ * @address The memory address
+ */
+static inline unsigned long int cache_tag(const struct cache_struct *cache,
+                    const struct cache_mask_struct *cache_mask, uint64_t address){
+    // Only the bits a block_struct keeps
+    if (cache->hashed_index)
+        return (address >> cache_mask->offset_mask_bit_length) & ((1UL << BLOCK_TAG_BITS) - 1);
+    return ((address & cache_mask->tag_mask) >> (cache_mask->offset_mask_bit_length + cache_mask->index_mask_bit_length))
+           & ((1UL << BLOCK_TAG_BITS) - 1);
+}
+
+/**
+ * Subroutine to rebuild the block address (memory address without the offset bits) from a tag and an index.
+ * It is also the tag used by the victim cache.
+ * @cache The cache
+ * @cache_mask The masks associated with the cache
+ * @tag The tag of the block
+ * @index_ The index of the block
+ */
+static inline uint64_t block_address_of(const struct cache_struct *cache,
+                    const struct cache_mask_struct *cache_mask, unsigned long int tag, unsigned long int index_){
+    if (cache->hashed_index)
+        return tag;
+    return (tag << cache_mask->index_mask_bit_length) | index_;
+}
+
+/**
+ * Subroutine giving the sector of a memory address in its block, as a one bit mask.
+ * Unsectored caches always give the mask 1.
+ * @cache The cache
+ * @cache_mask The masks associated with the cache
+ * @address The memory address
+ */
+static inline unsigned int sector_mask_of(const struct cache_struct *cache,
+                    const struct cache_mask_struct *cache_mask, uint64_t address){
+    return 1U << ((address & cache_mask->offset_mask) >> cache->sector_bits);
+}
+
+/**
+ * Subroutine giving the number of bytes held by a set of sectors.
+ * @cache The cache
+ * @sectors sector mask
+ */
+static inline uint64_t sector_bytes(const struct cache_struct *cache, unsigned int sectors){
+    return (uint64_t) __builtin_popcount(sectors) << cache->sector_bits;
+}
+
+/**
+ * Subroutine to find the l2 sectors covering some sectors of an l1 block.
+ * @level1_c address of the level 1 cache
+ * @level2_c address of the level 2 cache
+ * @level2_c_mask level2 cache mask structure
+ * @l1_block_address memory address of the first byte of the l1 block
+ * @l1_sectors sectors of the l1 block
+ */
+static unsigned int map_l1_sectors_in_l2(const struct cache_struct *level1_c, const struct cache_struct *level2_c,
+                    const struct cache_mask_struct *level2_c_mask, uint64_t l1_block_address, unsigned int l1_sectors){
+    unsigned int l2_sectors = 0;
+    uint64_t offset_in_l2 = l1_block_address & level2_c_mask->offset_mask;
+    unsigned int sector = 0;
+    for (sector = 0; (l1_sectors >> sector) != 0; sector++){
+        if (((l1_sectors >> sector) & 1) == 0)
+            continue;
+        uint64_t first_byte = offset_in_l2 + ((uint64_t) sector << level1_c->sector_bits);
+        uint64_t last_byte = first_byte + ((uint64_t) 1 << level1_c->sector_bits) - 1;
+        uint64_t l2_sector = 0;
+        for (l2_sector = first_byte >> level2_c->sector_bits; l2_sector <= (last_byte >> level2_c->sector_bits); l2_sector++){
+            l2_sectors |= 1U << l2_sector;
+        }
+    }
+    return l2_sectors;
+}
+
+/**
+ * Subroutine giving the number of a block in its cache, which indexes the side state of the block.
+ * @cache The cache
+ * @block The block
+ */
+static inline unsigned long int block_number(const struct cache_struct *cache, const struct block_struct *block){
+    return block - cache->blocks;
+}
+
+/**
+ * Subroutine giving the valid sectors of a block.
+ * @cache The cache of the block
+ * @block The block
+ */
+static inline unsigned int block_sector_valid(const struct cache_struct *cache, const struct block_struct *block){
+    if (cache->sectors == NULL)
+        return block->single_sector_valid;
+    return cache->sectors[block_number(cache, block)].valid;
+}
+
+/**
+ * Subroutine giving the dirty sectors of a block.
+ * @cache The cache of the block
+ * @block The block
+ */
+static inline unsigned int block_sector_dirty(const struct cache_struct *cache, const struct block_struct *block){
+    if (cache->sectors == NULL)
+        return block->single_sector_dirty;
+    return cache->sectors[block_number(cache, block)].dirty;
+}
+
+/**
+ * Subroutine to set the valid sectors of a block.
+ * @cache The cache of the block
+ * @block The block
+ * @sectors The valid sectors
+ */
+static inline void set_block_sector_valid(struct cache_struct *cache, struct block_struct *block, unsigned int sectors){
+    if (cache->sectors == NULL)
+        block->single_sector_valid = sectors & 1;
+    else
+        cache->sectors[block_number(cache, block)].valid = sectors;
+}
+
+/**
+ * Subroutine to set the dirty sectors of a block.
+ * @cache The cache of the block
+ * @block The block
+ * @sectors The dirty sectors
+ */
+static inline void set_block_sector_dirty(struct cache_struct *cache, struct block_struct *block, unsigned int sectors){
+    if (cache->sectors == NULL)
+        block->single_sector_dirty = sectors & 1;
+    else
+        cache->sectors[block_number(cache, block)].dirty = sectors;
+}
+
+/**
+ * Subroutine to mark sectors of a block as written. Written sectors are valid.
+ * @cache The cache of the block
+ * @block The block
+ * @sectors sectors written
+ */
+static inline void set_block_dirty(struct cache_struct *cache, struct block_struct *block, unsigned int sectors){
+    block->dirty_bit = 1;
+    set_block_sector_valid(cache, block, block_sector_valid(cache, block) | sectors);
+    set_block_sector_dirty(cache, block, block_sector_dirty(cache, block) | sectors);
+}
+
+/**
+ * Subroutine giving the hash of a block for the presence filter. The tag of a hashed index cache is the whole block
+ * address, and is hashed alone: the index given for a skewed cache is the address of the block accessed, not the
+ * one of the block removed.
+ * @cache The cache
+ * @index_ The index given by cache_index()
+ * @tag The tag of the block
+ */
+static inline uint64_t presence_filter_hash(const struct cache_struct *cache, unsigned long int index_, unsigned long int tag){
+    if (cache->hashed_index)
+        return tag * 0x9E3779B97F4A7C15UL;
+    return (tag ^ (index_ * 0xC2B2AE3D27D4EB4FUL)) * 0x9E3779B97F4A7C15UL;
+}
+
+/**
+ * Subroutine to add a block to the presence filter of its cache.
+ * @cache The cache (with a presence filter)
+ * @index_ The index given by cache_index()
+ * @tag The tag of the block
+ */
+static inline void presence_filter_add(struct cache_struct *cache, unsigned long int index_, unsigned long int tag){
+    uint64_t hash = presence_filter_hash(cache, index_, tag);
+    uint8_t *line = &cache->presence_filter[((hash >> 32) & cache->presence_filter_mask) << 6];
+    line[(hash >> 20) & 63] += (line[(hash >> 20) & 63] != UINT8_MAX);
+    line[(hash >> 26) & 63] += (line[(hash >> 26) & 63] != UINT8_MAX);
+}
+
+/**
+ * Subroutine to remove a block from the presence filter of its cache.
+ * @cache The cache (with a presence filter)
+ * @index_ The index given by cache_index()
+ * @tag The tag of the block
+ */
+static inline void presence_filter_remove(struct cache_struct *cache, unsigned long int index_, unsigned long int tag){
+    uint64_t hash = presence_filter_hash(cache, index_, tag);
+    uint8_t *line = &cache->presence_filter[((hash >> 32) & cache->presence_filter_mask) << 6];
+    line[(hash >> 20) & 63] -= (line[(hash >> 20) & 63] != UINT8_MAX);
+    line[(hash >> 26) & 63] -= (line[(hash >> 26) & 63] != UINT8_MAX);
+}
+
+/**
+ * Subroutine telling whether a block may be in a cache, according to its presence filter.
+ * @cache The cache (with a presence filter)
+ * @index_ The index given by cache_index()
+ * @tag The tag of the block
+ * Returns false only if the block is not in the cache
+ */
+static inline bool presence_filter_may_contain(const struct cache_struct *cache, unsigned long int index_,
+                    unsigned long int tag){
+    uint64_t hash = presence_filter_hash(cache, index_, tag);
+    const uint8_t *line = &cache->presence_filter[((hash >> 32) & cache->presence_filter_mask) << 6];
+    return (line[(hash >> 20) & 63] != 0) and (line[(hash >> 26) & 63] != 0);
+}
+
+/**
+ * Subroutine giving the contents of a block (data mode only).
+ * @cache The cache
+ * @index_ The index given by cache_index()
+ * @way The block number in the set
+ */
+static inline char *block_data(const struct cache_struct *cache, unsigned long int index_, unsigned long int way){
+    unsigned long int set = (cache->index_function == INDEX_SKEWED) ? skewed_set(cache, index_, way) : index_;
+    return cache->data_arena + (set * cache->nb_cache_blocks_per_line + way) * cache->nb_bytes_per_data_block;
+}
+
+/**
+ * Subroutine giving the slot of the memory table where the search for a block address starts.
+ * @mem Address of the memory structure
+ * @block_address The block address (l2 block granularity)
+ */
+static inline unsigned long int memory_slot(const struct memory_struct *mem, uint64_t block_address){
+    return (unsigned long int)((block_address * 0x9E3779B97F4A7C15UL) >> mem->table_shift) & mem->table_mask;
+}
+
+/**
+ * Subroutine for initializing the memory content. The table and the content arena grow when needed.
+ * @mem Address of the memory structure
+ * @block_size Number of bytes per block (l2 block size)
+ * Returns false if out of memory
+ */
+static bool setup_memory(struct memory_struct *mem, unsigned long int block_size){
+    mem->table_shift = 64 - 10;
+    mem->table_mask = (1UL << 10) - 1;
+    mem->block_addresses = (uint64_t *) calloc(mem->table_mask + 1, sizeof(uint64_t));
+    mem->block_numbers = (uint64_t *) calloc(mem->table_mask + 1, sizeof(uint64_t));
+    mem->nb_blocks = 0;
+    mem->content_arena_capacity = 256;
+    mem->nb_bytes_per_data_block = block_size;
+    mem->content_arena = (char *) calloc(mem->content_arena_capacity, block_size);
+    return (mem->block_addresses != NULL) and (mem->block_numbers != NULL) and (mem->content_arena != NULL);
+}
+
+/**
+ * Subroutine giving the content of a memory block, or NULL if the block was never written (it is then all 0).
+ * @mem Address of the memory structure
+ * @block_address The block address (l2 block granularity)
+ */
+static char *memory_find_block(struct memory_struct *mem, uint64_t block_address){
+    unsigned long int slot = memory_slot(mem, block_address);
+    while (mem->block_addresses[slot] != 0){
+        if (mem->block_addresses[slot] == block_address + 1)
+            return mem->content_arena + mem->block_numbers[slot] * mem->nb_bytes_per_data_block;
+        slot = (slot + 1) & mem->table_mask;
+    }
+    return NULL;
+}
+
+/**
+ * Subroutine giving the content of a memory block, creating it (all 0) if the block was never written.
+ * @mem Address of the memory structure
+ * @block_address The block address (l2 block granularity)
+ */
+static char *memory_insert_block(struct memory_struct *mem, uint64_t block_address){
+    char *content = memory_find_block(mem, block_address);
+    if (content != NULL)
+        return content;
+    if (2 * (mem->nb_blocks + 1) > mem->table_mask + 1){
+        // Table half full. Double it and insert every block again
+        unsigned long int old_size = mem->table_mask + 1;
+        uint64_t *old_block_addresses = mem->block_addresses;
+        uint64_t *old_block_numbers = mem->block_numbers;
+        mem->table_mask = 2 * old_size - 1;
+        mem->table_shift -= 1;
+        mem->block_addresses = (uint64_t *) calloc(2 * old_size, sizeof(uint64_t));
+        mem->block_numbers = (uint64_t *) calloc(2 * old_size, sizeof(uint64_t));
+        unsigned long int i = 0;
+        for (i = 0; i < old_size; i++){
+            if (old_block_addresses[i] == 0)
+                continue;
+            unsigned long int slot = memory_slot(mem, old_block_addresses[i] - 1);
+            while (mem->block_addresses[slot] != 0){
+                slot = (slot + 1) & mem->table_mask;
+            }
+            mem->block_addresses[slot] = old_block_addresses[i];
+            mem->block_numbers[slot] = old_block_numbers[i];
+        }
+        free(old_block_addresses);
+        free(old_block_numbers);
+    }
+    if (mem->nb_blocks == mem->content_arena_capacity){
+        mem->content_arena = (char *) realloc(mem->content_arena, 2 * mem->content_arena_capacity * mem->nb_bytes_per_data_block);
+        memset(mem->content_arena + mem->content_arena_capacity * mem->nb_bytes_per_data_block, 0,
+               mem->content_arena_capacity * mem->nb_bytes_per_data_block);
+        mem->content_arena_capacity *= 2;
+    }
+    unsigned long int slot = memory_slot(mem, block_address);
+    while (mem->block_addresses[slot] != 0){
+        slot = (slot + 1) & mem->table_mask;
+    }
+    mem->block_addresses[slot] = block_address + 1;
+    mem->block_numbers[slot] = mem->nb_blocks;
+    mem->nb_blocks += 1;
+    return mem->content_arena + (mem->nb_blocks - 1) * mem->nb_bytes_per_data_block;
+}
+
+/**
+ * Subroutine to read a memory block.
+ * @mem Address of the memory structure
+ * @block_address The block address (l2 block granularity)
+ * @destination Where the block content is copied
+ */
+static void memory_read_block(struct memory_struct *mem, uint64_t block_address, char *destination){
+    char *content = memory_find_block(mem, block_address);
+    if (content == NULL){
+        memset(destination, 0, mem->nb_bytes_per_data_block);
+    } else {
+        memcpy(destination, content, mem->nb_bytes_per_data_block);
+    }
+}
+
+/**
+ * Subroutine to write some sectors of a block in memory.
+ * @mem Address of the memory structure
+ * @block_address The block address (l2 block granularity)
+ * @source Content of the block
+ * @sectors Sectors written
+ * @sector_bits Sectors are 2^sector_bits bytes
+ */
+static void memory_write_sectors(struct memory_struct *mem, uint64_t block_address, const char *source,
+                    unsigned int sectors, unsigned int sector_bits){
+    if (sectors == 0)
+        return;
+    char *content = memory_insert_block(mem, block_address);
+    unsigned int sector = 0;
+    for (sector = 0; (sectors >> sector) != 0; sector++){
+        if (((sectors >> sector) & 1) == 1)
+            memcpy(content + ((unsigned long int) sector << sector_bits), source + ((unsigned long int) sector << sector_bits),
+                   1UL << sector_bits);
+    }
+}
+
+/**
+ * Subroutine for initializing a TLB.
+ * @tlb Address of the TLB
+ * @nb_entries Number of entries
+ * @nb_ways Number of entries per set. nb_entries is rounded down to a multiple of it
+ * Returns false if out of memory
+ */
+static bool setup_tlb(struct tlb_struct *tlb, unsigned long int nb_entries, unsigned long int nb_ways){
+    tlb->nb_ways = (nb_ways > nb_entries) ? nb_entries : nb_ways;
+    tlb->nb_sets = nb_entries / tlb->nb_ways;
+    tlb->vpns = (uint64_t *) calloc(tlb->nb_sets * tlb->nb_ways, sizeof(uint64_t));
+    tlb->pfns = (uint64_t *) calloc(tlb->nb_sets * tlb->nb_ways, sizeof(uint64_t));
+    tlb->last_use = (uint64_t *) calloc(tlb->nb_sets * tlb->nb_ways, sizeof(uint64_t));
+    tlb->clock = 0;
+    return (tlb->vpns != NULL) and (tlb->pfns != NULL) and (tlb->last_use != NULL);
+}
+
+/**
+ * Subroutine to search a TLB. The entry found becomes the most recently used of its set.
+ * @tlb Address of the TLB
+ * @vpn Virtual page number
+ * @pfn Physical page number, set if the page is found
+ * Returns true if the page is found
+ */
+static bool tlb_lookup(struct tlb_struct *tlb, uint64_t vpn, uint64_t *pfn){
+    unsigned long int first = (vpn % tlb->nb_sets) * tlb->nb_ways;
+    unsigned long int way = 0;
+    tlb->clock += 1;
+    for (way = first; way < first + tlb->nb_ways; way++){
+        if (tlb->vpns[way] == vpn + 1){
+            tlb->last_use[way] = tlb->clock;
+            *pfn = tlb->pfns[way];
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Subroutine to insert a translation in a TLB, in place of the least recently used (or an invalid) entry of the set.
+ * @tlb Address of the TLB
+ * @vpn Virtual page number
+ * @pfn Physical page number
+ */
+static void tlb_insert(struct tlb_struct *tlb, uint64_t vpn, uint64_t pfn){
+    unsigned long int first = (vpn % tlb->nb_sets) * tlb->nb_ways;
+    unsigned long int victim = first;
+    unsigned long int way = 0;
+    for (way = first; way < first + tlb->nb_ways; way++){
+        // Invalid entries have a last use of 0 and are taken first
+        if (tlb->last_use[way] < tlb->last_use[victim])
+            victim = way;
+    }
+    tlb->vpns[victim] = vpn + 1;
+    tlb->pfns[victim] = pfn;
+    tlb->last_use[victim] = tlb->clock;
+}
+
+/**
+ * Subroutine giving the slot of the page table where the search for a page starts.
+ * @page_table Address of the page table
+ * @vpn Virtual page number
+ */
+static inline unsigned long int page_table_slot(const struct page_table_struct *page_table, uint64_t vpn){
+    return (unsigned long int)((vpn * 0x9E3779B97F4A7C15UL) >> page_table->table_shift) & page_table->table_mask;
+}
+
+/**
+ * Subroutine for initializing the page table.
+ * @page_table Address of the page table
+ * Returns false if out of memory
+ */
+static bool setup_page_table(struct page_table_struct *page_table){
+    page_table->table_shift = 64 - 10;
+    page_table->table_mask = (1UL << 10) - 1;
+    page_table->vpns = (uint64_t *) calloc(page_table->table_mask + 1, sizeof(uint64_t));
+    page_table->pfns = (uint64_t *) calloc(page_table->table_mask + 1, sizeof(uint64_t));
+    page_table->nb_pages = 0;
+    return (page_table->vpns != NULL) and (page_table->pfns != NULL);
+}
+
+/**
+ * Subroutine walking the page table. A page touched for the first time gets the next physical frame.
+ * @page_table Address of the page table
+ * @vpn Virtual page number
+ * @p_stats Pointer to the statistics structure, NULL not to count the pages allocated
+ * Returns the physical page number
+ */
+static uint64_t page_table_walk(struct page_table_struct *page_table, uint64_t vpn, cache_stats_t *p_stats){
+    unsigned long int slot = page_table_slot(page_table, vpn);
+    while (page_table->vpns[slot] != 0){
+        if (page_table->vpns[slot] == vpn + 1)
+            return page_table->pfns[slot];
+        slot = (slot + 1) & page_table->table_mask;
+    }
+    if (2 * (page_table->nb_pages + 1) > page_table->table_mask + 1){
+        // Table half full. Double it and insert every page again
+        unsigned long int old_size = page_table->table_mask + 1;
+        uint64_t *old_vpns = page_table->vpns;
+        uint64_t *old_pfns = page_table->pfns;
+        page_table->table_mask = 2 * old_size - 1;
+        page_table->table_shift -= 1;
+        page_table->vpns = (uint64_t *) calloc(2 * old_size, sizeof(uint64_t));
+        page_table->pfns = (uint64_t *) calloc(2 * old_size, sizeof(uint64_t));
+        unsigned long int i = 0;
+        for (i = 0; i < old_size; i++){
+            if (old_vpns[i] == 0)
+                continue;
+            unsigned long int new_slot = page_table_slot(page_table, old_vpns[i] - 1);
+            while (page_table->vpns[new_slot] != 0){
+                new_slot = (new_slot + 1) & page_table->table_mask;
+            }
+            page_table->vpns[new_slot] = old_vpns[i];
+            page_table->pfns[new_slot] = old_pfns[i];
+        }
+        free(old_vpns);
+        free(old_pfns);
+        slot = page_table_slot(page_table, vpn);
+        while (page_table->vpns[slot] != 0){
+            slot = (slot + 1) & page_table->table_mask;
+        }
+    }
+    page_table->vpns[slot] = vpn + 1;
+    page_table->pfns[slot] = page_table->nb_pages;
+    page_table->nb_pages += 1;
+    if (p_stats != NULL)
+        p_stats->pages_allocated += 1;
+    return page_table->pfns[slot];
+}
+
+/**
+ * Subroutine for initializing one level of cache and its address masks.
+ * @cache The cache to initialize
+ * @cache_mask The masks used to get the tag, index and offset from the memory addresses
+ * @c The total number of bytes for data storage is 2^c (unless nb_sets is given)
+ * @b The size of the blocks in bytes: 2^b-byte blocks.
+ * @s The number of blocks in each set: 2^s blocks per set.
+ * @nb_sets The number of sets. 0 for 2^(c-b-s)
+ * @index_function The set index function (index_function_t)
+ * @sector_bits Sectors are 2^sector_bits bytes. 0 for unsectored blocks
+ * @compression Block compression algorithm (compression_t). A compressed cache has 2^(s+1) tags per set
+ * @data_mode Set when the cache also holds the contents of its blocks
+ * @presence_filter Set to keep a presence filter of the blocks
+ * Returns false if out of memory. free_cache_level() frees what was allocated
+ */
+static bool setup_cache_level(struct cache_struct *cache, struct cache_mask_struct *cache_mask,
+                    uint64_t c, uint64_t b, uint64_t s, uint64_t nb_sets, unsigned int index_function,
+                    unsigned int sector_bits, unsigned int compression, bool data_mode, bool presence_filter){
+
+    unsigned long int i = 0;
+    unsigned long int j = 0;
+    unsigned long int data_size = pow(2, b);
+    unsigned long int index_length = (nb_sets == 0) ? (unsigned long int) pow(2, c-b-s) : nb_sets;
+    cache->nb_cache_lines = index_length;
+
+    unsigned long int N = pow(2, s);
+    // Compressed cache: the data of 2^s blocks is shared by twice as many tags
+    cache->compression = compression;
+    cache->nb_segments_per_line = (N * data_size) >> 3;
+    if (compression != COMPRESSION_NONE){
+        N *= 2;
+    }
+    cache->nb_cache_blocks_per_line = N;
+    cache->nb_bytes_per_data_block = data_size;
+
+    // A single zeroed arena holds the sets, then the blocks set after set, then their sector state (sectored
+    // caches), their compressed sizes (compressed caches), the presence filter and their contents (data mode).
+    // The blocks are invalid, clean, with a LRU of 0, and the filter is empty
+    bool sectored = (sector_bits != 0) and (sector_bits != b);
+    size_t lines_size = (index_length * sizeof(struct cache_line_struct) + 63) & ~(size_t) 63;
+    size_t blocks_size = (index_length * N * sizeof(struct block_struct) + 63) & ~(size_t) 63;
+    size_t sectors_size = sectored ? (index_length * N * sizeof(struct block_sectors_struct) + 63) & ~(size_t) 63 : 0;
+    size_t segments_size = (compression != COMPRESSION_NONE) ? (index_length * N * sizeof(uint16_t) + 63) & ~(size_t) 63 : 0;
+    cache->presence_filter_mask = 0;
+    while (((cache->presence_filter_mask + 1) << 6) < index_length * N * PRESENCE_FILTER_COUNTERS_PER_BLOCK){
+        cache->presence_filter_mask = (cache->presence_filter_mask << 1) | 1;
+    }
+    size_t filter_size = presence_filter ? (cache->presence_filter_mask + 1) << 6 : 0;
+    size_t data_arena_size = data_mode ? index_length * N * data_size : 0;
+    cache->arena_size = lines_size + blocks_size + sectors_size + segments_size + filter_size + data_arena_size;
+    cache->skew_multipliers = NULL;
+    cache->arena = (char *) allocate_arena(cache->arena_size);
+    if (cache->arena == NULL)
+        return false;
+    cache->cache_lines = (struct cache_line_struct *) cache->arena;
+    cache->blocks = (struct block_struct *)(cache->arena + lines_size);
+    for (i = 0; i < index_length; i++){
+        cache->cache_lines[i].blocks = &cache->blocks[i * N];
+    }
+    char *side_state = cache->arena + lines_size + blocks_size;
+    cache->sectors = sectored ? (struct block_sectors_struct *) side_state : NULL;
+    cache->compressed_segments = (compression != COMPRESSION_NONE) ? (uint16_t *)(side_state + sectors_size) : NULL;
+    cache->presence_filter = presence_filter ? (uint8_t *)(side_state + sectors_size + segments_size) : NULL;
+    cache->filtered_lookups = 0;
+    cache->data_arena = data_mode ? side_state + sectors_size + segments_size + filter_size : NULL;
+
+    // Number of bits needed for the index. Rounded up when the number of sets is not a power of two.
+    unsigned int index_bits = 0;
+    while ((1UL << index_bits) < index_length){
+        index_bits += 1;
+    }
+    cache->index_function = index_function;
+    cache->sector_bits = (sector_bits == 0) ? b : sector_bits;
+    cache->hashed_index = (index_function != INDEX_MODULO) or ((index_length & (index_length - 1)) != 0);
+    if (index_function == INDEX_SKEWED){
+        // One odd multiplier per way (splitmix64 sequence), so that each way has its own hash function
+        cache->skew_multipliers = (uint64_t *) calloc(N, sizeof(uint64_t));
+        if (cache->skew_multipliers == NULL)
+            return false;
+        uint64_t state = 0x9E3779B97F4A7C15UL;
+        for (j = 0; j < N; j++){
+            state += 0x9E3779B97F4A7C15UL;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+            cache->skew_multipliers[j] = (z ^ (z >> 31)) | 1;
+        }
+    }
+
+    // Compute cache mask values
+    cache_mask->offset_mask = data_size - 1; //pow(2, b) -1;
+    cache_mask->offset_mask_bit_length = b;
+    cache_mask->index_mask_bit_length = index_bits;
+    if (not cache->hashed_index){
+        cache_mask->tag_mask = ~0UL << (b + index_bits);
+        cache_mask->index_mask = (index_length - 1) << b; //pow(2, c-b-s) - 1;
+        cache_mask->tag_mask_bit_length = 64 - b - index_bits;
+    } else {
+        // The tag is the whole block address, the index is computed by cache_index()
+        cache_mask->tag_mask = ~cache_mask->offset_mask;
+        cache_mask->index_mask = 0;
+        cache_mask->tag_mask_bit_length = 64 - b;
+    }
+    return true;
+}
+
+/**
+ * Subroutine giving the number of low address bits a cache level tells apart: the offset, the index when it is a
+ * range of address bits, and the BLOCK_TAG_BITS bits of tag a block keeps. Addresses that differ above them alias.
+ * @cache The cache
+ * @cache_mask The masks associated with the cache
+ * Returns at most 64
+ */
+static unsigned int kept_address_bits(const struct cache_struct *cache, const struct cache_mask_struct *cache_mask){
+    unsigned int bits = cache_mask->offset_mask_bit_length + BLOCK_TAG_BITS;
+    if (not cache->hashed_index)
+        bits += cache_mask->index_mask_bit_length;
+    return (bits > 64) ? 64 : bits;
+}
+
+/**
+ * l1 hit path, specialized for one l1 geometry (power of two number of sets, modulo index, unsectored blocks).
+ * The masks and shifts are constants and the way loop has a constant trip count, so that the compiler can unroll it.
+ * Anything but a hit returns false before changing anything, and the generic path of simulate_access() takes over.
+ * @hierarchy Address of the cache hierarchy
+ * @type The type of event, can be READ or WRITE.
+ * @arg  The target memory address
+ * @p_stats Pointer to the statistics structure
+ */
+template <unsigned int BLOCK_BITS, unsigned int SET_BITS, unsigned int WAY_BITS>
+static bool l1_hit_kernel(CacheHierarchy *hierarchy, char type, uint64_t arg, cache_stats_t *p_stats){
+    const unsigned long int index_ = (arg >> BLOCK_BITS) & ((1UL << SET_BITS) - 1);
+    // Only the bits a block_struct keeps, as cache_tag()
+    const unsigned long int tag = (arg >> (BLOCK_BITS + SET_BITS)) & ((1UL << BLOCK_TAG_BITS) - 1);
+    struct block_struct *blocks = hierarchy->l1_cache.cache_lines[index_].blocks;
+    unsigned long int way = 0;
+    for (way = 0; way < (1UL << WAY_BITS); way++){
+        if ((blocks[way].valid_bit == 1) and (blocks[way].tag == tag))
+            break;
+    }
+    if (way == (1UL << WAY_BITS))
+        return false;
+
+    // Same as the hit branch of simulate_access()
+    p_stats->accesses += 1;
+    if (type == READ){
+        p_stats->reads += 1;
+    } else {
+        if (type == WRITE){
+            p_stats->writes += 1;
+        }
+    }
+    blocks[way].LRU = (blocks[way].LRU == LRU_MAX_VALUE) ? LRU_MAX_VALUE : blocks[way].LRU + 1;
+    hierarchy->l1_cache.cache_lines[index_].last_accessed_block = way;
+    if (type == WRITE){
+        set_block_dirty(&hierarchy->l1_cache, &blocks[way], 1);
+    }
+    hierarchy->l1_last_block = &blocks[way];
+    hierarchy->l1_last_block_address = arg >> BLOCK_BITS;
+    print_marker(hierarchy, "H1****\n");
+    return true;
+}
+
+/** Geometry of a specialized l1 hit path */
+struct l1_kernel_entry {
+    unsigned int block_bits;
+    unsigned int set_bits;
+    unsigned int way_bits;
+    l1_hit_kernel_t kernel;
+};
+
+/** Specialized l1 hit paths. The comments give the (C1, B1, S1) of each geometry */
+static const struct l1_kernel_entry l1_kernels[] = {
+    {5, 4, 3, l1_hit_kernel<5, 4, 3>},   // (12, 5, 3) default
+    {5, 5, 2, l1_hit_kernel<5, 5, 2>},   // (12, 5, 2)
+    {5, 6, 1, l1_hit_kernel<5, 6, 1>},   // (12, 5, 1)
+    {5, 7, 0, l1_hit_kernel<5, 7, 0>},   // (12, 5, 0) direct mapped
+    {5, 3, 4, l1_hit_kernel<5, 3, 4>},   // (12, 5, 4)
+    {5, 5, 3, l1_hit_kernel<5, 5, 3>},   // (13, 5, 3)
+    {5, 6, 3, l1_hit_kernel<5, 6, 3>},   // (14, 5, 3)
+    {5, 7, 3, l1_hit_kernel<5, 7, 3>},   // (15, 5, 3)
+    {5, 6, 4, l1_hit_kernel<5, 6, 4>},   // (15, 5, 4)
+    {5, 7, 2, l1_hit_kernel<5, 7, 2>},   // (14, 5, 2)
+    {5, 3, 2, l1_hit_kernel<5, 3, 2>},   // (10, 5, 2)
+    {5, 4, 2, l1_hit_kernel<5, 4, 2>},   // (11, 5, 2)
+    {6, 3, 3, l1_hit_kernel<6, 3, 3>},   // (12, 6, 3)
+    {6, 4, 2, l1_hit_kernel<6, 4, 2>},   // (12, 6, 2)
+    {6, 4, 3, l1_hit_kernel<6, 4, 3>},   // (13, 6, 3)
+    {6, 5, 3, l1_hit_kernel<6, 5, 3>},   // (14, 6, 3)
+    {6, 6, 3, l1_hit_kernel<6, 6, 3>},   // (15, 6, 3)
+    {6, 5, 4, l1_hit_kernel<6, 5, 4>},   // (15, 6, 4)
+    {4, 5, 3, l1_hit_kernel<4, 5, 3>},   // (12, 4, 3)
+    {7, 2, 3, l1_hit_kernel<7, 2, 3>},   // (12, 7, 3)
+};
+
+/**
+ * Subroutine to choose the specialized l1 hit path of a geometry.
+ * @cache The l1 cache
+ * @cache_mask The l1 masks
+ * @s The number of blocks in each set of l1: 2^s blocks per set.
+ * Returns NULL if no specialized path applies: the generic path is then used for every access
+ */
+static l1_hit_kernel_t select_l1_hit_kernel(const struct cache_struct *cache,
+                    const struct cache_mask_struct *cache_mask, uint64_t s){
+    if (cache->hashed_index or (cache->sector_bits != cache_mask->offset_mask_bit_length))
+        return NULL;
+    unsigned long int i = 0;
+    for (i = 0; i < sizeof(l1_kernels) / sizeof(l1_kernels[0]); i++){
+        if ((l1_kernels[i].block_bits == cache_mask->offset_mask_bit_length) and
+            (l1_kernels[i].set_bits == cache_mask->index_mask_bit_length) and (l1_kernels[i].way_bits == s))
+            return l1_kernels[i].kernel;
+    }
+    return NULL;
+}
+
+/**
+ * Subroutine for initializing a cache hierarchy.
  *
+ * @hierarchy The hierarchy to initialize (zeroed)
  * @c1 The total number of bytes for data storage in L1 is 2^c1
  * @b1 The size of L1's blocks in bytes: 2^b1-byte blocks.
  * @s1 The number of blocks in each set of L1: 2^s1 blocks per set.
  * @v Victim Cache's total number of blocks (blocks are of size 2^b1).
- *    v is in [0, 4].
+ *    v is in [0, MAX_VICTIM_CACHE_LINES].
  * @c2 The total number of bytes for data storage in L2 is 2^c2
  * @b2 The size of L2's blocks in bytes: 2^b2-byte blocks.
  * @s2 The number of blocks in each set of L2: 2^s2 blocks per set.
+ * @p_options Optional settings (number of sets, index functions, sectors, data mode, compression, address
+ *    translation). NULL for the defaults.
  * Note: c2 >= c1, b2 >= b1 and s2 >= s1.
+ * Returns false if out of memory or if the miss trace cannot be written. CacheHierarchy::destroy() frees what was
+ * allocated
  */
-void setup_cache(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
-                 uint64_t c2, uint64_t b2, uint64_t s2) {
+static bool setup_hierarchy(CacheHierarchy *hierarchy, uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
+                 uint64_t c2, uint64_t b2, uint64_t s2,
+                 const cache_options_t *p_options) {
 
     unsigned long int i = 0;
-    unsigned long int j = 0;
     unsigned long int data_size = pow(2, b1);
 
-    victim_cache.nb_victim_cache_lines = v;
+    hierarchy->victim_cache.nb_victim_cache_lines = v;
+    hierarchy->victim_cache.fifo_head = 0;
     if (v > 0){
         // Victim cache Initialisation. Start with initialising victim cache line
-        victim_cache.victim_cache_lines = (struct victim_cache_line_struct *) calloc(v, sizeof(struct victim_cache_line_struct));
-        victim_cache.nb_victim_cache_blocks_per_line = 1;
-        victim_cache.nb_bytes_per_data_block = data_size;
+        hierarchy->victim_cache.victim_cache_lines = (struct victim_cache_line_struct *) calloc(v, sizeof(struct victim_cache_line_struct));
+        hierarchy->victim_cache.nb_victim_cache_blocks_per_line = 1;
+        hierarchy->victim_cache.nb_bytes_per_data_block = data_size;
+        // All the blocks are allocated at once, so that a large victim cache stays contiguous in memory
+        struct victim_cache_block_struct *vc_blocks = (struct victim_cache_block_struct *) calloc(v, sizeof(struct victim_cache_block_struct));
+        if ((hierarchy->victim_cache.victim_cache_lines == NULL) or (vc_blocks == NULL)){
+            free(vc_blocks);
+            return false;
+        }
         //Initialise each victim cache block and set defaults values
         for (i = 0; i < v; i++){
-            victim_cache.victim_cache_lines[i].victim_cache_block = (struct victim_cache_block_struct *) calloc(1, sizeof(struct victim_cache_block_struct));
-            // victim_cache.victim_cache_lines[i].victim_cache_block->data = (char *) calloc(data_size, sizeof(char));
+            hierarchy->victim_cache.victim_cache_lines[i].victim_cache_block = &vc_blocks[i];
             /** Calloc initialise everything to 0 or null. But making sure is better. */
-            victim_cache.victim_cache_lines[i].victim_cache_block->writable = 1;
+            hierarchy->victim_cache.victim_cache_lines[i].victim_cache_block->valid_bit = 0;
+        }
+        // Lookup table. At least twice as many slots as lines, so that the probe sequences stay short
+        unsigned long int table_size = 2;
+        hierarchy->victim_cache.lookup_table_shift = 63;
+        while (table_size < 2 * v){
+            table_size <<= 1;
+            hierarchy->victim_cache.lookup_table_shift -= 1;
         }
+        hierarchy->victim_cache.lookup_table = (unsigned int *) calloc(table_size, sizeof(unsigned int));
+        hierarchy->victim_cache.lookup_table_mask = table_size - 1;
+        if (hierarchy->victim_cache.lookup_table == NULL)
+            return false;
     }
 
-    // L1 Cache initialization
-    unsigned long int index_length = pow(2, c1-b1-s1);
-    l1_cache.cache_lines = (struct cache_line_struct *) calloc (index_length, sizeof(struct cache_line_struct));
-    l1_cache.nb_cache_lines = index_length;
+    // L1 and L2 Cache initialization. In data mode, their arenas also hold the block contents
+    bool data_mode = (p_options != NULL) and ((p_options->data_mode != 0) or (p_options->l2_compression != COMPRESSION_NONE));
+    bool allocated = setup_cache_level(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, c1, b1, s1,
+        (p_options == NULL) ? 0 : p_options->l1_sets,
+        (p_options == NULL) ? (unsigned int) INDEX_MODULO : p_options->l1_index_function,
+        (p_options == NULL) ? 0 : p_options->l1_sector_bits, COMPRESSION_NONE, data_mode, false);
+    allocated = allocated and setup_cache_level(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, c2, b2, s2,
+        (p_options == NULL) ? 0 : p_options->l2_sets,
+        (p_options == NULL) ? (unsigned int) INDEX_MODULO : p_options->l2_index_function,
+        (p_options == NULL) ? 0 : p_options->l2_sector_bits,
+        (p_options == NULL) ? (unsigned int) COMPRESSION_NONE : p_options->l2_compression, data_mode,
+        (p_options != NULL) and (p_options->l2_presence_filter != 0));
+    if (not allocated)
+        return false;
+    hierarchy->l1_hit_kernel = select_l1_hit_kernel(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, s1);
+    hierarchy->l1_last_block = NULL;
 
-    unsigned long int N = pow(2, s1);
-    l1_cache.nb_cache_blocks_per_line = N;
-    l1_cache.nb_bytes_per_data_block = data_size;
-    //Blocks initialization
-    for(i=0; i < index_length; i++){
-        l1_cache.cache_lines[i].blocks = (struct block_struct *) calloc(N, sizeof(struct block_struct));
-        // structure initialization
-        for (j = 0; j < N; j++){
-            // At this stage, data will never be used. So no initialisation.
-            // l1_cache.cache_lines[i].blocks[j].data = (char *) calloc(data_size, sizeof(char));
-            l1_cache.cache_lines[i].blocks[j].dirty_bit = 0;
-            l1_cache.cache_lines[i].blocks[j].valid_bit = 0;
-            l1_cache.cache_lines[i].blocks[j].LRU = 0;
-        }
-    }
-    // Compute l1 cache mask values
-    l1_cache_mask.tag_mask = ((unsigned long int)pow(2, 64 - c1 + s1) - 1) << (c1 - s1);
-    l1_cache_mask.index_mask = (index_length - 1) << b1; //pow(2, c1-b1-s1) - 1;
-    l1_cache_mask.offset_mask = data_size - 1; //pow(2, b1) -1;
-    l1_cache_mask.tag_mask_bit_length = 64 - c1 + s1;
-    l1_cache_mask.index_mask_bit_length = c1-b1-s1;
-    l1_cache_mask.offset_mask_bit_length = b1;
-
-
-    // L2 Cache initialization
-    index_length = pow(2, c2-b2-s2);
-    l2_cache.cache_lines = (struct cache_line_struct *) calloc (index_length, sizeof(struct cache_line_struct));
-    l2_cache.nb_cache_lines = index_length;
-    data_size = pow(2, b2);
-    N = pow(2, s2);
-    l2_cache.nb_cache_blocks_per_line = N;
-    l2_cache.nb_bytes_per_data_block = data_size;
-    //Blocks initialization
-    for(i=0; i < index_length; i++){
-        l2_cache.cache_lines[i].blocks = (struct block_struct *) calloc(N, sizeof(struct block_struct));
-        // structure initialization
-        for (j = 0; j < N; j++){
-            // l2_cache.cache_lines[i].blocks[j].data = (char *) calloc(data_size, sizeof(char));
-            l2_cache.cache_lines[i].blocks[j].dirty_bit = 0;
-            l2_cache.cache_lines[i].blocks[j].valid_bit = 0;
-            l2_cache.cache_lines[i].blocks[j].LRU = 0;
+    // Markers of the accesses
+    unsigned int access_markers = (p_options == NULL) ? (unsigned int) ACCESS_MARKERS_STDOUT : p_options->access_markers;
+    hierarchy->markers_silent = (access_markers == ACCESS_MARKERS_NONE);
+    hierarchy->markers = (access_markers == ACCESS_MARKERS_BUFFER) ? hierarchy->marker_buffer : NULL;
+    hierarchy->markers_length = 0;
+
+    // Random replacements: one key per level
+    hierarchy->random_seed = (p_options == NULL) ? 0 : p_options->random_seed;
+    hierarchy->l1_cache.random_key = random_key(hierarchy->random_seed, 1);
+    hierarchy->l2_cache.random_key = random_key(hierarchy->random_seed, 2);
+
+    // Instruction cache: unsectored, modulo indexed blocks of 2^b1 bytes, without data (fetches never write)
+    hierarchy->instruction_cache = (p_options != NULL) and (p_options->l1i_size_bits != 0);
+    hierarchy->l1i_last_block = NULL;
+    if (hierarchy->instruction_cache){
+        if (not setup_cache_level(&hierarchy->l1i_cache, &hierarchy->l1i_cache_mask, p_options->l1i_size_bits, b1,
+                                  p_options->l1i_way_bits, 0, INDEX_MODULO, 0, COMPRESSION_NONE, false, false))
+            return false;
+        hierarchy->l1i_cache.random_key = random_key(hierarchy->random_seed, 3);
+    }
+
+    // Widest addresses whose tags fit in the blocks of every level (the victim cache keeps the l1 tags)
+    hierarchy->tag_address_bits = kept_address_bits(&hierarchy->l1_cache, &hierarchy->l1_cache_mask);
+    if (kept_address_bits(&hierarchy->l2_cache, &hierarchy->l2_cache_mask) < hierarchy->tag_address_bits)
+        hierarchy->tag_address_bits = kept_address_bits(&hierarchy->l2_cache, &hierarchy->l2_cache_mask);
+    if (hierarchy->instruction_cache and
+        (kept_address_bits(&hierarchy->l1i_cache, &hierarchy->l1i_cache_mask) < hierarchy->tag_address_bits))
+        hierarchy->tag_address_bits = kept_address_bits(&hierarchy->l1i_cache, &hierarchy->l1i_cache_mask);
+
+    // Miss attribution
+    hierarchy->attribution_region_bits = (p_options == NULL) ? 0 : p_options->attribution_region_bits;
+    hierarchy->attribution_pc = (p_options != NULL) and (p_options->attribution_pc != 0);
+    if ((hierarchy->attribution_region_bits != 0) and (not setup_attribution_table(&hierarchy->region_attribution)))
+        return false;
+    if (hierarchy->attribution_pc and (not setup_attribution_table(&hierarchy->pc_attribution)))
+        return false;
+
+    // Miss classification. The shadows have the capacity of the levels (half the tags of a compressed l2)
+    hierarchy->miss_classification = (p_options != NULL) and (p_options->miss_classification != 0);
+    if (hierarchy->miss_classification){
+        if (not setup_shadow_cache(&hierarchy->l1_shadow, hierarchy->l1_cache.nb_cache_lines * hierarchy->l1_cache.nb_cache_blocks_per_line))
+            return false;
+        if (not setup_shadow_cache(&hierarchy->l2_shadow, hierarchy->l2_cache.nb_cache_lines * hierarchy->l2_cache.nb_cache_blocks_per_line
+                                   / ((hierarchy->l2_cache.compression == COMPRESSION_NONE) ? 1 : 2)))
+            return false;
+    }
+
+    // Miss trace output, l1 blocks being the unit of the trace
+    hierarchy->miss_trace = (p_options != NULL) and (p_options->miss_trace_file != NULL);
+    if (hierarchy->miss_trace and
+        (not open_miss_trace(&hierarchy->miss_trace_writer, p_options->miss_trace_file,
+                             hierarchy->l1_cache_mask.offset_mask_bit_length))){
+        hierarchy->miss_trace = false;
+        return false;
+    }
+
+    // Address translation
+    hierarchy->page_bits = (p_options == NULL) ? 0 : p_options->page_bits;
+    if (hierarchy->page_bits != 0){
+        bool translation = setup_tlb(&hierarchy->dtlb, (p_options->dtlb_entries == 0) ? 64 : p_options->dtlb_entries,
+                                     (p_options->dtlb_ways == 0) ? 4 : p_options->dtlb_ways);
+        translation = setup_tlb(&hierarchy->stlb, (p_options->stlb_entries == 0) ? 1536 : p_options->stlb_entries,
+                                (p_options->stlb_ways == 0) ? 12 : p_options->stlb_ways) and translation;
+        translation = setup_page_table(&hierarchy->page_table) and translation;
+        if (not translation)
+            return false;
+    }
+
+    // Data mode: the victim cache contents, and the memory content
+    hierarchy->victim_cache.data_arena = NULL;
+    if (data_mode){
+        if (v > 0){
+            hierarchy->victim_cache.data_arena = (char *) calloc(v, data_size);
+            if (hierarchy->victim_cache.data_arena == NULL)
+                return false;
         }
+        if (not setup_memory(&hierarchy->memory, hierarchy->l2_cache.nb_bytes_per_data_block))
+            return false;
     }
+    return true;
+}
 
-    // Compute l2 cache mask values
-    l2_cache_mask.tag_mask = ((unsigned long int) pow(2, 64 - c2 + s2) - 1)  << (c2 - s2);
-    l2_cache_mask.index_mask = (index_length - 1) << b2 ; //pow(2, c2-b2-s2) - 1;
-    l2_cache_mask.offset_mask = data_size - 1; //pow(2, b2) -1;
-    l2_cache_mask.tag_mask_bit_length = 64 - c2 + s2;
-    l2_cache_mask.index_mask_bit_length = c2-b2-s2;
-    l2_cache_mask.offset_mask_bit_length = b2;
+/**
+ * Subroutine giving the results of search_in_cache() for a block that is not in the cache: the replacement candidates
+ * of the set only, without comparing the tags.
+ * @cache The cache
+ * @valid_cache Set to false if the set has an invalid block
+ * @invalid_block Set to the last invalid block of the set that is not the last accessed block, if any
+ * @LRU_block_index Set to the valid block with the lowest LRU (the first one on a tie, 0 if none)
+ * @block_counter Set to the last block of the set
+ * @index_ The cache index
+ */
+static void search_set_for_victim(struct cache_struct *cache, bool *valid_cache, unsigned long int *invalid_block,
+                        unsigned long int *LRU_block_index, unsigned long int *block_counter, unsigned long int index_){
+    unsigned long int last_accessed_block = cache_line(cache, index_)->last_accessed_block;
+    unsigned long int lru_block = 0;
+    unsigned int lru_value = cache_block(cache, index_, 0)->LRU;
+    bool full = true;
+    unsigned long int way = 0;
+    for (way = 0; way < cache->nb_cache_blocks_per_line; way++){
+        const struct block_struct *block = cache_block(cache, index_, way);
+        if (block->valid_bit == 0){
+            full = false;
+            if (way != last_accessed_block)
+                *invalid_block = way;
+        } else if (block->LRU < lru_value){
+            lru_block = way;
+            lru_value = block->LRU;
+        }
+    }
+    *valid_cache = full;
+    *LRU_block_index = lru_block;
+    *block_counter = cache->nb_cache_blocks_per_line - 1;
 }
 
 /**
@@ -111,7 +1058,8 @@ void setup_cache(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
  * @cache The cache in which we should search for the tag
  * @valid_cache  Boolean holding the state of the cache: True -> The cache is full; False -> The cache is not full
  * @invalid_block In case the valid_cache boolean is false, Invalid block will hold the last empty index in the cache
- * @LRU_block_index Holds the index of the block that is the least recently used
+ * @LRU_block_index Holds the index of the block that is the least recently used (LRU_BLOCK_NOT_SEARCHED for a block
+ * ruled out by the presence filter in a full set)
  * @tag_found Boolean holding the state of the search.
  * @block_counter if the tag is found, this variable hold the block position of the tag we were looking for in the cache
  * @index_ The cache index deduced from the memory address given in by the CPU ()
@@ -122,24 +1070,38 @@ void setup_cache(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
                         unsigned long int index_, unsigned long int tag_to_search){
 
     *tag_found = false;
+    if ((cache->presence_filter != NULL) and (not presence_filter_may_contain(cache, index_, tag_to_search))){
+        cache->filtered_lookups += 1;
+        // The blocks of a skewed set are in other sets too: their count is not kept
+        if ((cache->index_function == INDEX_SKEWED) or
+            (cache_line(cache, index_)->valid_blocks < cache->nb_cache_blocks_per_line)){
+            search_set_for_victim(cache, valid_cache, invalid_block, LRU_block_index, block_counter, index_);
+            return;
+        }
+        // Full set: no invalid block, and the set is not read
+        *valid_cache = true;
+        *LRU_block_index = LRU_BLOCK_NOT_SEARCHED;
+        *block_counter = cache->nb_cache_blocks_per_line - 1;
+        return;
+    }
     *valid_cache = true;
     *LRU_block_index = 0;
     *block_counter = 0;
     bool stop_loop = false;
 
     while (not stop_loop){
-        if (cache->cache_lines[index_].blocks[*block_counter].valid_bit == 0) {
+        if (cache_block(cache, index_, *block_counter)->valid_bit == 0) {
             *valid_cache = false;
             // if we find at least one block in this cache line that has the valid bit set to 0,
             // then the cache is not full yet.
             // Make sure that the LRU is not the last value accessed.
-            if (*block_counter != cache->cache_lines[index_].last_accessed_block){
+            if (*block_counter != cache_line(cache, index_)->last_accessed_block){
                 *invalid_block = *block_counter;
             }
         } else {
             // if the valid bit is set for this line, compare the tag.
-            *tag_found = (cache->cache_lines[index_].blocks[*block_counter].tag == tag_to_search);
-            *LRU_block_index = (cache->cache_lines[index_].blocks[*block_counter].LRU < cache->cache_lines[index_].blocks[*LRU_block_index].LRU) ? *block_counter : *LRU_block_index;
+            *tag_found = (cache_block(cache, index_, *block_counter)->tag == tag_to_search);
+            *LRU_block_index = (cache_block(cache, index_, *block_counter)->LRU < cache_block(cache, index_, *LRU_block_index)->LRU) ? *block_counter : *LRU_block_index;
 
         }
         *block_counter += 1;
@@ -149,6 +1111,47 @@ void setup_cache(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
     *block_counter -= 1;
  }
 
+/**
+ * Subroutine to count a miss in its 3C class.
+ * @miss_class Class of the miss (miss_class_t), see shadow_cache_access()
+ * @compulsory_misses Address of the compulsory miss counter of the level
+ * @capacity_misses Address of the capacity miss counter of the level
+ * @conflict_misses Address of the conflict miss counter of the level
+ */
+static inline void count_miss_class(unsigned int miss_class, uint64_t *compulsory_misses, uint64_t *capacity_misses,
+                                    uint64_t *conflict_misses){
+    if (miss_class == MISS_COMPULSORY)
+        *compulsory_misses += 1;
+    else if (miss_class == MISS_CAPACITY)
+        *capacity_misses += 1;
+    else
+        *conflict_misses += 1;
+}
+
+/**
+ * Subroutine called next to each search in l2: every l2 access is an l1 (and victim cache) miss or an l1 write back.
+ * The access runs in the l2 shadow and is classified if it missed (miss classification), and is added to the miss
+ * trace (miss trace output).
+ * @hierarchy Address of the cache hierarchy
+ * @p_stats Pointer to the statistics structure
+ * @kind Kind of the access (miss_trace_kind_t)
+ * @address The memory address searched in l2
+ * @tag_found Result of the search in l2
+ */
+static inline void observe_l2_access(CacheHierarchy *hierarchy, cache_stats_t *p_stats, unsigned int kind, uint64_t address,
+                                     bool tag_found){
+    if (hierarchy->miss_trace){
+        unsigned int l1_block_bits = hierarchy->l1_cache_mask.offset_mask_bit_length;
+        miss_trace_record(&hierarchy->miss_trace_writer, (address >> l1_block_bits) << l1_block_bits, kind);
+        p_stats->miss_trace_records += 1;
+    }
+    if (not hierarchy->miss_classification)
+        return;
+    unsigned int miss_class = shadow_cache_access(&hierarchy->l2_shadow, address >> hierarchy->l2_cache_mask.offset_mask_bit_length);
+    if (not tag_found)
+        count_miss_class(miss_class, &p_stats->compulsory_misses_l2, &p_stats->capacity_misses_l2, &p_stats->conflict_misses_l2);
+}
+
 
 /**
  * Subroutine to read data from ram and setting data in the given cache parameters
@@ -156,83 +1159,432 @@ void setup_cache(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
  * @index_ The index in the cache in which the data should be put
  * @block_ the block number in the set (the index give the set number) in which we should put data
  * @tag the tag associated whith the data read.
+ * @sectors the sectors read. Only those sectors are valid after the read
  */
 void read_ram_set_elements_in_cache(struct cache_struct *cache, unsigned long int index_,
-                            unsigned long int block_, unsigned long int tag){
+                            unsigned long int block_, unsigned long int tag, unsigned int sectors){
 
-    cache->cache_lines[index_].blocks[block_].tag = tag;
+    struct block_struct *block = cache_block(cache, index_, block_);
+    if (cache->presence_filter != NULL){
+        if (block->valid_bit == 1)
+            presence_filter_remove(cache, index_, block->tag);
+        else
+            cache_line(cache, index_)->valid_blocks += 1;
+        presence_filter_add(cache, index_, tag);
+    }
+    block->tag = tag;
+    set_block_sector_valid(cache, block, sectors);
+    set_block_sector_dirty(cache, block, block_sector_dirty(cache, block) & sectors);
     // Newly read data from ram, so the LRU is set to 1
-    cache->cache_lines[index_].blocks[block_].LRU = 1;
-    cache->cache_lines[index_].blocks[block_].valid_bit = 1;
+    cache_block(cache, index_, block_)->LRU = 1;
+    cache_block(cache, index_, block_)->valid_bit = 1;
     // No data to allocate
     // Since read from ram, it is the last accessed block.
-    cache->cache_lines[index_].last_accessed_block = block_;
+    cache_line(cache, index_)->last_accessed_block = block_;
+}
+
+/**
+ * Subroutine to copy some sectors between two block contents (data mode).
+ * @destination Where the sectors are copied
+ * @source Content copied
+ * @sectors Sectors copied
+ * @sector_bits Sectors are 2^sector_bits bytes
+ */
+static void copy_sectors(char *destination, const char *source, unsigned int sectors, unsigned int sector_bits){
+    unsigned int sector = 0;
+    for (sector = 0; (sectors >> sector) != 0; sector++){
+        if (((sectors >> sector) & 1) == 1)
+            memcpy(destination + ((unsigned long int) sector << sector_bits),
+                   source + ((unsigned long int) sector << sector_bits), 1UL << sector_bits);
+    }
+}
+
+/**
+ * Subroutine to replace the content of an l2 block (data mode). The dirty sectors of the block replaced are
+ * written to memory, then the new block is read from memory. Must be called before the new tag is set.
+ * @mem Address of the memory structure
+ * @level2_c address of the level 2 cache
+ * @level2_c_mask level2 cache mask structure
+ * @index_l2 index of the block in l2
+ * @way_l2 block number in the set
+ * @address a memory address in the new block
+ */
+static void replace_l2_block_data(struct memory_struct *mem, struct cache_struct *level2_c,
+                    const struct cache_mask_struct *level2_c_mask,
+                    unsigned long int index_l2, unsigned long int way_l2, uint64_t address){
+    if (level2_c->data_arena == NULL)
+        return;
+    struct block_struct *block = cache_block(level2_c, index_l2, way_l2);
+    char *content = block_data(level2_c, index_l2, way_l2);
+    if ((block->valid_bit == 1) and (block->dirty_bit == 1)){
+        memory_write_sectors(mem, block_address_of(level2_c, level2_c_mask, block->tag, index_l2),
+                             content, block_sector_dirty(level2_c, block), level2_c->sector_bits);
+    }
+    memory_read_block(mem, address >> level2_c_mask->offset_mask_bit_length, content);
+}
+
+/**
+ * Subroutine to copy sectors between an l1 block and the l2 block holding it (data mode).
+ * @level1_c address of the level 1 cache
+ * @level2_c address of the level 2 cache
+ * @level1_c_mask level1 cache mask structure
+ * @level2_c_mask level2 cache mask structure
+ * @index_l1 index of the block in l1
+ * @way_l1 block number in the l1 set
+ * @index_l2 index of the block in l2
+ * @way_l2 block number in the l2 set
+ * @address a memory address in the l1 block
+ * @l1_sectors l1 sectors copied
+ * @to_l1 true to copy from l2 to l1 (fill), false to copy from l1 to l2 (write back)
+ */
+static void copy_block_data_l1_l2(struct cache_struct *level1_c, struct cache_struct *level2_c,
+                    const struct cache_mask_struct *level1_c_mask, const struct cache_mask_struct *level2_c_mask,
+                    unsigned long int index_l1, unsigned long int way_l1,
+                    unsigned long int index_l2, unsigned long int way_l2,
+                    uint64_t address, unsigned int l1_sectors, bool to_l1){
+    if (level1_c->data_arena == NULL)
+        return;
+    // The l1 block is somewhere inside the (larger or equal) l2 block
+    char *l1_content = block_data(level1_c, index_l1, way_l1);
+    char *l2_content = block_data(level2_c, index_l2, way_l2) +
+                       ((address & ~level1_c_mask->offset_mask) & level2_c_mask->offset_mask);
+    if (to_l1){
+        copy_sectors(l1_content, l2_content, l1_sectors, level1_c->sector_bits);
+    } else {
+        copy_sectors(l2_content, l1_content, l1_sectors, level1_c->sector_bits);
+    }
+}
+
+/**
+ * Subroutine to read the element i of a block seen as an array of ELEMENT_T integers.
+ * @content Block content
+ * @i element number
+ */
+template <typename ELEMENT_T>
+static inline ELEMENT_T bdi_element(const char *content, unsigned long int i){
+    ELEMENT_T element;
+    memcpy(&element, content + i * sizeof(ELEMENT_T), sizeof(ELEMENT_T));
+    return element;
+}
+
+/**
+ * Subroutine giving the size of a block encoded with one BASE_T base and DELTA_T deltas.
+ * Every element is either a narrow value (implicit zero base) or a narrow delta from the base, which is the first
+ * element that is not narrow. The element and delta types are fixed, so that the second loop (no early exit, an or
+ * reduction of the same width as the elements) is vectorized.
+ * @content Block content
+ * @size Block size in bytes
+ * Returns the encoded size, or size if the block cannot be encoded this way
+ */
+template <typename BASE_T, typename DELTA_T>
+static inline unsigned long int bdi_encoded_size(const char *content, unsigned long int size){
+    typedef typename std::make_unsigned<BASE_T>::type UNSIGNED_BASE_T;
+    unsigned long int nb_elements = size / sizeof(BASE_T);
+    unsigned long int i = 0;
+    BASE_T base = 0;
+    for (i = 0; i < nb_elements; i++){
+        BASE_T element = bdi_element<BASE_T>(content, i);
+        if (element != (DELTA_T) element){
+            base = element;
+            break;
+        }
+    }
+    UNSIGNED_BASE_T misses = 0;
+    for (i = 0; i < nb_elements; i++){
+        BASE_T element = bdi_element<BASE_T>(content, i);
+        // The delta wraps around like BASE_T integers do: computed unsigned, no signed overflow
+        BASE_T delta = (BASE_T)((UNSIGNED_BASE_T) element - (UNSIGNED_BASE_T) base);
+        misses |= (UNSIGNED_BASE_T)((element != (DELTA_T) element) & (delta != (DELTA_T) delta));
+    }
+    return (misses == 0) ? sizeof(BASE_T) + nb_elements * sizeof(DELTA_T) : size;
+}
+
+/**
+ * Subroutine giving the Base-Delta-Immediate compressed size of a block: the smallest of the zero block,
+ * the repeated 8 byte value and the six base/delta encodings.
+ * @content Block content
+ * @size Block size in bytes (at least 8)
+ */
+static unsigned long int bdi_compressed_size(const char *content, unsigned long int size){
+    unsigned long int i = 0;
+    uint64_t repeated = 0;
+    uint64_t nonzero = 0;
+    uint64_t first = bdi_element<uint64_t>(content, 0);
+    for (i = 0; i < size / 8; i++){
+        uint64_t element = bdi_element<uint64_t>(content, i);
+        repeated |= element ^ first;
+        nonzero |= element;
+    }
+    if (nonzero == 0)
+        return 1;
+    if (repeated == 0)
+        return 8;
+    const unsigned long int encoded[6] = {
+        bdi_encoded_size<int64_t, int8_t>(content, size), bdi_encoded_size<int32_t, int8_t>(content, size),
+        bdi_encoded_size<int64_t, int16_t>(content, size), bdi_encoded_size<int16_t, int8_t>(content, size),
+        bdi_encoded_size<int32_t, int16_t>(content, size), bdi_encoded_size<int64_t, int32_t>(content, size),
+    };
+    unsigned long int best = size;
+    for (i = 0; i < 6; i++){
+        best = (encoded[i] < best) ? encoded[i] : best;
+    }
+    return best;
+}
+
+/**
+ * Subroutine giving the Frequent Pattern Compression size of a block. Each 32 bit word takes a 3 bit prefix and
+ * a 0 to 32 bit payload. Runs of up to 8 zero words share one prefix.
+ * @content Block content
+ * @size Block size in bytes (at least 8)
+ */
+static unsigned long int fpc_compressed_size(const char *content, unsigned long int size){
+    unsigned long int bits = 0;
+    unsigned long int zero_run = 0;
+    unsigned long int i = 0;
+    for (i = 0; i < size / 4; i++){
+        int32_t word = 0;
+        memcpy(&word, content + 4 * i, 4);
+        if (word == 0){
+            // A zero run takes a prefix and a 3 bit run length
+            if (zero_run == 0)
+                bits += 3 + 3;
+            zero_run = (zero_run == 7) ? 0 : zero_run + 1;
+            continue;
+        }
+        zero_run = 0;
+        int16_t low_half = (int16_t)(word & 0xFFFF);
+        int16_t high_half = (int16_t)((uint32_t) word >> 16);
+        if ((word >= -8) and (word < 8)){
+            bits += 3 + 4;
+        } else if ((word >= -128) and (word < 128)){
+            bits += 3 + 8;
+        } else if ((word >= -32768) and (word < 32768)){
+            bits += 3 + 16;
+        } else if (low_half == 0){
+            // Halfword padded with a zero halfword
+            bits += 3 + 16;
+        } else if ((low_half >= -128) and (low_half < 128) and (high_half >= -128) and (high_half < 128)){
+            // Two halfwords, each a sign extended byte
+            bits += 3 + 16;
+        } else if ((uint32_t) word == ((uint32_t)(word & 0xFF) * 0x01010101U)){
+            // Word made of one repeated byte
+            bits += 3 + 8;
+        } else {
+            bits += 3 + 32;
+        }
+    }
+    unsigned long int compressed = (bits + 7) / 8;
+    return (compressed < size) ? compressed : size;
+}
+
+/**
+ * Subroutine to count the valid blocks of a compressed l2 (effective capacity sample).
+ * @level2_c address of the level 2 cache
+ * @histogram if not NULL, the compressed size histogram in which the valid blocks are counted
+ */
+static unsigned long int count_compressed_blocks(struct cache_struct *level2_c, uint64_t *histogram){
+    unsigned long int nb_blocks = 0;
+    unsigned long int segments_per_block = level2_c->nb_bytes_per_data_block >> 3;
+    unsigned long int index_ = 0;
+    unsigned long int way = 0;
+    for (index_ = 0; index_ < level2_c->nb_cache_lines; index_++){
+        for (way = 0; way < level2_c->nb_cache_blocks_per_line; way++){
+            struct block_struct *block = cache_block(level2_c, index_, way);
+            if (block->valid_bit == 0)
+                continue;
+            nb_blocks += 1;
+            if (histogram != NULL)
+                histogram[(level2_c->compressed_segments[block_number(level2_c, block)] * COMPRESSION_HISTOGRAM_BUCKETS - 1) / segments_per_block] += 1;
+        }
+    }
+    return nb_blocks;
+}
+
+/**
+ * Subroutine to compress an l2 block whose content changed (fill or write back), then make room in its set.
+ * While the compressed blocks of the set do not fit in the set budget, the least recently used other block is
+ * evicted (written to memory if dirty). Does nothing for an uncompressed l2.
+ * @hierarchy Address of the cache hierarchy
+ * @p_stats Address of the statistic structure
+ * @level2_c address of the level 2 cache
+ * @level2_c_mask level2 cache mask structure
+ * @index_l2 index of the block in l2
+ * @way_l2 block number in the set
+ */
+static void compress_l2_block(CacheHierarchy *hierarchy, struct cache_stats_t *p_stats, struct cache_struct *level2_c,
+                    const struct cache_mask_struct *level2_c_mask, unsigned long int index_l2, unsigned long int way_l2){
+    if (level2_c->compression == COMPRESSION_NONE)
+        return;
+    unsigned long int size = level2_c->nb_bytes_per_data_block;
+    const char *content = block_data(level2_c, index_l2, way_l2);
+    unsigned long int compressed = (level2_c->compression == COMPRESSION_BDI) ?
+                                   bdi_compressed_size(content, size) : fpc_compressed_size(content, size);
+    unsigned long int segments = (compressed + 7) >> 3;
+    level2_c->compressed_segments[block_number(level2_c, cache_block(level2_c, index_l2, way_l2))] = segments;
+    p_stats->compressed_size_histogram_l2[(segments * COMPRESSION_HISTOGRAM_BUCKETS - 1) / (size >> 3)] += 1;
+
+    while (true){
+        unsigned long int used_segments = 0;
+        unsigned long int victim = way_l2;
+        unsigned long int way = 0;
+        for (way = 0; way < level2_c->nb_cache_blocks_per_line; way++){
+            struct block_struct *block = cache_block(level2_c, index_l2, way);
+            if (block->valid_bit == 0)
+                continue;
+            used_segments += level2_c->compressed_segments[block_number(level2_c, block)];
+            if ((way != way_l2) and ((victim == way_l2) or (block->LRU < cache_block(level2_c, index_l2, victim)->LRU)))
+                victim = way;
+        }
+        if ((used_segments <= level2_c->nb_segments_per_line) or (victim == way_l2))
+            break;
+        // Not enough room left in the set. Evict the LRU block
+        struct block_struct *block = cache_block(level2_c, index_l2, victim);
+        if (block->dirty_bit == 1){
+            p_stats->write_back_l2 += 1;
+            p_stats->bytes_written_back_l2 += sector_bytes(level2_c, block_sector_dirty(level2_c, block));
+            memory_write_sectors(&hierarchy->memory, block_address_of(level2_c, level2_c_mask, block->tag, index_l2),
+                                 block_data(level2_c, index_l2, victim), block_sector_dirty(level2_c, block), level2_c->sector_bits);
+        }
+        p_stats->compression_evictions_l2 += 1;
+        if (level2_c->presence_filter != NULL){
+            presence_filter_remove(level2_c, index_l2, block->tag);
+            cache_line(level2_c, index_l2)->valid_blocks -= 1;
+        }
+        block->valid_bit = 0;
+        block->dirty_bit = 0;
+        set_block_sector_dirty(level2_c, block, 0);
+    }
+
+    // Effective capacity sample
+    hierarchy->compressions_since_sample += 1;
+    if (hierarchy->compressions_since_sample == COMPRESSION_SAMPLE_PERIOD){
+        hierarchy->compressions_since_sample = 0;
+        hierarchy->compression_samples += 1;
+        hierarchy->compression_sampled_blocks += count_compressed_blocks(level2_c, NULL);
+    }
 }
 
 /**
  * Subroutine for setting the LRU index.
  * @cache The address of the cache in which the lru is extracted
  * @index_ The index in the cache (or the set number) in which the lru is located
- * @lru_index The address of the lru index we found in the given cache.
+ * @lru_index The address of the lru index we found in the given cache (LRU_BLOCK_NOT_SEARCHED: searched here)
  */
 void set_Least_Recently_used_index(struct cache_struct *cache, unsigned long int index_,
                     unsigned long int *lru_index){
+    if (*lru_index == LRU_BLOCK_NOT_SEARCHED){
+        bool valid_cache = true;
+        unsigned long int invalid_block = 0;
+        unsigned long int last_block = 0;
+        search_set_for_victim(cache, &valid_cache, &invalid_block, lru_index, &last_block, index_);
+    }
     /** if the smallest value of the LRU in each block is the maximum LRU value,
         then reset the LRU value of every block except the last accessed one.
         Maybe randomly select one block that has the LRU set to 0??*/
-    if (cache->cache_lines[index_].blocks[*lru_index].LRU == LRU_MAX_VALUE){
+    if (cache_block(cache, index_, *lru_index)->LRU == LRU_MAX_VALUE){
         // reset every LRU except the last accessed one.
         unsigned long int block_counter = 0;
         for (block_counter = 0; block_counter <
-        cache->cache_lines[index_].last_accessed_block; block_counter++){
-            cache->cache_lines[index_].blocks[block_counter].LRU = 0;
+        cache_line(cache, index_)->last_accessed_block; block_counter++){
+            cache_block(cache, index_, block_counter)->LRU = 0;
         }
-        for (block_counter = cache->cache_lines[index_].last_accessed_block + 1;
+        for (block_counter = cache_line(cache, index_)->last_accessed_block + 1;
          block_counter < cache->nb_cache_blocks_per_line; block_counter++){
-            cache->cache_lines[index_].blocks[block_counter].LRU = 0;
+            cache_block(cache, index_, block_counter)->LRU = 0;
         }
-        cache->cache_lines[index_].blocks[cache->cache_lines[index_].last_accessed_block].LRU = 1;
-        // Randomly select one number except the last accessed one
-        time_t t;
-        srand((unsigned) time(&t));
-        *lru_index = (rand() % cache->nb_cache_blocks_per_line);
-        while (*lru_index == cache->cache_lines[index_].last_accessed_block){
-            *lru_index = (rand() % cache->nb_cache_blocks_per_line);
+        cache_block(cache, index_, cache_line(cache, index_)->last_accessed_block)->LRU = 1;
+        // Randomly select one number except the last accessed one (the only block of a direct mapped set)
+        if (cache->nb_cache_blocks_per_line == 1){
+            *lru_index = 0;
+            return;
         }
+        *lru_index = random_below(cache, cache_line(cache, index_), cache->nb_cache_blocks_per_line - 1);
+        if (*lru_index >= cache_line(cache, index_)->last_accessed_block)
+            *lru_index += 1;
     }
 }
 
 /**
- * Subroutine to search the victim cache.
- * @v_cache Victim cache in which we should search for the tag
- * @writable_index contains the address of the first index in the victim cache where we can write data
+ * Subroutine giving the first lookup table slot to probe for a victim cache tag (multiplicative hashing).
+ * @v_cache Address of the victim cache
+ * @victim_cache_tag Victim cache tag: the l1 block address, see block_address_of()
+ */
+static inline unsigned long int vcache_lookup_slot(const struct victim_cache_struct *v_cache,
+                    unsigned long int victim_cache_tag){
+    return (unsigned long int)((victim_cache_tag * 0x9E3779B97F4A7C15UL) >> v_cache->lookup_table_shift) & v_cache->lookup_table_mask;
+}
+
+/**
+ * Subroutine to search the victim cache. The lookup table is probed until the tag or an empty slot is found.
+ * @v_cache Address of the victim cache in which we should search for the tag
  * @block_counter contains the block number  in which we foumd the tag in the victim cache.
  * @tag_found boolean to tell if we found the tag in the victim cache or not
  * @victim_cache_tag_sent tag to search for in the victim cache.
  */
-void search_in_vcache(struct victim_cache_struct v_cache,
-                    unsigned long int *writable_index,
+void search_in_vcache(const struct victim_cache_struct *v_cache,
                     unsigned long int *block_counter, bool *tag_found,
                     unsigned long int victim_cache_tag_sent){
 
     *block_counter = 0;
     *tag_found = false;
-    bool stop_loop = false;
-    while (not stop_loop){
-        if (v_cache.victim_cache_lines[*block_counter].victim_cache_block->tag
-         == victim_cache_tag_sent){
+    unsigned long int slot = vcache_lookup_slot(v_cache, victim_cache_tag_sent);
+    while (v_cache->lookup_table[slot] != 0){
+        unsigned long int line = v_cache->lookup_table[slot] - 1;
+        if (v_cache->victim_cache_lines[line].victim_cache_block->tag == victim_cache_tag_sent){
             *tag_found = true;
+            *block_counter = line;
+            return;
         }
-        if (*writable_index == WRITABLE)
-            *writable_index =
-            (v_cache.victim_cache_lines[*block_counter].victim_cache_block->writable
-             == 1)? *block_counter : *writable_index;
-        *block_counter += 1;
-        if ((*block_counter >= v_cache.nb_victim_cache_lines) or (*tag_found)){
-            stop_loop = true;
+        slot = (slot + 1) & v_cache->lookup_table_mask;
+    }
+}
+
+/**
+ * Subroutine to remove a tag from the victim cache lookup table. The following entries of the probe
+ * sequence are shifted back, so that no tombstone is needed and lookups stay short.
+ * @v_cache Address of the victim cache
+ * @victim_cache_tag tag to remove. Must be present in the table.
+ */
+static void vcache_lookup_remove(struct victim_cache_struct *v_cache, unsigned long int victim_cache_tag){
+    unsigned long int slot = vcache_lookup_slot(v_cache, victim_cache_tag);
+    while (v_cache->victim_cache_lines[v_cache->lookup_table[slot] - 1].victim_cache_block->tag != victim_cache_tag){
+        slot = (slot + 1) & v_cache->lookup_table_mask;
+    }
+    unsigned long int next_slot = slot;
+    while (true){
+        next_slot = (next_slot + 1) & v_cache->lookup_table_mask;
+        if (v_cache->lookup_table[next_slot] == 0)
+            break;
+        // An entry can be moved in the hole only if its home slot is not between the hole and its current place
+        unsigned long int home = vcache_lookup_slot(v_cache,
+            v_cache->victim_cache_lines[v_cache->lookup_table[next_slot] - 1].victim_cache_block->tag);
+        if (((next_slot - home) & v_cache->lookup_table_mask) >= ((next_slot - slot) & v_cache->lookup_table_mask)){
+            v_cache->lookup_table[slot] = v_cache->lookup_table[next_slot];
+            slot = next_slot;
         }
     }
-    *block_counter -= 1;
+    v_cache->lookup_table[slot] = 0;
+}
+
+/**
+ * Subroutine to write a tag in a victim cache line. The tag previously held by the line is removed from the lookup table.
+ * @v_cache Address of the victim cache
+ * @line line of the victim cache to overwrite
+ * @victim_cache_tag tag to write: the l1 block address, see block_address_of()
+ */
+static void vcache_set_line(struct victim_cache_struct *v_cache, unsigned long int line,
+                    unsigned long int victim_cache_tag){
+    struct victim_cache_block_struct *block = v_cache->victim_cache_lines[line].victim_cache_block;
+    if (block->valid_bit == 1){
+        vcache_lookup_remove(v_cache, block->tag);
+    }
+    block->tag = victim_cache_tag;
+    block->valid_bit = 1;
+    unsigned long int slot = vcache_lookup_slot(v_cache, victim_cache_tag);
+    while (v_cache->lookup_table[slot] != 0){
+        slot = (slot + 1) & v_cache->lookup_table_mask;
+    }
+    v_cache->lookup_table[slot] = line + 1;
 }
 
 /**
@@ -249,26 +1601,41 @@ void search_in_vcache(struct victim_cache_struct v_cache,
 void exchange_vc_and_l1c_els(char type, struct victim_cache_struct *v_cache,
                 unsigned long int vc_tag_f_index, struct cache_struct *cache,
                 unsigned long int index_c, unsigned long int cache_lru,
-                struct cache_mask_struct cache_mask, unsigned long int tag_searched){
+                const struct cache_mask_struct *cache_mask, unsigned long int tag_searched){
 
-    unsigned long int cache_tag_temp = cache->cache_lines[index_c].blocks[cache_lru].tag;
-    // Updating cache
-    read_ram_set_elements_in_cache(cache, index_c, cache_lru, tag_searched);
+    unsigned long int cache_tag_temp = cache_block(cache, index_c, cache_lru)->tag;
+    if (v_cache->data_arena != NULL){
+        // Data mode: swap the contents
+        char *l1_content = block_data(cache, index_c, cache_lru);
+        char *vc_content = v_cache->data_arena + vc_tag_f_index * v_cache->nb_bytes_per_data_block;
+        unsigned long int byte = 0;
+        for (byte = 0; byte < v_cache->nb_bytes_per_data_block; byte++){
+            char tmp = l1_content[byte];
+            l1_content[byte] = vc_content[byte];
+            vc_content[byte] = tmp;
+        }
+    }
+    unsigned int cache_sectors_temp = block_sector_valid(cache, cache_block(cache, index_c, cache_lru));
+    // Updating cache. The block keeps the sectors it had in the victim cache
+    read_ram_set_elements_in_cache(cache, index_c, cache_lru, tag_searched,
+        v_cache->victim_cache_lines[vc_tag_f_index].victim_cache_block->sector_valid);
     if (type == READ){
-        cache->cache_lines[index_c].blocks[cache_lru].dirty_bit = 0;
+        cache_block(cache, index_c, cache_lru)->dirty_bit = 0;
+        set_block_sector_dirty(cache, cache_block(cache, index_c, cache_lru), 0);
     } else {
         if (type == WRITE){
-            cache->cache_lines[index_c].blocks[cache_lru].dirty_bit = 1;
+            cache_block(cache, index_c, cache_lru)->dirty_bit = 1;
         }
     }
-    //cache->cache_lines[index_c].blocks[cache_lru].tag = tag_sent_l1; //(vc_tmp_tag^index_sent_l1) >> l1_cache_mask.index_mask_bit_length; // Should be equal to tag_sent_l1
-    // Updating Victim cache.
-    v_cache->victim_cache_lines[vc_tag_f_index].victim_cache_block->tag = ((cache_tag_temp << cache_mask.index_mask_bit_length) | index_c);
-    v_cache->victim_cache_lines[vc_tag_f_index].victim_cache_block->writable = 0;
+    //cache_block(cache, index_c, cache_lru)->tag = tag_sent_l1; //(vc_tmp_tag^index_sent_l1) >> l1_cache_mask.index_mask_bit_length; // Should be equal to tag_sent_l1
+    // Updating Victim cache. The l1 block takes the place of the block found, the FIFO order is not changed.
+    vcache_set_line(v_cache, vc_tag_f_index, block_address_of(cache, cache_mask, cache_tag_temp, index_c));
+    v_cache->victim_cache_lines[vc_tag_f_index].victim_cache_block->sector_valid = cache_sectors_temp;
 }
 
 /**
  * Subroutine for l1 write back in l2. It consist in searching for the tag in l2 and do some operations depending on the result
+ * @hierarchy Address of the cache hierarchy
  * @p_stats  address of the Structure for statitics
  * @level1_c address of level 1 cache structure
  * @level2_c address of level 2 cache structure
@@ -277,9 +1644,9 @@ void exchange_vc_and_l1c_els(char type, struct victim_cache_struct *v_cache,
  * @level1_lru least recently used block number (in the set) in level 1 cache
  * @level1_index Index for level 1 cache sent by the CPU
  */
- void write_back_level_1_cache(struct cache_stats_t* p_stats, struct cache_struct* level1_c,
-                struct cache_struct* level2_c, struct cache_mask_struct level1_c_mask,
-                struct cache_mask_struct level2_c_mask, unsigned long int level1_lru,
+ void write_back_level_1_cache(CacheHierarchy *hierarchy, struct cache_stats_t* p_stats,
+                struct cache_struct* level1_c, struct cache_struct* level2_c, const struct cache_mask_struct *level1_c_mask,
+                const struct cache_mask_struct *level2_c_mask, unsigned long int level1_lru,
                 unsigned long int level1_index){
     // Updating stats
     p_stats->write_back_l1 += 1;
@@ -292,26 +1659,35 @@ void exchange_vc_and_l1c_els(char type, struct victim_cache_struct *v_cache,
     unsigned long int l2_lru_block_index = 0;
     unsigned long int l2_block_counter = 0;
     // Setting the index and the tag for L2 cache
-    unsigned long int l1_lru_tag = level1_c->cache_lines[level1_index].blocks[level1_lru].tag;
-    unsigned long int pseudo_mem_address = l1_lru_tag << (level1_c_mask.index_mask_bit_length + level1_c_mask.offset_mask_bit_length);
-    pseudo_mem_address = pseudo_mem_address | (level1_index << level1_c_mask.offset_mask_bit_length);
-    unsigned long int l1_lru_index_in_l2 = (pseudo_mem_address & level2_c_mask.index_mask) >> level2_c_mask.offset_mask_bit_length;
-    unsigned long int l1_lru_tag_in_l2 = (pseudo_mem_address & level2_c_mask.tag_mask) >> (level2_c_mask.index_mask_bit_length + level2_c_mask.offset_mask_bit_length);
+    unsigned long int l1_lru_tag = cache_block(level1_c, level1_index, level1_lru)->tag;
+    unsigned long int pseudo_mem_address = block_address_of(level1_c, level1_c_mask, l1_lru_tag, level1_index)
+                                           << level1_c_mask->offset_mask_bit_length;
+    unsigned long int l1_lru_index_in_l2 = cache_index(level2_c, level2_c_mask, pseudo_mem_address);
+    unsigned long int l1_lru_tag_in_l2 = cache_tag(level2_c, level2_c_mask, pseudo_mem_address);
+    // Only the dirty sectors are written back. They become valid and dirty in l2
+    unsigned int l1_dirty_sectors = block_sector_dirty(level1_c, cache_block(level1_c, level1_index, level1_lru));
+    unsigned int l2_dirty_sectors = map_l1_sectors_in_l2(level1_c, level2_c, level2_c_mask,
+                                                         pseudo_mem_address, l1_dirty_sectors);
+    p_stats->bytes_written_back_l1 += sector_bytes(level1_c, l1_dirty_sectors);
     // Searching for the right tag at the right index in l2
     search_in_cache(level2_c, &valid_l2_cache, &invalid_l2_block, &l2_lru_block_index,
     &l1_lru_tag_found_in_l2, &l2_block_counter, l1_lru_index_in_l2, l1_lru_tag_in_l2);
+    observe_l2_access(hierarchy, p_stats, MISS_TRACE_WRITE_BACK, pseudo_mem_address, l1_lru_tag_found_in_l2);
 
     if (l1_lru_tag_found_in_l2){
+        copy_block_data_l1_l2(level1_c, level2_c, level1_c_mask, level2_c_mask, level1_index, level1_lru,
+                              l1_lru_index_in_l2, l2_block_counter, pseudo_mem_address, l1_dirty_sectors, false);
+        compress_l2_block(hierarchy, p_stats, level2_c, level2_c_mask, l1_lru_index_in_l2, l2_block_counter);
         // The l1 LRU tag is found in l2. We should update its value
-        level2_c->cache_lines[l1_lru_index_in_l2].blocks[l2_block_counter].LRU =
-        (level2_c->cache_lines[l1_lru_index_in_l2].blocks[l2_block_counter].LRU ==
+        cache_block(level2_c, l1_lru_index_in_l2, l2_block_counter)->LRU =
+        (cache_block(level2_c, l1_lru_index_in_l2, l2_block_counter)->LRU ==
         LRU_MAX_VALUE)? LRU_MAX_VALUE :
-        level2_c->cache_lines[l1_lru_index_in_l2].blocks[l2_block_counter].LRU + 1;
+        cache_block(level2_c, l1_lru_index_in_l2, l2_block_counter)->LRU + 1;
         // When write back from l1, it means that this data has not been saved in memory.
         // Therefore, it should be marked as dirty. L2 will write it back in ram at the right time
-        level2_c->cache_lines[l1_lru_index_in_l2].blocks[l2_block_counter].dirty_bit = 1;
-        level2_c->cache_lines[l1_lru_index_in_l2].blocks[l2_block_counter].valid_bit = 1;
-        level2_c->cache_lines[l1_lru_index_in_l2].last_accessed_block = l2_block_counter;
+        set_block_dirty(level2_c, cache_block(level2_c, l1_lru_index_in_l2, l2_block_counter), l2_dirty_sectors);
+        cache_block(level2_c, l1_lru_index_in_l2, l2_block_counter)->valid_bit = 1;
+        cache_line(level2_c, l1_lru_index_in_l2)->last_accessed_block = l2_block_counter;
     } else {
         // Tag not found. Write miss ?
         // Updating stats
@@ -319,51 +1695,65 @@ void exchange_vc_and_l1c_els(char type, struct victim_cache_struct *v_cache,
         if ((not l1_lru_tag_found_in_l2) and (not valid_l2_cache)){
             // Tag not found but found some empty space in l2. Just write it back. (By the way, it is a write miss? seems like)
             // Writing in empty space located at invalid_l2_block.
-            read_ram_set_elements_in_cache(level2_c, l1_lru_index_in_l2, invalid_l2_block, l1_lru_tag_in_l2);
-            level2_c->cache_lines[l1_lru_index_in_l2].blocks[invalid_l2_block].dirty_bit = 1;
+            // The block is not read from memory, only the sectors written back are valid
+            replace_l2_block_data(&hierarchy->memory, level2_c, level2_c_mask, l1_lru_index_in_l2, invalid_l2_block, pseudo_mem_address);
+            read_ram_set_elements_in_cache(level2_c, l1_lru_index_in_l2, invalid_l2_block, l1_lru_tag_in_l2, l2_dirty_sectors);
+            set_block_dirty(level2_c, cache_block(level2_c, l1_lru_index_in_l2, invalid_l2_block), l2_dirty_sectors);
+            copy_block_data_l1_l2(level1_c, level2_c, level1_c_mask, level2_c_mask, level1_index, level1_lru,
+                                  l1_lru_index_in_l2, invalid_l2_block, pseudo_mem_address, l1_dirty_sectors, false);
+            compress_l2_block(hierarchy, p_stats, level2_c, level2_c_mask, l1_lru_index_in_l2, invalid_l2_block);
         } else {
             if ((not l1_lru_tag_found_in_l2) and (valid_l2_cache)){
                 // Tag not found, no empty space. Setting the level 2 cache LRU
                 set_Least_Recently_used_index(level2_c, l1_lru_index_in_l2, &l2_lru_block_index);
                 // Testing if l2_lru has the dirty bit set.
-                if (level2_c->cache_lines[l1_lru_index_in_l2].blocks[l2_lru_block_index].dirty_bit == 1){
+                if (cache_block(level2_c, l1_lru_index_in_l2, l2_lru_block_index)->dirty_bit == 1){
                     // Dirty bit set, L2 write back in ram.
                     p_stats->write_back_l2 += 1;
+                    p_stats->bytes_written_back_l2 += sector_bytes(level2_c,
+                        block_sector_dirty(level2_c, cache_block(level2_c, l1_lru_index_in_l2, l2_lru_block_index)));
                 }
-                read_ram_set_elements_in_cache(level2_c, l1_lru_index_in_l2, l2_lru_block_index, l1_lru_tag_in_l2);
-                level2_c->cache_lines[l1_lru_index_in_l2].blocks[l2_lru_block_index].dirty_bit = 1;
+                replace_l2_block_data(&hierarchy->memory, level2_c, level2_c_mask, l1_lru_index_in_l2, l2_lru_block_index, pseudo_mem_address);
+                read_ram_set_elements_in_cache(level2_c, l1_lru_index_in_l2, l2_lru_block_index, l1_lru_tag_in_l2, l2_dirty_sectors);
+                set_block_dirty(level2_c, cache_block(level2_c, l1_lru_index_in_l2, l2_lru_block_index), l2_dirty_sectors);
+                copy_block_data_l1_l2(level1_c, level2_c, level1_c_mask, level2_c_mask, level1_index, level1_lru,
+                                      l1_lru_index_in_l2, l2_lru_block_index, pseudo_mem_address, l1_dirty_sectors, false);
+                compress_l2_block(hierarchy, p_stats, level2_c, level2_c_mask, l1_lru_index_in_l2, l2_lru_block_index);
             }
         }
     }
  }
 
 /**
- * Subroutine to put the least recently used element of l1 in the victim cache.
+ * Subroutine to put the least recently used element of l1 in the victim cache. The line replaced is the FIFO head.
  * @P_stats Address of the statistic structure
  * @v_cache Address of the victim cache in which we should modify elements
- * @victim_cache_writable_index index in which we should write the data in the victim cache
  * @level1_lru_index least recently used tag in level 1 cache
  * @index_l1 Index sent by the CPU, used in level 1 cache
  * @cache Level 1 cache corresponding to the index sent
  * @level1_c_mask cache mask corresponding to level 1 cache
  */
 void put_l1_el_in_vc(struct cache_stats_t* p_stats, struct victim_cache_struct *v_cache,
-    unsigned long int *victim_cache_writable_index, unsigned long int level1_lru_index,
-    unsigned long int index_l1, struct cache_struct cache, struct cache_mask_struct level1_c_mask){
+    unsigned long int level1_lru_index, unsigned long int index_l1, struct cache_struct *cache,
+    const struct cache_mask_struct *level1_c_mask){
     // moving L1 LRU to victim cache
     if (v_cache->nb_victim_cache_lines > 0){
-        unsigned long int l1_tag_tmp = cache.cache_lines[index_l1].blocks[level1_lru_index].tag;
-        // If the index is still the default value, then the first value inserted in the cache is the index 0
-        *victim_cache_writable_index = (*victim_cache_writable_index == WRITABLE)? 0: *victim_cache_writable_index;
-        v_cache->victim_cache_lines[*victim_cache_writable_index].victim_cache_block->tag =
-        ((l1_tag_tmp << level1_c_mask.index_mask_bit_length) | index_l1);
-        v_cache->victim_cache_lines[*victim_cache_writable_index].victim_cache_block->writable = 0;
+        unsigned long int l1_tag_tmp = cache_block(cache, index_l1, level1_lru_index)->tag;
+        vcache_set_line(v_cache, v_cache->fifo_head, block_address_of(cache, level1_c_mask, l1_tag_tmp, index_l1));
+        v_cache->victim_cache_lines[v_cache->fifo_head].victim_cache_block->sector_valid =
+            block_sector_valid(cache, cache_block(cache, index_l1, level1_lru_index));
+        if (v_cache->data_arena != NULL){
+            memcpy(v_cache->data_arena + v_cache->fifo_head * v_cache->nb_bytes_per_data_block,
+                   block_data(cache, index_l1, level1_lru_index), v_cache->nb_bytes_per_data_block);
+        }
+        v_cache->fifo_head = (v_cache->fifo_head + 1 == v_cache->nb_victim_cache_lines) ? 0 : v_cache->fifo_head + 1;
         p_stats->accesses_vc += 1;
     }
 }
 
 /**
  * Subroutine to copy the element with the right tag from cache l2 to cache l1
+ * @hierarchy Address of the cache hierarchy
  * @level1_c address of the level 1 cache
  * @level2_c address of the level 2 cache
  * @index_l1 Index sent by the CPU used in l1 cache (The cpu send an address from which the index is extracted)
@@ -371,38 +1761,71 @@ void put_l1_el_in_vc(struct cache_stats_t* p_stats, struct victim_cache_struct *
  * @block_index_l1 block of interest from the index sent in level1 cache
  * @block_index_l2 block of interest from the index sent in level2 cache
  * @tag_l1 Tag extracted from address sent by the CPU and used in cache l1
+ * @p_stats Address of the statistic structure
+ * @l1_sectors sector accessed in the l1 block. It is the only sector copied
+ * @l2_sectors sector accessed in the l2 block. It is read from memory if the l2 block does not hold it
  */
- void copy_tag_found_in_l2_to_l1_cache(struct cache_struct *level1_c, struct cache_struct *level2_c,
+ void copy_tag_found_in_l2_to_l1_cache(CacheHierarchy *hierarchy, struct cache_struct *level1_c,
+                    struct cache_struct *level2_c,
                     unsigned long int index_l1, unsigned long int index_l2,
                     unsigned long int block_index_l1, unsigned long int block_index_l2,
-                    unsigned long int tag_l1){
-    // No stats to update here.
+                    unsigned long int tag_l1, struct cache_stats_t* p_stats,
+                    unsigned int l1_sectors, unsigned int l2_sectors){
+    // Only byte counts to update here.
+    struct block_struct *l2_block = cache_block(level2_c, index_l2, block_index_l2);
+    if ((block_sector_valid(level2_c, l2_block) & l2_sectors) == 0){
+        // The l2 block does not hold the sector yet (sector miss). Read it from memory
+        p_stats->sector_misses_l2 += 1;
+        p_stats->bytes_filled_l2 += sector_bytes(level2_c, l2_sectors);
+        set_block_sector_valid(level2_c, l2_block, block_sector_valid(level2_c, l2_block) | l2_sectors);
+    }
+    p_stats->bytes_filled_l1 += sector_bytes(level1_c, l1_sectors);
     // Setting the tag to an invalid place
-    level1_c->cache_lines[index_l1].blocks[block_index_l1].tag =
+    cache_block(level1_c, index_l1, block_index_l1)->tag =
     tag_l1;
     // Setting the dirty bit (Just copy without l2 write back)
-    level1_c->cache_lines[index_l1].blocks[block_index_l1].dirty_bit
-     = level2_c->cache_lines[index_l2].blocks[block_index_l2].dirty_bit;
+    cache_block(level1_c, index_l1, block_index_l1)->dirty_bit
+     = cache_block(level2_c, index_l2, block_index_l2)->dirty_bit;
+    set_block_sector_dirty(level1_c, cache_block(level1_c, index_l1, block_index_l1),
+     (cache_block(level2_c, index_l2, block_index_l2)->dirty_bit == 1) ? l1_sectors : 0);
     // Set the new place as valid
-    level1_c->cache_lines[index_l1].blocks[block_index_l2].valid_bit = 1;
+    cache_block(level1_c, index_l1, block_index_l1)->valid_bit = 1;
+    set_block_sector_valid(level1_c, cache_block(level1_c, index_l1, block_index_l1), l1_sectors);
     // No data to copy
     // Newly accessed data. Increment the LRU value
-    level1_c->cache_lines[index_l1].blocks[block_index_l2].LRU = 1;
+    cache_block(level1_c, index_l1, block_index_l1)->LRU = 1;
     // Set this new place as the last accessed
-    level1_c->cache_lines[index_l1].last_accessed_block = block_index_l1;
+    cache_line(level1_c, index_l1)->last_accessed_block = block_index_l1;
+    // Copy data (data mode only)
+    uint64_t l1_address = block_address_of(level1_c, &hierarchy->l1_cache_mask, tag_l1, index_l1) << hierarchy->l1_cache_mask.offset_mask_bit_length;
+    if ((level1_c->data_arena != NULL) and
+        (cache_block(level2_c, index_l2, block_index_l2)->tag != cache_tag(level2_c, &hierarchy->l2_cache_mask, l1_address))){
+        // The l1 write back done just before replaced the l2 block, which was written to memory. Read it there.
+        char *content = memory_find_block(&hierarchy->memory, l1_address >> hierarchy->l2_cache_mask.offset_mask_bit_length);
+        char *l1_content = block_data(level1_c, index_l1, block_index_l1);
+        if (content == NULL){
+            memset(l1_content, 0, 1UL << hierarchy->l1_cache_mask.offset_mask_bit_length);
+        } else {
+            copy_sectors(l1_content, content + (l1_address & hierarchy->l2_cache_mask.offset_mask), l1_sectors, level1_c->sector_bits);
+        }
+    } else {
+        copy_block_data_l1_l2(level1_c, level2_c, &hierarchy->l1_cache_mask, &hierarchy->l2_cache_mask, index_l1, block_index_l1,
+                              index_l2, block_index_l2, l1_address, l1_sectors, true);
+    }
     // Increment the LRU value of this block in l2 since it was accessed.
-    level2_c->cache_lines[index_l2].blocks[block_index_l2].LRU =
-    (level2_c->cache_lines[index_l2].blocks[block_index_l2].LRU ==
+    cache_block(level2_c, index_l2, block_index_l2)->LRU =
+    (cache_block(level2_c, index_l2, block_index_l2)->LRU ==
      LRU_MAX_VALUE)? LRU_MAX_VALUE :
-     level2_c->cache_lines[index_l2].blocks[block_index_l2].LRU + 1;;
+     cache_block(level2_c, index_l2, block_index_l2)->LRU + 1;;
     // Set block counter as the last accessed block in l2
-    level2_c->cache_lines[index_l2].last_accessed_block =
+    cache_line(level2_c, index_l2)->last_accessed_block =
     block_index_l2;
 
  }
 
 /**
  * Subroutine used to write back in l2, and move element in the victim cache in case we are searching in cache l2 and the cache l1 is valid
+ * @hierarchy Address of the cache hierarchy
  * @level1_c Address of the level 1 cache
  * @level2_c Address of the level 2 cache
  * @v_cache Address of the victim cache
@@ -415,20 +1838,21 @@ void put_l1_el_in_vc(struct cache_stats_t* p_stats, struct victim_cache_struct *
  * @level2_lru least recently used block index in cache l2
  * @p_stats Address of the statistic structure
  * @tag_block_in_l2 block index corresponding to the tag we were looking for in l2 cache
- * @v_cache_writable_index Index of a block where we can erase data in the victim cache
  * @tag_sent_l1 Memory tag sent by the CPU to cache l1
+ * @l1_sectors sector accessed in the l1 block
+ * @l2_sectors sector accessed in the l2 block
  */
-void write_back_l1_move_to_vc_copy_tag_found_in_l2(struct cache_struct *level1_c,
+void write_back_l1_move_to_vc_copy_tag_found_in_l2(CacheHierarchy *hierarchy, struct cache_struct *level1_c,
             struct cache_struct *level2_c, struct victim_cache_struct *v_cache,
-            struct cache_mask_struct level1_c_mask,struct cache_mask_struct level2_c_mask,
+            const struct cache_mask_struct *level1_c_mask, const struct cache_mask_struct *level2_c_mask,
             unsigned long int *level1_lru, unsigned long int level1_index,
             unsigned long int level2_index, bool tag_found_in_l2, unsigned long int *level2_lru,
             struct cache_stats_t* p_stats, unsigned long int tag_block_in_l2,
-            unsigned long int *v_cache_writable_index, unsigned long int tag_sent_l1){
+            unsigned long int tag_sent_l1, unsigned int l1_sectors, unsigned int l2_sectors){
 
     // Setting the LRU in l1 cache
     set_Least_Recently_used_index(level1_c, level1_index, level1_lru);
-    if (level1_c->cache_lines[level1_index].blocks[*level1_lru].dirty_bit == 1){
+    if (cache_block(level1_c, level1_index, *level1_lru)->dirty_bit == 1){
         // Dirty bit is set. Write back in l2
         if (tag_found_in_l2){
             // Make sure the LRU in cache l2 is not the element we try to access.
@@ -440,10 +1864,10 @@ void write_back_l1_move_to_vc_copy_tag_found_in_l2(struct cache_struct *level1_c
                 unsigned long int second_l2_lru = 0;
                 unsigned long int counter = 0;
                 while (not stop_loop){
-                    if ((level2_c->cache_lines[level2_index].blocks[counter].LRU < level2_c->cache_lines[level2_index].blocks[second_l2_lru].LRU)
+                    if ((cache_block(level2_c, level2_index, counter)->LRU < cache_block(level2_c, level2_index, second_l2_lru)->LRU)
                      and (counter != tag_block_in_l2)){
                      // Make sure that the LRU is not the last value accessed.
-                        if (counter != level2_c->cache_lines[level2_index].last_accessed_block){
+                        if (counter != cache_line(level2_c, level2_index)->last_accessed_block){
                             second_l2_lru = counter;
                         }
                     }
@@ -453,38 +1877,167 @@ void write_back_l1_move_to_vc_copy_tag_found_in_l2(struct cache_struct *level1_c
                     }
                 }
                 // Making the second LRU less than the first LRU
-                if (level2_c->cache_lines[level2_index].blocks[tag_block_in_l2].LRU > 0){
-                    level2_c->cache_lines[level2_index].blocks[second_l2_lru].LRU = level2_c->cache_lines[level2_index].blocks[tag_block_in_l2].LRU - 1;
+                if (cache_block(level2_c, level2_index, tag_block_in_l2)->LRU > 0){
+                    cache_block(level2_c, level2_index, second_l2_lru)->LRU = cache_block(level2_c, level2_index, tag_block_in_l2)->LRU - 1;
                 }else{
-                    level2_c->cache_lines[level2_index].blocks[second_l2_lru].LRU = 0;
-                    level2_c->cache_lines[level2_index].blocks[tag_block_in_l2].LRU = 1;
+                    cache_block(level2_c, level2_index, second_l2_lru)->LRU = 0;
+                    cache_block(level2_c, level2_index, tag_block_in_l2)->LRU = 1;
                 }
             }
         }
-        // The LRU has the diry bit set.l1 write back in l2
-        write_back_level_1_cache(p_stats, level1_c, level2_c,
-        level1_c_mask, level2_c_mask, *level1_lru, level1_index);
+        // The LRU has the diry bit set.l1 write back in l2
+        write_back_level_1_cache(hierarchy, p_stats, level1_c, level2_c,
+        level1_c_mask, level2_c_mask, *level1_lru, level1_index);
+
+    }
+
+    put_l1_el_in_vc(p_stats, v_cache, *level1_lru, level1_index, level1_c, level1_c_mask);
+     if (tag_found_in_l2){
+        // Then we should copy data from l2 to l1 LRU block index.
+        copy_tag_found_in_l2_to_l1_cache(hierarchy, level1_c, level2_c, level1_index,
+            level2_index, *level1_lru, tag_block_in_l2, tag_sent_l1, p_stats, l1_sectors, l2_sectors);
+     }
+}
+
+/**
+ * Subroutine to read a sector missing from a block present in l1 (sector miss). The sector is read from l2,
+ * which reads it from memory if needed. Only sectored caches take this path.
+ * @hierarchy Address of the cache hierarchy
+ * @type The type of access to the cache (r or w)
+ * @arg The target memory address
+ * @p_stats Address of the statistic structure
+ * @index_l1 index of the l1 block
+ * @way_l1 block number in the l1 set
+ */
+void fetch_l1_sector_from_l2(CacheHierarchy *hierarchy, char type, uint64_t arg, cache_stats_t* p_stats,
+                    unsigned long int index_l1, unsigned long int way_l1){
+    p_stats->sector_misses_l1 += 1;
+    p_stats->accesses_l2 += 1;
+    p_stats->bytes_filled_l1 += sector_bytes(&hierarchy->l1_cache, sector_mask_of(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg));
+
+    bool valid_l2_cache = true;
+    bool tag_found_in_l2 = false;
+    unsigned long int invalid_l2_block = 0;
+    unsigned long int l2_LRU_block_index = 0;
+    unsigned long int block_counter = 0;
+    unsigned long int index_sent_l2 = cache_index(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
+    unsigned long int tag_sent_l2 = cache_tag(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
+    unsigned int sector_l2 = sector_mask_of(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
+    search_in_cache(&hierarchy->l2_cache, &valid_l2_cache, &invalid_l2_block,
+    &l2_LRU_block_index, &tag_found_in_l2, &block_counter, index_sent_l2,
+    tag_sent_l2);
+    observe_l2_access(hierarchy, p_stats, (type == WRITE) ? MISS_TRACE_WRITE : MISS_TRACE_READ, arg, tag_found_in_l2);
+
+    if (tag_found_in_l2){
+        struct block_struct *l2_block = cache_block(&hierarchy->l2_cache, index_sent_l2, block_counter);
+        l2_block->LRU = (l2_block->LRU == LRU_MAX_VALUE) ? LRU_MAX_VALUE : l2_block->LRU + 1;
+        cache_line(&hierarchy->l2_cache, index_sent_l2)->last_accessed_block = block_counter;
+        if ((block_sector_valid(&hierarchy->l2_cache, l2_block) & sector_l2) == 0){
+            // Sector miss in l2 too. Read the sector from memory
+            p_stats->sector_misses_l2 += 1;
+            p_stats->bytes_filled_l2 += sector_bytes(&hierarchy->l2_cache, sector_l2);
+            set_block_sector_valid(&hierarchy->l2_cache, l2_block, block_sector_valid(&hierarchy->l2_cache, l2_block) | sector_l2);
+        }
+        copy_block_data_l1_l2(&hierarchy->l1_cache, &hierarchy->l2_cache, &hierarchy->l1_cache_mask, &hierarchy->l2_cache_mask, index_l1, way_l1,
+                              index_sent_l2, block_counter, arg, sector_mask_of(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg), true);
+        return;
+    }
 
+    // The block is not in l2 any more. Allocate it, with only the sector read from memory.
+    if (type == READ){
+        p_stats->read_misses_l2 += 1;
+    } else {
+        if (type == WRITE){
+            p_stats->write_misses_l2 += 1;
+        }
+    }
+    if (valid_l2_cache){
+        set_Least_Recently_used_index(&hierarchy->l2_cache, index_sent_l2, &l2_LRU_block_index);
+        if (cache_block(&hierarchy->l2_cache, index_sent_l2, l2_LRU_block_index)->dirty_bit == 1){
+            p_stats->write_back_l2 += 1;
+            p_stats->bytes_written_back_l2 += sector_bytes(&hierarchy->l2_cache,
+                block_sector_dirty(&hierarchy->l2_cache, cache_block(&hierarchy->l2_cache, index_sent_l2, l2_LRU_block_index)));
+        }
+        invalid_l2_block = l2_LRU_block_index;
     }
+    replace_l2_block_data(&hierarchy->memory, &hierarchy->l2_cache, &hierarchy->l2_cache_mask, index_sent_l2, invalid_l2_block, arg);
+    read_ram_set_elements_in_cache(&hierarchy->l2_cache, index_sent_l2, invalid_l2_block, tag_sent_l2, sector_l2);
+    compress_l2_block(hierarchy, p_stats, &hierarchy->l2_cache, &hierarchy->l2_cache_mask, index_sent_l2, invalid_l2_block);
+    cache_block(&hierarchy->l2_cache, index_sent_l2, invalid_l2_block)->dirty_bit = 0;
+    set_block_sector_dirty(&hierarchy->l2_cache, cache_block(&hierarchy->l2_cache, index_sent_l2, invalid_l2_block), 0);
+    p_stats->bytes_filled_l2 += sector_bytes(&hierarchy->l2_cache, sector_l2);
+    copy_block_data_l1_l2(&hierarchy->l1_cache, &hierarchy->l2_cache, &hierarchy->l1_cache_mask, &hierarchy->l2_cache_mask, index_l1, way_l1,
+                          index_sent_l2, invalid_l2_block, arg, sector_mask_of(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg), true);
+}
 
-    put_l1_el_in_vc(p_stats, v_cache, v_cache_writable_index, *level1_lru,
-    level1_index, *level1_c, level1_c_mask);
-     if (tag_found_in_l2){
-        // Then we should copy data from l2 to l1 LRU block index.
-        copy_tag_found_in_l2_to_l1_cache(level1_c, level2_c, level1_index,
-            level2_index, *level1_lru, tag_block_in_l2, tag_sent_l1);
-     }
+/**
+ * Subroutine translating a virtual address through the data TLB, then the second level TLB, then the page table.
+ * Also counts the accesses whose l1 set would change if l1 were indexed with the virtual address (VIPT l1).
+ * @hierarchy Address of the cache hierarchy
+ * @arg The virtual address
+ * @p_stats Pointer to the statistics structure
+ * Returns the physical address
+ */
+static uint64_t translate_address(CacheHierarchy *hierarchy, uint64_t arg, cache_stats_t *p_stats){
+    uint64_t vpn = arg >> hierarchy->page_bits;
+    uint64_t pfn = 0;
+    if (not tlb_lookup(&hierarchy->dtlb, vpn, &pfn)){
+        p_stats->dtlb_misses += 1;
+        if (not tlb_lookup(&hierarchy->stlb, vpn, &pfn)){
+            p_stats->page_walks += 1;
+            pfn = page_table_walk(&hierarchy->page_table, vpn, p_stats);
+            tlb_insert(&hierarchy->stlb, vpn, pfn);
+        }
+        tlb_insert(&hierarchy->dtlb, vpn, pfn);
+    }
+    uint64_t physical_address = (pfn << hierarchy->page_bits) | (arg & ((1UL << hierarchy->page_bits) - 1));
+    if (cache_index(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg) !=
+        cache_index(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, physical_address)){
+        p_stats->vipt_index_mismatches += 1;
+    }
+    return physical_address;
 }
 
 /**
- * Subroutine that simulates the cache one trace event at a time.
- * XXX: You're responsible for completing this routine
+ * Subroutine that simulates the cache one trace event at a time, once the address is physical.
  *
+ * @hierarchy Address of the cache hierarchy
  * @type The type of event, can be READ or WRITE.
- * @arg  The target memory address
+ * @arg  The target memory address (physical)
+ * @decoded Set indexes and tags of arg (see decode_address()), NULL to compute them
  * @p_stats Pointer to the statistics structure
  */
-void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
+static void simulate_physical_access(CacheHierarchy *hierarchy, char type, uint64_t arg,
+                                     const struct decoded_address_struct *decoded, cache_stats_t* p_stats) {
+
+    // Same block as the previous access, which hit: the block is still the last accessed block of its set, so a hit
+    // only updates the counters, the LRU and the dirty bits
+    struct block_struct *last_block = hierarchy->l1_last_block;
+    if ((last_block != NULL) and ((arg >> hierarchy->l1_cache_mask.offset_mask_bit_length) == hierarchy->l1_last_block_address)){
+        unsigned int sector = sector_mask_of(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg);
+        if ((block_sector_valid(&hierarchy->l1_cache, last_block) & sector) != 0){
+            p_stats->accesses += 1;
+            if (type == READ){
+                p_stats->reads += 1;
+            } else {
+                if (type == WRITE){
+                    p_stats->writes += 1;
+                }
+            }
+            last_block->LRU = (last_block->LRU == LRU_MAX_VALUE) ? LRU_MAX_VALUE : last_block->LRU + 1;
+            if (type == WRITE){
+                set_block_dirty(&hierarchy->l1_cache, last_block, sector);
+            }
+            print_marker(hierarchy, "H1****\n");
+            return;
+        }
+    }
+    // Anything but a hit may move blocks: the hit branches set the block again
+    hierarchy->l1_last_block = NULL;
+
+    // Specialized l1 hit path, when the l1 geometry has one
+    if ((hierarchy->l1_hit_kernel != NULL) and hierarchy->l1_hit_kernel(hierarchy, type, arg, p_stats))
+        return;
 
     // Access in cache
     p_stats->accesses += 1;
@@ -506,13 +2059,14 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
     /** Search in L1 first. */
     unsigned long int l1_LRU_block_index = 0;
     // First step, get the index.
-    unsigned long int index_sent_l1 = (arg & l1_cache_mask.index_mask) >>
-    l1_cache_mask.offset_mask_bit_length;
+    unsigned long int index_sent_l1 = (decoded != NULL) ? decoded->index_l1 : cache_index(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg);
     // Second step, get the tag.
-    unsigned long int tag_sent_l1 = (arg & l1_cache_mask.tag_mask) >>
-    (l1_cache_mask.offset_mask_bit_length + l1_cache_mask.index_mask_bit_length);
+    unsigned long int tag_sent_l1 = (decoded != NULL) ? decoded->tag_l1 : cache_tag(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg);
+    // Sectors accessed in the l1 and l2 blocks (always 1 for unsectored caches)
+    unsigned int sector_l1 = sector_mask_of(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg);
+    unsigned int sector_l2 = sector_mask_of(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
     //Search for the tag in the cache line index_sent.
-    search_in_cache(&l1_cache, &valid_l1_cache, &invalid_l1_block,
+    search_in_cache(&hierarchy->l1_cache, &valid_l1_cache, &invalid_l1_block,
     &l1_LRU_block_index, &tag_found_in_l1, &block_counter, index_sent_l1,
     tag_sent_l1);
     /**
@@ -536,17 +2090,25 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
     */
     if (tag_found_in_l1) {
         /** Eight bits LRU. Either add 1 or set the max value. */
-        l1_cache.cache_lines[index_sent_l1].blocks[block_counter].LRU =
-        (l1_cache.cache_lines[index_sent_l1].blocks[block_counter].LRU ==
+        cache_block(&hierarchy->l1_cache, index_sent_l1, block_counter)->LRU =
+        (cache_block(&hierarchy->l1_cache, index_sent_l1, block_counter)->LRU ==
         LRU_MAX_VALUE)? LRU_MAX_VALUE :
-        l1_cache.cache_lines[index_sent_l1].blocks[block_counter].LRU + 1;
+        cache_block(&hierarchy->l1_cache, index_sent_l1, block_counter)->LRU + 1;
         // Set the last accessed block in l1
-        l1_cache.cache_lines[index_sent_l1].last_accessed_block = block_counter;
+        cache_line(&hierarchy->l1_cache, index_sent_l1)->last_accessed_block = block_counter;
+        // A sectored block may not hold the sector accessed yet
+        struct block_struct *l1_block = cache_block(&hierarchy->l1_cache, index_sent_l1, block_counter);
+        if ((block_sector_valid(&hierarchy->l1_cache, l1_block) & sector_l1) == 0){
+            fetch_l1_sector_from_l2(hierarchy, type, arg, p_stats, index_sent_l1, block_counter);
+            set_block_sector_valid(&hierarchy->l1_cache, l1_block, block_sector_valid(&hierarchy->l1_cache, l1_block) | sector_l1);
+        }
         // If write, set the dirty bit
         if (type == WRITE){
-            l1_cache.cache_lines[index_sent_l1].blocks[block_counter].dirty_bit = 1;
+            set_block_dirty(&hierarchy->l1_cache, cache_block(&hierarchy->l1_cache, index_sent_l1, block_counter), sector_l1);
         }
-        printf("H1****\n");
+        hierarchy->l1_last_block = cache_block(&hierarchy->l1_cache, index_sent_l1, block_counter);
+        hierarchy->l1_last_block_address = arg >> hierarchy->l1_cache_mask.offset_mask_bit_length;
+        print_marker(hierarchy, "H1****\n");
     } else {
         /** First outcome: The cache line is not full (cache not valid),
             and tag is not found in l1.
@@ -567,7 +2129,7 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
                     p_stats->write_misses_l1 += 1;
                 }
             }
-            printf ("M1Mv");
+            print_marker(hierarchy, "M1Mv");
             /** Searching in L2 cache */
             p_stats->accesses_l2 += 1;
             block_counter = 0;
@@ -577,13 +2139,14 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
             /** Searching in L2. */
             unsigned long int l2_LRU_block_index = 0;
             // First step, get the index.
-            unsigned long int index_sent_l2 = (arg & l2_cache_mask.index_mask) >> l2_cache_mask.offset_mask_bit_length;
+            unsigned long int index_sent_l2 = (decoded != NULL) ? decoded->index_l2 : cache_index(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
             // Second step, get the tag.
-            unsigned long int tag_sent_l2 = (arg & l2_cache_mask.tag_mask) >> (l2_cache_mask.offset_mask_bit_length + l2_cache_mask.index_mask_bit_length);
+            unsigned long int tag_sent_l2 = (decoded != NULL) ? decoded->tag_l2 : cache_tag(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
             // Searching
-            search_in_cache(&l2_cache, &valid_l2_cache, &invalid_l2_block,
+            search_in_cache(&hierarchy->l2_cache, &valid_l2_cache, &invalid_l2_block,
             &l2_LRU_block_index, &tag_found_in_l2, &block_counter, index_sent_l2,
             tag_sent_l2);
+            observe_l2_access(hierarchy, p_stats, (type == WRITE) ? MISS_TRACE_WRITE : MISS_TRACE_READ, arg, tag_found_in_l2);
 
             /** Possible outcomes:
                 - The tag is found, then we should move data in l1
@@ -593,30 +2156,36 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
             */
 
             /** 1- The tag is found in cache l2.
-                Copy data from l2 to l1. Remember: here, l1_cache is not full yet.
+                Copy data from l2 to l1. Remember: here, hierarchy->l1_cache is not full yet.
             */
             if (tag_found_in_l2){
-                copy_tag_found_in_l2_to_l1_cache(&l1_cache, &l2_cache, index_sent_l1,
-                index_sent_l2, invalid_l1_block, block_counter, tag_sent_l1);
-                printf ("H2\n");
+                copy_tag_found_in_l2_to_l1_cache(hierarchy, &hierarchy->l1_cache, &hierarchy->l2_cache, index_sent_l1,
+                index_sent_l2, invalid_l1_block, block_counter, tag_sent_l1, p_stats, sector_l1, sector_l2);
+                print_marker(hierarchy, "H2\n");
                 if (type == WRITE){
                     // If write, only set dirty bit in l1, since data will be write back from l1 to l2 if it is not used.
-                    l1_cache.cache_lines[index_sent_l1].blocks[invalid_l1_block].dirty_bit = 1;
+                    set_block_dirty(&hierarchy->l1_cache, cache_block(&hierarchy->l1_cache, index_sent_l1, invalid_l1_block), sector_l1);
                     /** If the teacher tell us to set the dirty bit in both, then uncomment the following line */
-                    // l2_cache.cache_lines[index_sent_l2].blocks[invalid_l2_block].dirty_bit = 1;
+                    // cache_block(&l2_cache, index_sent_l2, invalid_l2_block)->dirty_bit = 1;
                 }
             }
 
             /** 2- The tag is not found in l2, and the l2 cache is not full.
                 L1 and  L2 cache are not full yet. There are invalid place in both */
             if ((not tag_found_in_l2) and (not valid_l2_cache)){
-                printf ("M2\n");
+                print_marker(hierarchy, "M2\n");
                 // Read data from ram and place it in l2 cache
-                read_ram_set_elements_in_cache(&l2_cache, index_sent_l2,
-                invalid_l2_block, tag_sent_l2);
+                replace_l2_block_data(&hierarchy->memory, &hierarchy->l2_cache, &hierarchy->l2_cache_mask, index_sent_l2, invalid_l2_block, arg);
+                read_ram_set_elements_in_cache(&hierarchy->l2_cache, index_sent_l2,
+                invalid_l2_block, tag_sent_l2, sector_l2);
+                compress_l2_block(hierarchy, p_stats, &hierarchy->l2_cache, &hierarchy->l2_cache_mask, index_sent_l2, invalid_l2_block);
                 // Also set data in l1 cache
-                read_ram_set_elements_in_cache(&l1_cache, index_sent_l1,
-                invalid_l1_block, tag_sent_l1);
+                read_ram_set_elements_in_cache(&hierarchy->l1_cache, index_sent_l1,
+                invalid_l1_block, tag_sent_l1, sector_l1);
+                copy_block_data_l1_l2(&hierarchy->l1_cache, &hierarchy->l2_cache, &hierarchy->l1_cache_mask, &hierarchy->l2_cache_mask, index_sent_l1, invalid_l1_block,
+                                      index_sent_l2, invalid_l2_block, arg, sector_l1, true);
+                p_stats->bytes_filled_l2 += sector_bytes(&hierarchy->l2_cache, sector_l2);
+                p_stats->bytes_filled_l1 += sector_bytes(&hierarchy->l1_cache, sector_l1);
                 // stats
                 if (type == READ){
                     p_stats->read_misses_l2 += 1;
@@ -624,9 +2193,9 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
                     if (type == WRITE){
                         p_stats->write_misses_l2 += 1;
                         // If write, only set dirty bit in l1, since data will be write back from l1 to l2 if it is not used.
-                        l1_cache.cache_lines[index_sent_l1].blocks[invalid_l1_block].dirty_bit = 1;
+                        set_block_dirty(&hierarchy->l1_cache, cache_block(&hierarchy->l1_cache, index_sent_l1, invalid_l1_block), sector_l1);
                         /** If the teacher tell us to set the dirty bit in both, then uncomment the following line */
-                        // l2_cache.cache_lines[index_sent_l2].blocks[invalid_l2_block].dirty_bit = 1;
+                        // cache_block(&l2_cache, index_sent_l2, invalid_l2_block)->dirty_bit = 1;
                     }
                 }
             }
@@ -634,19 +2203,27 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
             /** 3- The tag is not found in l2 and the l2 cache is full (l1 still have some place left),
             every valid bit is set. Search for the LRU and replace it LRU is given by the l2_LRU_block_index */
             if ((not tag_found_in_l2) and (valid_l2_cache)){
-                printf("M1MvM2\n");
+                print_marker(hierarchy, "M1MvM2\n");
                 // Setting the LRU value
-                set_Least_Recently_used_index(&l2_cache, index_sent_l2, &l2_LRU_block_index);
+                set_Least_Recently_used_index(&hierarchy->l2_cache, index_sent_l2, &l2_LRU_block_index);
                 // Updating stats if the LRU has the dirty bit set.
-                if (l2_cache.cache_lines[index_sent_l2].blocks[l2_LRU_block_index].dirty_bit == 1){
+                if (cache_block(&hierarchy->l2_cache, index_sent_l2, l2_LRU_block_index)->dirty_bit == 1){
                     p_stats->write_back_l2 += 1;
+                    p_stats->bytes_written_back_l2 += sector_bytes(&hierarchy->l2_cache,
+                        block_sector_dirty(&hierarchy->l2_cache, cache_block(&hierarchy->l2_cache, index_sent_l2, l2_LRU_block_index)));
                 }
                 // Read data from ram and place it in l2 cache
-                read_ram_set_elements_in_cache(&l2_cache, index_sent_l2,
-                l2_LRU_block_index, tag_sent_l2);
+                replace_l2_block_data(&hierarchy->memory, &hierarchy->l2_cache, &hierarchy->l2_cache_mask, index_sent_l2, l2_LRU_block_index, arg);
+                read_ram_set_elements_in_cache(&hierarchy->l2_cache, index_sent_l2,
+                l2_LRU_block_index, tag_sent_l2, sector_l2);
+                compress_l2_block(hierarchy, p_stats, &hierarchy->l2_cache, &hierarchy->l2_cache_mask, index_sent_l2, l2_LRU_block_index);
                 // Also set data in l1 cache
-                read_ram_set_elements_in_cache(&l1_cache, index_sent_l1,
-                invalid_l1_block, tag_sent_l1);
+                read_ram_set_elements_in_cache(&hierarchy->l1_cache, index_sent_l1,
+                invalid_l1_block, tag_sent_l1, sector_l1);
+                copy_block_data_l1_l2(&hierarchy->l1_cache, &hierarchy->l2_cache, &hierarchy->l1_cache_mask, &hierarchy->l2_cache_mask, index_sent_l1, invalid_l1_block,
+                                      index_sent_l2, l2_LRU_block_index, arg, sector_l1, true);
+                p_stats->bytes_filled_l2 += sector_bytes(&hierarchy->l2_cache, sector_l2);
+                p_stats->bytes_filled_l1 += sector_bytes(&hierarchy->l1_cache, sector_l1);
                 // stats
                 if (type == READ){
                     p_stats->read_misses_l2 += 1;
@@ -654,15 +2231,15 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
                     if (type == WRITE){
                         p_stats->write_misses_l2 += 1;
                         // If write, only set dirty bit in l1, since data will be write back from l1 to l2 if it is not used.
-                        l1_cache.cache_lines[index_sent_l1].blocks[invalid_l1_block].dirty_bit = 1;
+                        set_block_dirty(&hierarchy->l1_cache, cache_block(&hierarchy->l1_cache, index_sent_l1, invalid_l1_block), sector_l1);
                         /** If the teacher tell us to set the dirty bit in both, then uncomment the following line */
-                        // l2_cache.cache_lines[index_sent_l2].blocks[invalid_l2_block].dirty_bit = 1;
+                        // cache_block(&l2_cache, index_sent_l2, invalid_l2_block)->dirty_bit = 1;
                     }
                 }
             }
 
         } else {
-            printf ("M1");
+            print_marker(hierarchy, "M1");
             /** l1 cache is full, we should search for the tag in the victim cache first */
             if ((not tag_found_in_l1) and (valid_l1_cache)){
                 // Setting stats
@@ -674,10 +2251,9 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
                     }
                 }
 
-                unsigned long int victim_cache_writable_index = WRITABLE;
                 bool tag_found_in_vc = false;
                 // Searching in victim cache.
-                if (victim_cache.nb_victim_cache_lines > 0){
+                if (hierarchy->victim_cache.nb_victim_cache_lines > 0){
                     // Updating stats
                     p_stats->accesses_vc += 1;
                     // Searching in the victim cache
@@ -686,40 +2262,46 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
                     // Victim cache tag is compose of the index appended at the end of the l1 tags.
                     // Victim cache tag should hold information on the index.
                     unsigned long int victim_cache_tag_sent =
-                    ((tag_sent_l1 << l1_cache_mask.index_mask_bit_length) | index_sent_l1);
+                    block_address_of(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, tag_sent_l1, index_sent_l1);
 
-                    search_in_vcache(victim_cache, &victim_cache_writable_index,
-                     &block_counter, &tag_found_in_vc, victim_cache_tag_sent);
+                    search_in_vcache(&hierarchy->victim_cache, &block_counter, &tag_found_in_vc,
+                     victim_cache_tag_sent);
 
                     if (tag_found_in_vc) {
-                        printf("Hv**\n");
+                        print_marker(hierarchy, "Hv**\n");
                      /** The tag is found in the victim cache. We should search for the LRU in the l1 cache  and replace it.
                          The l1 LRU is already known. */
                         // Updating stats
                         p_stats->victim_hits += 1;
                         // Setting the lru for l1
-                        set_Least_Recently_used_index(&l1_cache, index_sent_l1, &l1_LRU_block_index);
+                        set_Least_Recently_used_index(&hierarchy->l1_cache, index_sent_l1, &l1_LRU_block_index);
 
                         // Test if the LRU has the dirty bit set.
-                        if (l1_cache.cache_lines[index_sent_l1].blocks[l1_LRU_block_index].dirty_bit == 0){
+                        if (cache_block(&hierarchy->l1_cache, index_sent_l1, l1_LRU_block_index)->dirty_bit == 0){
                             // If there is no dirty bits set, then we should directly
                             // exchange data between the l1_cache and the victim cache
-                            exchange_vc_and_l1c_els(type, &victim_cache, block_counter,
-                            &l1_cache, index_sent_l1, l1_LRU_block_index, l1_cache_mask, tag_sent_l1);
+                            exchange_vc_and_l1c_els(type, &hierarchy->victim_cache, block_counter,
+                            &hierarchy->l1_cache, index_sent_l1, l1_LRU_block_index, &hierarchy->l1_cache_mask, tag_sent_l1);
                         }else{
                             // The LRU has the diry bit set.l1 write back in l2
-                            write_back_level_1_cache(p_stats, &l1_cache, &l2_cache,
-                            l1_cache_mask, l2_cache_mask, l1_LRU_block_index, index_sent_l1);
+                            write_back_level_1_cache(hierarchy, p_stats, &hierarchy->l1_cache, &hierarchy->l2_cache,
+                            &hierarchy->l1_cache_mask, &hierarchy->l2_cache_mask, l1_LRU_block_index, index_sent_l1);
                             // Exchanging data between the l1 and victim cache
-                            exchange_vc_and_l1c_els(type, &victim_cache, block_counter,
-                            &l1_cache, index_sent_l1, l1_LRU_block_index, l1_cache_mask, tag_sent_l1);
+                            exchange_vc_and_l1c_els(type, &hierarchy->victim_cache, block_counter,
+                            &hierarchy->l1_cache, index_sent_l1, l1_LRU_block_index, &hierarchy->l1_cache_mask, tag_sent_l1);
+                        }
+                        // The block may not hold the sector accessed (sectored caches)
+                        struct block_struct *l1_block = cache_block(&hierarchy->l1_cache, index_sent_l1, l1_LRU_block_index);
+                        if ((block_sector_valid(&hierarchy->l1_cache, l1_block) & sector_l1) == 0){
+                            fetch_l1_sector_from_l2(hierarchy, type, arg, p_stats, index_sent_l1, l1_LRU_block_index);
+                            set_block_sector_valid(&hierarchy->l1_cache, l1_block, block_sector_valid(&hierarchy->l1_cache, l1_block) | sector_l1);
                         }
                         // Set dirty in l1 lru if write
                         if (type == WRITE){
                             // If write, only set dirty bit in l1, since data will be write back from l1 to l2 if it is not used.
-                            l1_cache.cache_lines[index_sent_l1].blocks[l1_LRU_block_index].dirty_bit = 1;
+                            set_block_dirty(&hierarchy->l1_cache, cache_block(&hierarchy->l1_cache, index_sent_l1, l1_LRU_block_index), sector_l1);
                             /** If the teacher tell us to set the dirty bit in both, then uncomment the following line */
-                            // l2_cache.cache_lines[index_sent_l2].blocks[invalid_l2_block].dirty_bit = 1;
+                            // cache_block(&l2_cache, index_sent_l2, invalid_l2_block)->dirty_bit = 1;
                         }
                     }
                 }
@@ -728,10 +2310,10 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
                 if (not tag_found_in_vc){
                     // Updating Stats
                     p_stats->accesses_l2 += 1;
-                    if (victim_cache.nb_victim_cache_lines > 0){
-                        printf("Mv");
+                    if (hierarchy->victim_cache.nb_victim_cache_lines > 0){
+                        print_marker(hierarchy, "Mv");
                     } else {
-                        printf("**");
+                        print_marker(hierarchy, "**");
                     }
 
                     /** Searching in L2 cache */
@@ -742,80 +2324,86 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
                     /** Searching in L2. */
                     unsigned long int l2_LRU_block_index = 0;
                     // First step, get the index.
-                    unsigned long int index_sent_l2 = (arg & l2_cache_mask.index_mask) >> l2_cache_mask.offset_mask_bit_length;
+                    unsigned long int index_sent_l2 = (decoded != NULL) ? decoded->index_l2 : cache_index(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
                     // Second step, get the tag.
-                    unsigned long int tag_sent_l2 = (arg & l2_cache_mask.tag_mask) >> (l2_cache_mask.offset_mask_bit_length + l2_cache_mask.index_mask_bit_length);
+                    unsigned long int tag_sent_l2 = (decoded != NULL) ? decoded->tag_l2 : cache_tag(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
                     // Searching
-                    search_in_cache(&l2_cache, &valid_l2_cache, &invalid_l2_block,
+                    search_in_cache(&hierarchy->l2_cache, &valid_l2_cache, &invalid_l2_block,
                     &l2_LRU_block_index, &tag_found_in_l2, &block_counter, index_sent_l2,
                     tag_sent_l2);
+                    observe_l2_access(hierarchy, p_stats, (type == WRITE) ? MISS_TRACE_WRITE : MISS_TRACE_READ, arg, tag_found_in_l2);
 
                     if (tag_found_in_l2){
-                        printf("H2\n");
-                        write_back_l1_move_to_vc_copy_tag_found_in_l2(&l1_cache, &l2_cache, &victim_cache,
-                        l1_cache_mask, l2_cache_mask, &l1_LRU_block_index, index_sent_l1, index_sent_l2,
+                        print_marker(hierarchy, "H2\n");
+                        write_back_l1_move_to_vc_copy_tag_found_in_l2(hierarchy, &hierarchy->l1_cache, &hierarchy->l2_cache, &hierarchy->victim_cache,
+                        &hierarchy->l1_cache_mask, &hierarchy->l2_cache_mask, &l1_LRU_block_index, index_sent_l1, index_sent_l2,
                         tag_found_in_l2, &l2_LRU_block_index, p_stats, block_counter,
-                        &victim_cache_writable_index, tag_sent_l1);
+                        tag_sent_l1, sector_l1, sector_l2);
                         // set dirty bit in l1
                         if (type == WRITE){
                             // If write, only set dirty bit in l1, since data will be write back from l1 to l2 if it is not used.
-                            l1_cache.cache_lines[index_sent_l1].blocks[l1_LRU_block_index].dirty_bit = 1;
+                            set_block_dirty(&hierarchy->l1_cache, cache_block(&hierarchy->l1_cache, index_sent_l1, l1_LRU_block_index), sector_l1);
                             /** If the teacher tell us to set the dirty bit in both, then uncomment the following line */
-                            // l2_cache.cache_lines[index_sent_l2].blocks[invalid_l2_block].dirty_bit = 1;
+                            // cache_block(&l2_cache, index_sent_l2, invalid_l2_block)->dirty_bit = 1;
                         }
                     }
 
                     // 2- The tag is not found, and the l2 cache is not full.
                     if (not tag_found_in_l2){
-                        printf("M2\n");
+                        print_marker(hierarchy, "M2\n");
                         // if the l2 cache is not valid (valid_l2_cache = False), we will be looking for an empty space in l2 to create data.
                         // If there is no empty space left (last empty space used by the write back),
                         // we will be using the LRU
                         // In case the l2 cache is valid (full), we will be directly using the second lru.
-                        write_back_l1_move_to_vc_copy_tag_found_in_l2(&l1_cache, &l2_cache, &victim_cache,
-                        l1_cache_mask, l2_cache_mask, &l1_LRU_block_index, index_sent_l1, index_sent_l2,
+                        write_back_l1_move_to_vc_copy_tag_found_in_l2(hierarchy, &hierarchy->l1_cache, &hierarchy->l2_cache, &hierarchy->victim_cache,
+                        &hierarchy->l1_cache_mask, &hierarchy->l2_cache_mask, &l1_LRU_block_index, index_sent_l1, index_sent_l2,
                         tag_found_in_l2, &l2_LRU_block_index, p_stats, block_counter,
-                        &victim_cache_writable_index, tag_sent_l1);
+                        tag_sent_l1, sector_l1, sector_l2);
 
                         // There should be and empty place in cache l2, but we have to test if the write back had not already
                         // Written data at the invalid place.
-                        if (l2_cache.cache_lines[index_sent_l2].blocks[invalid_l2_block].valid_bit != 0){
+                        if (cache_block(&hierarchy->l2_cache, index_sent_l2, invalid_l2_block)->valid_bit != 0){
                             // The write back has already take this place (invalid_l2_block)
                             // Then, we should search for the LRU in l2 or for another invalid_place.
                             block_counter = 0;
                             invalid_l2_block = 0;
                             l2_LRU_block_index = 0;
                             bool stop_loop = false;
-                            // Finding a new invalid place, or the new LRU that will be replaced.
+                            // Finding a new invalid place, or the new LRU that will be replaced. The search stops after
+                            // the first block of the set, whatever the associativity
                             while(not stop_loop){
-                                if (l2_cache.cache_lines[index_sent_l2].blocks[block_counter].valid_bit == 0){
+                                if (cache_block(&hierarchy->l2_cache, index_sent_l2, block_counter)->valid_bit == 0){
                                     stop_loop = true;
                                     invalid_l2_block = block_counter;
                                 }
-                                if (l2_cache.cache_lines[index_sent_l2].blocks[block_counter].LRU <
-                                l2_cache.cache_lines[index_sent_l2].blocks[l2_LRU_block_index].LRU){
+                                if (cache_block(&hierarchy->l2_cache, index_sent_l2, block_counter)->LRU <
+                                cache_block(&hierarchy->l2_cache, index_sent_l2, l2_LRU_block_index)->LRU){
                                     // Make sure that the LRU is not the last value accessed.
-                                    if (block_counter != l2_cache.cache_lines[index_sent_l2].last_accessed_block){
+                                    if (block_counter != cache_line(&hierarchy->l2_cache, index_sent_l2)->last_accessed_block){
                                         l2_LRU_block_index = block_counter;
                                     }
                                 }
                                 block_counter += 1;
-                                if (block_counter < l2_cache.nb_cache_blocks_per_line){
-                                    stop_loop = true;
-                                }
+                                stop_loop = true;
                             }
                             // If the invalid block we found has the valid bit set, this means there are no empty place in
                             // The l2 cache, we should use the LRU instead.
-                            if (l2_cache.cache_lines[index_sent_l2].blocks[invalid_l2_block].valid_bit == 1){
+                            if (cache_block(&hierarchy->l2_cache, index_sent_l2, invalid_l2_block)->valid_bit == 1){
                                 invalid_l2_block = l2_LRU_block_index;
                             }
                         }
                         // Read data from ram and place it in l2 cache
-                        read_ram_set_elements_in_cache(&l2_cache, index_sent_l2,
-                         invalid_l2_block, tag_sent_l2);
+                        replace_l2_block_data(&hierarchy->memory, &hierarchy->l2_cache, &hierarchy->l2_cache_mask, index_sent_l2, invalid_l2_block, arg);
+                        read_ram_set_elements_in_cache(&hierarchy->l2_cache, index_sent_l2,
+                         invalid_l2_block, tag_sent_l2, sector_l2);
+                        compress_l2_block(hierarchy, p_stats, &hierarchy->l2_cache, &hierarchy->l2_cache_mask, index_sent_l2, invalid_l2_block);
                         // Also set data in l1 cache. The l1 block is full, and the LRU has already be written in the VC.
-                        read_ram_set_elements_in_cache(&l1_cache, index_sent_l1,
-                        l1_LRU_block_index, tag_sent_l1);
+                        read_ram_set_elements_in_cache(&hierarchy->l1_cache, index_sent_l1,
+                        l1_LRU_block_index, tag_sent_l1, sector_l1);
+                        copy_block_data_l1_l2(&hierarchy->l1_cache, &hierarchy->l2_cache, &hierarchy->l1_cache_mask, &hierarchy->l2_cache_mask, index_sent_l1, l1_LRU_block_index,
+                                              index_sent_l2, invalid_l2_block, arg, sector_l1, true);
+                        p_stats->bytes_filled_l2 += sector_bytes(&hierarchy->l2_cache, sector_l2);
+                        p_stats->bytes_filled_l1 += sector_bytes(&hierarchy->l1_cache, sector_l1);
                         // stats
                         if (type == READ){
                             p_stats->read_misses_l2 += 1;
@@ -823,9 +2411,9 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
                             if (type == WRITE){
                                 p_stats->write_misses_l2 += 1;
                                 // If write, only set dirty bit in l1, since data will be write back from l1 to l2 if it is not used.
-                                l1_cache.cache_lines[index_sent_l1].blocks[l1_LRU_block_index].dirty_bit = 1;
+                                set_block_dirty(&hierarchy->l1_cache, cache_block(&hierarchy->l1_cache, index_sent_l1, l1_LRU_block_index), sector_l1);
                                 /** If the teacher tell us to set the dirty bit in both, then uncomment the following line */
-                                // l2_cache.cache_lines[index_sent_l2].blocks[invalid_l2_block].dirty_bit = 1;
+                                // cache_block(&l2_cache, index_sent_l2, invalid_l2_block)->dirty_bit = 1;
                             }
                         }
                     }
@@ -835,12 +2423,742 @@ void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
     }
 }
 
+/**
+ * Subroutine that simulates an instruction fetch in the instruction cache, then in l2 on a miss. Fetches only read,
+ * so the instruction cache has no victim cache and no write back. A fetch in the block of the previous fetch only
+ * updates the LRU of the block, like a hit found by the search would.
+ *
+ * @hierarchy Address of the cache hierarchy
+ * @arg  The fetched memory address (physical)
+ * @p_stats Pointer to the statistics structure
+ */
+static void simulate_fetch(CacheHierarchy *hierarchy, uint64_t arg, cache_stats_t* p_stats){
+    struct cache_struct *l1i_cache = &hierarchy->l1i_cache;
+    uint64_t block_address = arg >> hierarchy->l1i_cache_mask.offset_mask_bit_length;
+    p_stats->fetches += 1;
+
+    // Sequential fetches: same block as the previous fetch, which is still the last accessed block of its set
+    struct block_struct *block = hierarchy->l1i_last_block;
+    if ((block != NULL) and (block_address == hierarchy->l1i_last_block_address)){
+        block->LRU = (block->LRU == LRU_MAX_VALUE) ? LRU_MAX_VALUE : block->LRU + 1;
+        print_marker(hierarchy, "HI****\n");
+        return;
+    }
+
+    bool valid_l1i_cache = true;
+    bool tag_found_in_l1i = false;
+    unsigned long int invalid_l1i_block = 0;
+    unsigned long int l1i_LRU_block_index = 0;
+    unsigned long int way = 0;
+    unsigned long int index_sent_l1i = cache_index(l1i_cache, &hierarchy->l1i_cache_mask, arg);
+    unsigned long int tag_sent_l1i = cache_tag(l1i_cache, &hierarchy->l1i_cache_mask, arg);
+    search_in_cache(l1i_cache, &valid_l1i_cache, &invalid_l1i_block, &l1i_LRU_block_index, &tag_found_in_l1i, &way,
+                    index_sent_l1i, tag_sent_l1i);
+    if (tag_found_in_l1i){
+        block = cache_block(l1i_cache, index_sent_l1i, way);
+        block->LRU = (block->LRU == LRU_MAX_VALUE) ? LRU_MAX_VALUE : block->LRU + 1;
+        cache_line(l1i_cache, index_sent_l1i)->last_accessed_block = way;
+        hierarchy->l1i_last_block = block;
+        hierarchy->l1i_last_block_address = block_address;
+        print_marker(hierarchy, "HI****\n");
+        return;
+    }
+    p_stats->fetch_misses_l1i += 1;
+    if (valid_l1i_cache){
+        set_Least_Recently_used_index(l1i_cache, index_sent_l1i, &l1i_LRU_block_index);
+        invalid_l1i_block = l1i_LRU_block_index;
+    }
+
+    // Unified l2
+    bool valid_l2_cache = true;
+    bool tag_found_in_l2 = false;
+    unsigned long int invalid_l2_block = 0;
+    unsigned long int l2_LRU_block_index = 0;
+    unsigned long int block_counter = 0;
+    unsigned long int index_sent_l2 = cache_index(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
+    unsigned long int tag_sent_l2 = cache_tag(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
+    unsigned int sector_l2 = sector_mask_of(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
+    search_in_cache(&hierarchy->l2_cache, &valid_l2_cache, &invalid_l2_block,
+    &l2_LRU_block_index, &tag_found_in_l2, &block_counter, index_sent_l2,
+    tag_sent_l2);
+    observe_l2_access(hierarchy, p_stats, MISS_TRACE_READ, arg, tag_found_in_l2);
+
+    if (tag_found_in_l2){
+        print_marker(hierarchy, "MI**H2\n");
+        struct block_struct *l2_block = cache_block(&hierarchy->l2_cache, index_sent_l2, block_counter);
+        l2_block->LRU = (l2_block->LRU == LRU_MAX_VALUE) ? LRU_MAX_VALUE : l2_block->LRU + 1;
+        cache_line(&hierarchy->l2_cache, index_sent_l2)->last_accessed_block = block_counter;
+        if ((block_sector_valid(&hierarchy->l2_cache, l2_block) & sector_l2) == 0){
+            p_stats->sector_misses_l2 += 1;
+            p_stats->bytes_filled_l2 += sector_bytes(&hierarchy->l2_cache, sector_l2);
+            set_block_sector_valid(&hierarchy->l2_cache, l2_block, block_sector_valid(&hierarchy->l2_cache, l2_block) | sector_l2);
+        }
+    } else {
+        print_marker(hierarchy, "MI**M2\n");
+        p_stats->fetch_misses_l2 += 1;
+        if (valid_l2_cache){
+            set_Least_Recently_used_index(&hierarchy->l2_cache, index_sent_l2, &l2_LRU_block_index);
+            if (cache_block(&hierarchy->l2_cache, index_sent_l2, l2_LRU_block_index)->dirty_bit == 1){
+                p_stats->write_back_l2 += 1;
+                p_stats->bytes_written_back_l2 += sector_bytes(&hierarchy->l2_cache,
+                    block_sector_dirty(&hierarchy->l2_cache, cache_block(&hierarchy->l2_cache, index_sent_l2, l2_LRU_block_index)));
+            }
+            invalid_l2_block = l2_LRU_block_index;
+        }
+        replace_l2_block_data(&hierarchy->memory, &hierarchy->l2_cache, &hierarchy->l2_cache_mask, index_sent_l2, invalid_l2_block, arg);
+        read_ram_set_elements_in_cache(&hierarchy->l2_cache, index_sent_l2, invalid_l2_block, tag_sent_l2, sector_l2);
+        compress_l2_block(hierarchy, p_stats, &hierarchy->l2_cache, &hierarchy->l2_cache_mask, index_sent_l2, invalid_l2_block);
+        cache_block(&hierarchy->l2_cache, index_sent_l2, invalid_l2_block)->dirty_bit = 0;
+        set_block_sector_dirty(&hierarchy->l2_cache, cache_block(&hierarchy->l2_cache, index_sent_l2, invalid_l2_block), 0);
+        p_stats->bytes_filled_l2 += sector_bytes(&hierarchy->l2_cache, sector_l2);
+    }
+
+    // The whole block goes in the instruction cache
+    read_ram_set_elements_in_cache(l1i_cache, index_sent_l1i, invalid_l1i_block, tag_sent_l1i, 1);
+    hierarchy->l1i_last_block = cache_block(l1i_cache, index_sent_l1i, invalid_l1i_block);
+    hierarchy->l1i_last_block_address = block_address;
+}
+
+/**
+ * Subroutine that simulates the cache one trace event at a time.
+ * The address is translated first, and the l1 access runs in the l1 shadow when the misses are classified.
+ *
+ * @hierarchy Address of the cache hierarchy
+ * @type The type of event, can be READ, WRITE or FETCH.
+ * @arg  The target memory address
+ * @decoded Set indexes and tags of arg, NULL to compute them. Ignored for virtual addresses
+ * @p_stats Pointer to the statistics structure
+ */
+static void simulate_access(CacheHierarchy *hierarchy, char type, uint64_t arg,
+                            const struct decoded_address_struct *decoded, cache_stats_t* p_stats) {
+
+    // Virtual addresses are translated first (the caches are physically indexed and tagged)
+    if (hierarchy->page_bits != 0){
+        arg = translate_address(hierarchy, arg, p_stats);
+        decoded = NULL;
+    }
+    if ((hierarchy->tag_address_bits < 64) and ((arg >> hierarchy->tag_address_bits) != 0))
+        p_stats->truncated_tag_accesses += 1;
+    if (type == FETCH){
+        if (hierarchy->instruction_cache){
+            simulate_fetch(hierarchy, arg, p_stats);
+            return;
+        }
+        // Without instruction cache, the fetches are reads of l1
+        p_stats->fetches += 1;
+        type = READ;
+    }
+    if (not hierarchy->miss_classification){
+        simulate_physical_access(hierarchy, type, arg, decoded, p_stats);
+        return;
+    }
+    uint64_t l1_misses = p_stats->read_misses_l1 + p_stats->write_misses_l1;
+    simulate_physical_access(hierarchy, type, arg, decoded, p_stats);
+    unsigned int miss_class = shadow_cache_access(&hierarchy->l1_shadow, arg >> hierarchy->l1_cache_mask.offset_mask_bit_length);
+    if (p_stats->read_misses_l1 + p_stats->write_misses_l1 != l1_misses)
+        count_miss_class(miss_class, &p_stats->compulsory_misses_l1, &p_stats->capacity_misses_l1, &p_stats->conflict_misses_l1);
+}
+
+/**
+ * Subroutine that simulates one trace event, then attributes its misses and write backs to the region of its
+ * address and to its PC, when the attribution is enabled.
+ * @hierarchy Address of the cache hierarchy
+ * @type The type of event, can be READ or WRITE.
+ * @arg  The target memory address
+ * @pc The address of the instruction (only used by the attribution to PCs)
+ * @decoded Set indexes and tags of arg, NULL to compute them
+ * @p_stats Pointer to the statistics structure
+ */
+static void attributed_access(CacheHierarchy *hierarchy, char type, uint64_t arg, uint64_t pc,
+                              const struct decoded_address_struct *decoded, cache_stats_t* p_stats){
+    if ((hierarchy->attribution_region_bits == 0) and (not hierarchy->attribution_pc)){
+        simulate_access(hierarchy, type, arg, decoded, p_stats);
+        return;
+    }
+    uint64_t l1_misses = p_stats->read_misses_l1 + p_stats->write_misses_l1 + p_stats->fetch_misses_l1i;
+    uint64_t victim_hits = p_stats->victim_hits;
+    uint64_t l2_misses = p_stats->read_misses_l2 + p_stats->write_misses_l2 + p_stats->fetch_misses_l2;
+    uint64_t write_backs = p_stats->write_back_l1 + p_stats->write_back_l2;
+    simulate_access(hierarchy, type, arg, decoded, p_stats);
+
+    struct attribution_entry_t events;
+    events.key = 0;
+    events.l1_misses = p_stats->read_misses_l1 + p_stats->write_misses_l1 + p_stats->fetch_misses_l1i - l1_misses;
+    events.vc_misses = events.l1_misses - (p_stats->victim_hits - victim_hits);
+    events.l2_misses = p_stats->read_misses_l2 + p_stats->write_misses_l2 + p_stats->fetch_misses_l2 - l2_misses;
+    events.write_backs = p_stats->write_back_l1 + p_stats->write_back_l2 - write_backs;
+    // Hits are not recorded, so that the tables only hold the regions and PCs that miss
+    if ((events.l1_misses == 0) and (events.l2_misses == 0) and (events.write_backs == 0))
+        return;
+    if (hierarchy->attribution_region_bits != 0)
+        attribution_count(&hierarchy->region_attribution, arg >> hierarchy->attribution_region_bits, &events);
+    if (hierarchy->attribution_pc)
+        attribution_count(&hierarchy->pc_attribution, pc, &events);
+}
+
+/**
+ * Subroutine computing the set indexes and tags of an address in l1 and l2, so that they can be computed once for
+ * every simulation of a trace (pre-decoded traces).
+ * @hierarchy Address of the cache hierarchy
+ * @arg The memory address (physical)
+ * @decoded Set to the indexes and tags
+ */
+static void decode_address(const CacheHierarchy *hierarchy, uint64_t arg, struct decoded_address_struct *decoded){
+    decoded->index_l1 = cache_index(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg);
+    decoded->tag_l1 = cache_tag(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg);
+    decoded->index_l2 = cache_index(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
+    decoded->tag_l2 = cache_tag(&hierarchy->l2_cache, &hierarchy->l2_cache_mask, arg);
+}
+
+/**
+ * Subroutine giving what the indexes and tags of decode_address() depend on.
+ * @hierarchy Address of the cache hierarchy
+ * @geometry Set to the geometry of l1 and l2
+ */
+static void decode_geometry(const CacheHierarchy *hierarchy, struct decode_geometry_struct *geometry){
+    geometry->block_bits_l1 = hierarchy->l1_cache_mask.offset_mask_bit_length;
+    geometry->sets_l1 = hierarchy->l1_cache.nb_cache_lines;
+    geometry->index_function_l1 = hierarchy->l1_cache.index_function;
+    geometry->block_bits_l2 = hierarchy->l2_cache_mask.offset_mask_bit_length;
+    geometry->sets_l2 = hierarchy->l2_cache.nb_cache_lines;
+    geometry->index_function_l2 = hierarchy->l2_cache.index_function;
+}
+
+/**
+ * Subroutine that simulates an l1 hit on a sector whose set index and tag are known (units of a sized access).
+ * Same as the hit branch of simulate_physical_access(): anything but a hit on a valid sector returns false before
+ * changing anything, and the full path takes over.
+ * @hierarchy Address of the cache hierarchy
+ * @type The type of event, can be READ or WRITE.
+ * @arg  The target memory address (physical)
+ * @index_ The index of arg in l1
+ * @tag The tag of arg in l1
+ * @p_stats Pointer to the statistics structure
+ */
+static bool l1_unit_hit(CacheHierarchy *hierarchy, char type, uint64_t arg, unsigned long int index_,
+                        unsigned long int tag, cache_stats_t *p_stats){
+    struct cache_struct *cache = &hierarchy->l1_cache;
+    uint64_t block_address = arg >> hierarchy->l1_cache_mask.offset_mask_bit_length;
+    unsigned int sector = sector_mask_of(cache, &hierarchy->l1_cache_mask, arg);
+    // Next sector of the block of the previous unit: no search
+    struct block_struct *block = hierarchy->l1_last_block;
+    if ((block == NULL) or (hierarchy->l1_last_block_address != block_address)){
+        unsigned long int way = 0;
+        for (way = 0; way < cache->nb_cache_blocks_per_line; way++){
+            block = cache_block(cache, index_, way);
+            if ((block->valid_bit == 1) and (block->tag == tag))
+                break;
+        }
+        if (way == cache->nb_cache_blocks_per_line)
+            return false;
+        if ((block_sector_valid(cache, block) & sector) == 0)
+            return false;
+        cache_line(cache, index_)->last_accessed_block = way;
+    } else if ((block_sector_valid(cache, block) & sector) == 0){
+        return false;
+    }
+    p_stats->accesses += 1;
+    if (type == READ){
+        p_stats->reads += 1;
+    } else {
+        if (type == WRITE){
+            p_stats->writes += 1;
+        }
+    }
+    block->LRU = (block->LRU == LRU_MAX_VALUE) ? LRU_MAX_VALUE : block->LRU + 1;
+    if (type == WRITE){
+        set_block_dirty(cache, block, sector);
+    }
+    hierarchy->l1_last_block = block;
+    hierarchy->l1_last_block_address = block_address;
+    print_marker(hierarchy, "H1****\n");
+    return true;
+}
+
+/**
+ * Subroutine that simulates a trace event of size bytes. An access crossing l1 sector or block boundaries is
+ * split into one access per l1 sector it touches (one per block for unsectored caches, and for the instruction
+ * cache), in address order: the first one at arg, the next ones at the start of their sector.
+ * The units after the first are walked in one pass: the address is translated once per page, the l1 index and tag
+ * are stepped from block to block, and only the units that do not hit in l1 take the full path of
+ * attributed_access(). Fetches in the instruction cache take the full path for every block.
+ * @hierarchy Address of the cache hierarchy
+ * @type The type of event, can be READ, WRITE or FETCH.
+ * @arg  The target memory address (first byte)
+ * @size Number of bytes accessed. 0 or 1 is a single access
+ * @pc The address of the instruction (only used by the attribution to PCs)
+ * @p_stats Pointer to the statistics structure
+ */
+static void sized_access(CacheHierarchy *hierarchy, char type, uint64_t arg, unsigned int size, uint64_t pc,
+                         cache_stats_t* p_stats){
+    bool instruction_fetch = (type == FETCH) and hierarchy->instruction_cache;
+    unsigned int unit_bits = instruction_fetch ? hierarchy->l1i_cache.sector_bits : hierarchy->l1_cache.sector_bits;
+    uint64_t first_unit = arg >> unit_bits;
+    uint64_t last_unit = (size > 1) ? (arg + size - 1) >> unit_bits : first_unit;
+    attributed_access(hierarchy, type, arg, pc, NULL, p_stats);
+    if (last_unit == first_unit)
+        return;
+    // The span is walked by units: no lookup for the bytes in between
+    p_stats->split_accesses += last_unit - first_unit;
+    uint64_t unit = 0;
+    if (instruction_fetch){
+        for (unit = first_unit + 1; unit <= last_unit; unit++){
+            attributed_access(hierarchy, type, unit << unit_bits, pc, NULL, p_stats);
+        }
+        return;
+    }
+
+    struct cache_struct *l1_cache = &hierarchy->l1_cache;
+    unsigned int block_bits = hierarchy->l1_cache_mask.offset_mask_bit_length;
+    // Fetches without instruction cache are reads of l1
+    char access_type = (type == FETCH) ? READ : type;
+    // The page of arg was mapped by its access
+    uint64_t page_mask = (hierarchy->page_bits != 0) ? (1UL << hierarchy->page_bits) - 1 : ~(uint64_t) 0;
+    uint64_t page_base = (hierarchy->page_bits != 0) ?
+                         page_table_walk(&hierarchy->page_table, arg >> hierarchy->page_bits, NULL) << hierarchy->page_bits : 0;
+    uint64_t physical_address = page_base | (arg & page_mask);
+    uint64_t block_address = physical_address >> block_bits;
+    unsigned long int index_ = cache_index(l1_cache, &hierarchy->l1_cache_mask, physical_address);
+    unsigned long int tag = cache_tag(l1_cache, &hierarchy->l1_cache_mask, physical_address);
+    for (unit = first_unit + 1; unit <= last_unit; unit++){
+        uint64_t virtual_address = unit << unit_bits;
+        if ((hierarchy->page_bits != 0) and ((virtual_address & page_mask) == 0)){
+            // First unit of a page: the full path translates it, the next units of the page use the mapping
+            attributed_access(hierarchy, type, virtual_address, pc, NULL, p_stats);
+            page_base = page_table_walk(&hierarchy->page_table, virtual_address >> hierarchy->page_bits, NULL) << hierarchy->page_bits;
+            physical_address = page_base;
+            block_address = physical_address >> block_bits;
+            index_ = cache_index(l1_cache, &hierarchy->l1_cache_mask, physical_address);
+            tag = cache_tag(l1_cache, &hierarchy->l1_cache_mask, physical_address);
+            continue;
+        }
+        physical_address = page_base | (virtual_address & page_mask);
+        if ((physical_address >> block_bits) != block_address){
+            // Next block (the units are consecutive in the page)
+            block_address += 1;
+            if (l1_cache->hashed_index){
+                index_ = cache_index(l1_cache, &hierarchy->l1_cache_mask, physical_address);
+                tag = cache_tag(l1_cache, &hierarchy->l1_cache_mask, physical_address);
+            } else {
+                index_ += 1;
+                if (index_ == l1_cache->nb_cache_lines){
+                    index_ = 0;
+                    tag = (tag + 1) & ((1UL << BLOCK_TAG_BITS) - 1);
+                }
+            }
+        }
+        if (not l1_unit_hit(hierarchy, access_type, physical_address, index_, tag, p_stats)){
+            attributed_access(hierarchy, type, virtual_address, pc, NULL, p_stats);
+            continue;
+        }
+        // What the full path does besides the hit: the translation (the page is the most recently used entry of the
+        // data TLB, which a lookup leaves as it is) and the l1 shadow. Hits are not attributed
+        if ((hierarchy->page_bits != 0) and (cache_index(l1_cache, &hierarchy->l1_cache_mask, virtual_address) != index_)){
+            p_stats->vipt_index_mismatches += 1;
+        }
+        if (type == FETCH){
+            p_stats->fetches += 1;
+        }
+        if (hierarchy->miss_classification){
+            shadow_cache_access(&hierarchy->l1_shadow, block_address);
+        }
+    }
+}
+
+/**
+ * Subroutine that simulates more reads and writes to the l1 sector of the previous access (run length collapsed
+ * traces). The previous access left its block in l1 with the sector valid, so they are all l1 hits: only the
+ * counters, the LRU and the dirty bits change, and the address is translated and searched once for all of them.
+ * The l1 shadow and the TLBs are left as they are, since the same block and page were just accessed. If the block
+ * is not in l1 after all, the events are simulated one by one (reads first, without PC) so that none is lost.
+ * @hierarchy Address of the cache hierarchy
+ * @arg The target memory address of the previous access
+ * @reads Number of reads
+ * @writes Number of writes
+ * @p_stats Pointer to the statistics structure
+ */
+static void repeat_access(CacheHierarchy *hierarchy, uint64_t arg, unsigned int reads, unsigned int writes,
+                          cache_stats_t* p_stats){
+    unsigned int count = reads + writes;
+    if (count == 0)
+        return;
+    uint64_t virtual_address = arg;
+    if (hierarchy->page_bits != 0){
+        // The page was mapped by the previous access
+        arg = (page_table_walk(&hierarchy->page_table, arg >> hierarchy->page_bits, NULL) << hierarchy->page_bits) |
+              (arg & ((1UL << hierarchy->page_bits) - 1));
+    }
+    uint64_t block_address = arg >> hierarchy->l1_cache_mask.offset_mask_bit_length;
+    struct block_struct *block = hierarchy->l1_last_block;
+    if ((block == NULL) or (hierarchy->l1_last_block_address != block_address)){
+        // The previous access missed
+        bool valid_cache = true;
+        bool tag_found = false;
+        unsigned long int invalid_block = 0;
+        unsigned long int lru_block = 0;
+        unsigned long int way = 0;
+        unsigned long int index_ = cache_index(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg);
+        search_in_cache(&hierarchy->l1_cache, &valid_cache, &invalid_block, &lru_block, &tag_found, &way,
+                        index_, cache_tag(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg));
+        if (not tag_found){
+            // The run does not stay in the block of its first event: every event goes through the whole hierarchy
+            unsigned int i = 0;
+            for (i = 0; i < reads; i++)
+                attributed_access(hierarchy, READ, virtual_address, 0, NULL, p_stats);
+            for (i = 0; i < writes; i++)
+                attributed_access(hierarchy, WRITE, virtual_address, 0, NULL, p_stats);
+            return;
+        }
+        block = cache_block(&hierarchy->l1_cache, index_, way);
+        cache_line(&hierarchy->l1_cache, index_)->last_accessed_block = way;
+        hierarchy->l1_last_block = block;
+        hierarchy->l1_last_block_address = block_address;
+    }
+    if ((hierarchy->tag_address_bits < 64) and ((arg >> hierarchy->tag_address_bits) != 0))
+        p_stats->truncated_tag_accesses += count;
+    if ((hierarchy->page_bits != 0) and
+        (cache_index(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, virtual_address) !=
+         cache_index(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg))){
+        p_stats->vipt_index_mismatches += count;
+    }
+    p_stats->accesses += count;
+    p_stats->reads += reads;
+    p_stats->writes += writes;
+    block->LRU = (block->LRU + count >= LRU_MAX_VALUE) ? LRU_MAX_VALUE : block->LRU + count;
+    if (writes != 0){
+        set_block_dirty(&hierarchy->l1_cache, block, sector_mask_of(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg));
+    }
+    unsigned int i = 0;
+    for (i = 0; i < count; i++){
+        print_marker(hierarchy, "H1****\n");
+    }
+}
+
+/**
+ * Subroutine to find the l1 block holding an address (data mode). The block is always present
+ * right after cache_access() on that address.
+ * @hierarchy Address of the cache hierarchy
+ * @arg The memory address
+ * Returns the content of the byte at arg in l1, or NULL if the block is not present.
+ */
+static char *l1_byte_data(CacheHierarchy *hierarchy, uint64_t arg){
+    if (hierarchy->l1_cache.data_arena == NULL)
+        return NULL;
+    bool valid_cache = true;
+    bool tag_found = false;
+    unsigned long int invalid_block = 0;
+    unsigned long int lru_block = 0;
+    unsigned long int way = 0;
+    unsigned long int index_ = cache_index(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg);
+    search_in_cache(&hierarchy->l1_cache, &valid_cache, &invalid_block, &lru_block, &tag_found, &way,
+                    index_, cache_tag(&hierarchy->l1_cache, &hierarchy->l1_cache_mask, arg));
+    if (not tag_found)
+        return NULL;
+    return block_data(&hierarchy->l1_cache, index_, way) + (arg & hierarchy->l1_cache_mask.offset_mask);
+}
+
+/**
+ * Subroutine to write the value of a store in the l1 block (data mode). Call it right after the cache_access()
+ * of the store. The value is stored little endian and cut at the end of the block.
+ * @hierarchy Address of the cache hierarchy
+ * @arg The target memory address
+ * @value The value stored
+ * @size Number of bytes stored (1 to 8)
+ * @p_stats Pointer to the statistics structure
+ */
+static void store_value(CacheHierarchy *hierarchy, uint64_t arg, uint64_t value, unsigned int size, cache_stats_t* p_stats){
+    if (hierarchy->page_bits != 0){
+        // The page was mapped by the access
+        arg = (page_table_walk(&hierarchy->page_table, arg >> hierarchy->page_bits, NULL) << hierarchy->page_bits) |
+              (arg & ((1UL << hierarchy->page_bits) - 1));
+    }
+    char *content = l1_byte_data(hierarchy, arg);
+    if (content == NULL)
+        return;
+    if (size > hierarchy->l1_cache.nb_bytes_per_data_block - (arg & hierarchy->l1_cache_mask.offset_mask))
+        size = hierarchy->l1_cache.nb_bytes_per_data_block - (arg & hierarchy->l1_cache_mask.offset_mask);
+    bool silent = true;
+    unsigned int byte = 0;
+    for (byte = 0; byte < size and byte < 8; byte++){
+        char new_byte = (char)(value >> (8 * byte));
+        silent = silent and (content[byte] == new_byte);
+        content[byte] = new_byte;
+    }
+    // Value locality: the store did not change memory
+    if (silent)
+        p_stats->silent_stores += 1;
+}
+
+/**
+ * Subroutine to read a value from the l1 block (data mode). Call it right after the cache_access() of the load.
+ * @hierarchy Address of the cache hierarchy
+ * @arg The target memory address
+ * @size Number of bytes read (1 to 8), cut at the end of the block
+ * Returns the value read (little endian), 0 if the block is not present
+ */
+static uint64_t load_value(CacheHierarchy *hierarchy, uint64_t arg, unsigned int size){
+    if (hierarchy->page_bits != 0){
+        // The page was mapped by the access
+        arg = (page_table_walk(&hierarchy->page_table, arg >> hierarchy->page_bits, NULL) << hierarchy->page_bits) |
+              (arg & ((1UL << hierarchy->page_bits) - 1));
+    }
+    char *content = l1_byte_data(hierarchy, arg);
+    if (content == NULL)
+        return 0;
+    if (size > hierarchy->l1_cache.nb_bytes_per_data_block - (arg & hierarchy->l1_cache_mask.offset_mask))
+        size = hierarchy->l1_cache.nb_bytes_per_data_block - (arg & hierarchy->l1_cache_mask.offset_mask);
+    uint64_t value = 0;
+    unsigned int byte = 0;
+    for (byte = 0; byte < size and byte < 8; byte++){
+        value |= (uint64_t)(unsigned char) content[byte] << (8 * byte);
+    }
+    return value;
+}
+
 /**
  * Subroutine for cleaning up any outstanding memory operations and calculating overall statistics
  * such as miss rate or average access time.
- * XXX: You're responsible for completing this routine
  *
+ * @hierarchy Address of the cache hierarchy
+ * @p_stats Pointer to the statistics structure
+ */
+static void complete_hierarchy(CacheHierarchy *hierarchy, cache_stats_t *p_stats) {
+    p_stats->random_seed = hierarchy->random_seed;
+    p_stats->filtered_lookups_l2 = hierarchy->l2_cache.filtered_lookups;
+    if (hierarchy->miss_trace){
+        p_stats->miss_trace_lost_records += close_miss_trace(&hierarchy->miss_trace_writer);
+        hierarchy->miss_trace = false;
+    }
+    if (hierarchy->l2_cache.compression != COMPRESSION_NONE){
+        // Last effective capacity sample, and the compressed sizes of the blocks left in l2
+        hierarchy->compression_samples += 1;
+        hierarchy->compression_sampled_blocks += count_compressed_blocks(&hierarchy->l2_cache, p_stats->resident_size_histogram_l2);
+        // Ratio to the number of uncompressed blocks the l2 data array can hold
+        p_stats->effective_capacity_l2 = (double) hierarchy->compression_sampled_blocks / hierarchy->compression_samples /
+                                         (hierarchy->l2_cache.nb_cache_lines * (hierarchy->l2_cache.nb_cache_blocks_per_line / 2));
+    }
+}
+
+/**
+ * Subroutine to free one level of cache.
+ * @cache The cache to free
+ */
+static void free_cache_level(struct cache_struct *cache){
+    free_arena(cache->arena, cache->arena_size);
+    free(cache->skew_multipliers);
+}
+
+CacheHierarchy *CacheHierarchy::create(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
+                                       uint64_t c2, uint64_t b2, uint64_t s2,
+                                       const cache_options_t *p_options){
+    // Zeroed, like the globals of the driver interface used to be
+    CacheHierarchy *hierarchy = (CacheHierarchy *) calloc(1, sizeof(CacheHierarchy));
+    if (hierarchy == NULL)
+        return NULL;
+    if (not setup_hierarchy(hierarchy, c1, b1, s1, v, c2, b2, s2, p_options)){
+        destroy(hierarchy);
+        return NULL;
+    }
+    return hierarchy;
+}
+
+void CacheHierarchy::destroy(CacheHierarchy *hierarchy){
+    if (hierarchy == NULL)
+        return;
+    free_cache_level(&hierarchy->l1_cache);
+    free_cache_level(&hierarchy->l2_cache);
+    if (hierarchy->instruction_cache)
+        free_cache_level(&hierarchy->l1i_cache);
+    if (hierarchy->victim_cache.victim_cache_lines != NULL){
+        // The blocks were allocated at once, the first line points to the allocation
+        free(hierarchy->victim_cache.victim_cache_lines[0].victim_cache_block);
+        free(hierarchy->victim_cache.victim_cache_lines);
+        free(hierarchy->victim_cache.lookup_table);
+        free(hierarchy->victim_cache.data_arena);
+    }
+    free(hierarchy->memory.block_addresses);
+    free(hierarchy->memory.block_numbers);
+    free(hierarchy->memory.content_arena);
+    free(hierarchy->dtlb.vpns);
+    free(hierarchy->dtlb.pfns);
+    free(hierarchy->dtlb.last_use);
+    free(hierarchy->stlb.vpns);
+    free(hierarchy->stlb.pfns);
+    free(hierarchy->stlb.last_use);
+    free(hierarchy->page_table.vpns);
+    free(hierarchy->page_table.pfns);
+    free_attribution_table(&hierarchy->region_attribution);
+    free_attribution_table(&hierarchy->pc_attribution);
+    if (hierarchy->miss_trace)
+        close_miss_trace(&hierarchy->miss_trace_writer);
+    if (hierarchy->miss_classification){
+        free_shadow_cache(&hierarchy->l1_shadow);
+        free_shadow_cache(&hierarchy->l2_shadow);
+    }
+    free(hierarchy);
+}
+
+void CacheHierarchy::access(char type, uint64_t arg){
+    clear_markers(this);
+    attributed_access(this, type, arg, 0, NULL, &stats);
+}
+
+void CacheHierarchy::access(char type, uint64_t arg, uint64_t pc){
+    clear_markers(this);
+    attributed_access(this, type, arg, pc, NULL, &stats);
+}
+
+void CacheHierarchy::access(char type, uint64_t arg, uint64_t pc, unsigned int size){
+    clear_markers(this);
+    sized_access(this, type, arg, size, pc, &stats);
+}
+
+void CacheHierarchy::access_decoded(char type, uint64_t arg, const struct decoded_address_struct *decoded){
+    clear_markers(this);
+    attributed_access(this, type, arg, 0, decoded, &stats);
+}
+
+void CacheHierarchy::decode(uint64_t arg, struct decoded_address_struct *decoded) const{
+    decode_address(this, arg, decoded);
+}
+
+void CacheHierarchy::decode(struct decode_geometry_struct *geometry) const{
+    decode_geometry(this, geometry);
+}
+
+void CacheHierarchy::repeat_access(uint64_t arg, unsigned int reads, unsigned int writes){
+    clear_markers(this);
+    ::repeat_access(this, arg, reads, writes, &stats);
+}
+
+void CacheHierarchy::store_value(uint64_t arg, uint64_t value, unsigned int size){
+    ::store_value(this, arg, value, size, &stats);
+}
+
+uint64_t CacheHierarchy::load_value(uint64_t arg, unsigned int size){
+    return ::load_value(this, arg, size);
+}
+
+const cache_stats_t *CacheHierarchy::finish(){
+    complete_hierarchy(this, &stats);
+    return &stats;
+}
+
+unsigned int CacheHierarchy::attribution_top(unsigned int table, unsigned int k, attribution_entry_t *entries) const{
+    return ::attribution_top((table == ATTRIBUTION_PC) ? &pc_attribution : &region_attribution, k, entries);
+}
+
+/**
+ * Subroutine for initializing the cache simulated by the driver interface. A previous cache is freed.
+ * See setup_hierarchy() for the parameters.
+ * Returns false if out of memory or if the miss trace cannot be written
+ */
+bool setup_cache(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
+                 uint64_t c2, uint64_t b2, uint64_t s2,
+                 const cache_options_t *p_options) {
+    CacheHierarchy::destroy(default_hierarchy);
+    default_hierarchy = CacheHierarchy::create(c1, b1, s1, v, c2, b2, s2, p_options);
+    return default_hierarchy != NULL;
+}
+
+/**
+ * Subroutine that simulates the cache one trace event at a time (driver interface).
+ * @type The type of event, can be READ or WRITE.
+ * @arg  The target memory address
+ * @p_stats Pointer to the statistics structure
+ */
+void cache_access(char type, uint64_t arg, cache_stats_t* p_stats) {
+    attributed_access(default_hierarchy, type, arg, 0, NULL, p_stats);
+}
+
+/**
+ * Subroutine that simulates a trace event of the instruction at pc (driver interface, miss attribution to PCs).
+ * @type The type of event, can be READ or WRITE.
+ * @arg  The target memory address
+ * @pc The address of the instruction
+ * @p_stats Pointer to the statistics structure
+ */
+void cache_access_pc(char type, uint64_t arg, uint64_t pc, cache_stats_t* p_stats) {
+    attributed_access(default_hierarchy, type, arg, pc, NULL, p_stats);
+}
+
+/**
+ * Subroutine that simulates a trace event of size bytes (driver interface). See sized_access().
+ * @type The type of event, can be READ or WRITE.
+ * @arg  The target memory address (first byte)
+ * @size Number of bytes accessed
+ * @pc The address of the instruction, 0 if unknown
+ * @p_stats Pointer to the statistics structure
+ */
+void cache_access_sized(char type, uint64_t arg, unsigned int size, uint64_t pc, cache_stats_t* p_stats) {
+    sized_access(default_hierarchy, type, arg, size, pc, p_stats);
+}
+
+/**
+ * Subroutine that simulates a trace event whose set indexes and tags are already computed (driver interface).
+ * @type The type of event, can be READ or WRITE.
+ * @arg  The target memory address
+ * @decoded Set indexes and tags of arg, given by cache_decode_address() for the same geometry
+ * @p_stats Pointer to the statistics structure
+ */
+void cache_access_decoded(char type, uint64_t arg, const struct decoded_address_struct *decoded, cache_stats_t* p_stats) {
+    attributed_access(default_hierarchy, type, arg, 0, decoded, p_stats);
+}
+
+/**
+ * Subroutine computing the set indexes and tags of an address (driver interface). See decode_address().
+ */
+void cache_decode_address(uint64_t arg, struct decoded_address_struct *decoded) {
+    decode_address(default_hierarchy, arg, decoded);
+}
+
+/**
+ * Subroutine giving the geometry of l1 and l2 the decoded addresses depend on (driver interface).
+ */
+void cache_decode_geometry(struct decode_geometry_struct *geometry) {
+    decode_geometry(default_hierarchy, geometry);
+}
+
+/**
+ * Subroutine that simulates more accesses to the l1 sector of the previous access (driver interface). See
+ * repeat_access().
+ * @arg The target memory address of the previous access
+ * @reads Number of reads
+ * @writes Number of writes
+ * @p_stats Pointer to the statistics structure
+ */
+void cache_repeat_access(uint64_t arg, unsigned int reads, unsigned int writes, cache_stats_t* p_stats) {
+    repeat_access(default_hierarchy, arg, reads, writes, p_stats);
+}
+
+/**
+ * Subroutine to write the value of a store (driver interface). See store_value().
+ */
+void cache_store_value(uint64_t arg, uint64_t value, unsigned int size, cache_stats_t* p_stats){
+    store_value(default_hierarchy, arg, value, size, p_stats);
+}
+
+/**
+ * Subroutine to read a value (driver interface). See load_value().
+ */
+uint64_t cache_load_value(uint64_t arg, unsigned int size){
+    return load_value(default_hierarchy, arg, size);
+}
+
+/**
+ * Subroutine computing the overall statistics (driver interface).
  * @p_stats Pointer to the statistics structure
  */
 void complete_cache(cache_stats_t *p_stats) {
+    complete_hierarchy(default_hierarchy, p_stats);
+}
+
+/**
+ * Subroutine giving the top-K of a miss attribution table (driver interface). See attribution_top().
+ * @table ATTRIBUTION_REGION or ATTRIBUTION_PC
+ * @k Number of entries wanted
+ * @entries Array of at least k entries
+ */
+unsigned int cache_attribution_top(unsigned int table, unsigned int k, attribution_entry_t *entries) {
+    return default_hierarchy->attribution_top(table, k, entries);
 }
@@ -4,30 +4,50 @@
 
 #ifdef CCOMPILER
 #include <stdint.h>
+#include <stddef.h>
 #else
 #include <cstdint>
+#include <cstddef>
 #endif
 
-struct cache_stats_t {
-    uint64_t accesses;
-    uint64_t accesses_l2;
-    uint64_t accesses_vc;
-    uint64_t reads;
-    uint64_t read_misses_l1;
-    uint64_t read_misses_l2;
-    uint64_t writes;
-    uint64_t write_misses_l1;
-    uint64_t write_misses_l2;
-    uint64_t write_back_l1;
-    uint64_t write_back_l2;
-    uint64_t victim_hits;
-    double   avg_access_time_l1;
+#include "cachesim_api.h"
+#include "attribution.hpp"
+#include "miss_classification.hpp"
+#include "miss_trace.hpp"
+
+/** Set indexes and tags of an address in l1 and l2, as the simulation computes them (see cache_decode_address()) */
+struct decoded_address_struct {
+    uint64_t index_l1;
+    uint64_t tag_l1;
+    uint64_t index_l2;
+    uint64_t tag_l2;
+};
+
+/** What the decoded addresses depend on: two hierarchies with the same geometry decode every address the same way */
+struct decode_geometry_struct {
+    uint64_t block_bits_l1;
+    uint64_t sets_l1;
+    uint64_t index_function_l1;
+    uint64_t block_bits_l2;
+    uint64_t sets_l2;
+    uint64_t index_function_l2;
 };
 
-void setup_cache(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
-                 uint64_t c2, uint64_t b2, uint64_t s2);
+/* Driver interface. It simulates a single, process wide cache hierarchy (see CacheHierarchy for several ones) */
+bool setup_cache(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
+                 uint64_t c2, uint64_t b2, uint64_t s2,
+                 const cache_options_t *p_options = NULL);
 void cache_access(char type, uint64_t arg, cache_stats_t* p_stats);
+void cache_access_pc(char type, uint64_t arg, uint64_t pc, cache_stats_t* p_stats);
+void cache_access_sized(char type, uint64_t arg, unsigned int size, uint64_t pc, cache_stats_t* p_stats);
+void cache_access_decoded(char type, uint64_t arg, const struct decoded_address_struct *decoded, cache_stats_t* p_stats);
+void cache_decode_address(uint64_t arg, struct decoded_address_struct *decoded);
+void cache_decode_geometry(struct decode_geometry_struct *geometry);
+void cache_repeat_access(uint64_t arg, unsigned int reads, unsigned int writes, cache_stats_t* p_stats);
+void cache_store_value(uint64_t arg, uint64_t value, unsigned int size, cache_stats_t* p_stats);
+uint64_t cache_load_value(uint64_t arg, unsigned int size);
 void complete_cache(cache_stats_t *p_stats);
+unsigned int cache_attribution_top(unsigned int table, unsigned int k, attribution_entry_t *entries);
 
 static const uint64_t DEFAULT_C1 = 12;   /* 4KB Cache */
 static const uint64_t DEFAULT_B1 = 5;    /* 32-byte blocks */
@@ -41,11 +61,15 @@ static const uint64_t DEFAULT_V =  3;    /* 3 blocks in VC */
 static const char     READ = 'r';
 /** Argument to cache_access rw. Indicates a store */
 static const char     WRITE = 'w';
+/** Argument to cache_access rw. Indicates an instruction fetch */
+static const char     FETCH = 'i';
 
 /** LRU maximum value. Used to avoid resetting the LRU block value as it gets higher than the maximum possible value*/
 static const unsigned int LRU_MAX_VALUE =  255;
-/** Value only used to get the first index where we could write data in the victim cache*/
-static const unsigned int WRITABLE =  255;
+/** Largest number of sectors in a block. The sector valid and dirty masks are 16 bits wide */
+static const unsigned int MAX_SECTORS_PER_BLOCK = 16;
+/** Largest victim cache accepted by setup_cache(). The victim cache is fully associative, lookups go through a hash table */
+static const unsigned int MAX_VICTIM_CACHE_LINES = 1024;
 
 
 /* ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** **
@@ -54,19 +78,34 @@ static const unsigned int WRITABLE =  255;
 *************************
 ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** ** **/
 
-/**  Block struture or structure of one block in one set */
+/** Number of tag bits kept in a block_struct. Tags wider than that (addresses of 2^(52+B+index bits) and above) keep
+their low bits only, and the accesses to such addresses are counted in cache_stats_t::truncated_tag_accesses */
+#define BLOCK_TAG_BITS 52
+
+/**  Block struture or structure of one block in one set. Packed in 8 bytes, so that the way search of a set reads
+half as many host cache lines */
 struct block_struct {
     /** Indicates whether or not the cache block has been loaded with valid data. Set to 0 on power-up */
-    unsigned int valid_bit : 1;
+    unsigned long int valid_bit : 1;
     /** Indicates whether the associated cache line has been changed since it was read in main memory */
-    unsigned int dirty_bit : 1;
+    unsigned long int dirty_bit : 1;
     /** Bits used for the LRU algorithm. The lowest value is the least recently used cache line */
-    unsigned int LRU : 8; // If modified, also change the LRU max value
-    /** Tag. May vary according to C1 and S1 (64-C1-S1). However, the highest possible value is 63, since offset >= 1
-    Use Calloc or Malloc to set ... Not sure if can allocate 1-63 bits memory and use it correctly. Set to 63 for the moment Set to 64bits since all the rest is in 64 bits */
-    unsigned long int tag : 64;
-    /** Data elements. size 2^B1 bytes. */
-    char *data;
+    unsigned long int LRU : 8; // If modified, also change the LRU max value
+    /** Sector valid and dirty bits of an unsectored cache (single sector). Sectored caches keep them in
+    cache_struct::sectors. Use block_sector_valid() and block_sector_dirty() */
+    unsigned long int single_sector_valid : 1;
+    unsigned long int single_sector_dirty : 1;
+    /** Tag: the low BLOCK_TAG_BITS bits of the tag given by cache_tag() */
+    unsigned long int tag : BLOCK_TAG_BITS;
+    // Data elements (2^B bytes) are in cache_struct::data_arena, so that they do not take room in the tag array.
+};
+
+/** Sector state of a block of a sectored cache */
+struct block_sectors_struct {
+    /** One valid bit per sector. A valid block has at least one valid sector */
+    uint16_t valid;
+    /** One dirty bit per sector. Only the dirty sectors are written back */
+    uint16_t dirty;
 };
 
 /** Cache line structure */
@@ -74,7 +113,11 @@ struct cache_line_struct {
     /** Each cache line contains N1=2^S1 blocs. Each of those block are structure above */
     struct block_struct *blocks;
     /** Every other block will have the LRU set to 0 except for the last accessed block */
-    unsigned long int last_accessed_block: 64;
+    unsigned long int last_accessed_block: 32;
+    /** Number of random replacement choices made in the set (see random_below()) */
+    unsigned long int random_draws: 32;
+    /** Number of valid blocks in the set (caches with a presence filter only, unused by skewed caches) */
+    unsigned long int valid_blocks: 32;
 
 };
 
@@ -88,17 +131,51 @@ struct cache_struct {
     unsigned long int nb_cache_blocks_per_line : 64;
     /** Number of bytes per block */
     unsigned long int nb_bytes_per_data_block : 64;
+    /** Set index function (index_function_t) */
+    unsigned int index_function : 2;
+    /** Set when the index is hashed or the number of sets is not a power of two. The tag is then the whole block address */
+    unsigned int hashed_index : 1;
+    /** Sectors are 2^sector_bits bytes. Equal to the block bits for unsectored caches */
+    unsigned int sector_bits : 6;
+    /** Odd multipliers of the per way hash functions (skewed caches only) */
+    uint64_t *skew_multipliers;
+    /** Block contents, 2^B bytes per block, set after set (data mode only, NULL otherwise) */
+    char *data_arena;
+    /** Single allocation holding the sets, the blocks, their side state and the block contents (allocate_arena()),
+    and its size */
+    char *arena;
+    size_t arena_size;
+    /** Every block of the cache, set after set. Side state is indexed by block number (block_number()) */
+    struct block_struct *blocks;
+    /** Sector state of each block (sectored caches only, NULL otherwise) */
+    struct block_sectors_struct *sectors;
+    /** Compressed size of each block in 8 byte segments (compressed caches only, NULL otherwise) */
+    uint16_t *compressed_segments;
+    /** Presence filter: counting Bloom filter of the blocks held, with the two 8 bit counters of a block in the
+    same 64 byte line (NULL without filter). A null counter rules a block out. A saturated counter is never
+    decremented, so that the filter never rules out a block that is present */
+    uint8_t *presence_filter;
+    /** Number of 64 byte lines of the presence filter - 1 (a power of two - 1) */
+    unsigned long int presence_filter_mask : 64;
+    /** Searches ruled out by the presence filter */
+    uint64_t filtered_lookups;
+    /** Compression algorithm (compression_t). Only l2 may be compressed */
+    unsigned int compression : 2;
+    /** Data budget of a set in 8 byte segments (compressed caches only). The compressed blocks of a set must fit in it */
+    unsigned long int nb_segments_per_line : 64;
+    /** Key of the random replacement choices of the cache, derived from the seed of the hierarchy */
+    uint64_t random_key;
 };
 
 /** Victim cache block structure */
 struct victim_cache_block_struct {
     /** Tag. Size is 64 - B1. Highest value is 63 bits. Same conditions and problems as for "normal" cache*/
     unsigned long int tag : 64;
-    /** Data 2^B1 bytes. */
-    char *data;
-    /** Bit used to Indicate if the line has been newly written. If set to 0, can write. If all line has this bit set to 1,
-    remove the first line and set the rest of the bits to 0. This bit is used for FIFO. Helps avoiding moving all elements. */
-    unsigned int writable: 1;
+    // Data (2^B1 bytes) is in victim_cache_struct::data_arena
+    /** Indicates whether the line holds a block. Only valid lines are entered in the lookup table */
+    unsigned int valid_bit : 1;
+    /** Valid sectors of the l1 block. Victim cache blocks are always clean */
+    unsigned int sector_valid : 16;
 
 };
 
@@ -112,12 +189,73 @@ struct victim_cache_line_struct {
 struct victim_cache_struct {
     /** The victim cache consist in V cache lines */
     struct victim_cache_line_struct *victim_cache_lines;
-    /** V may takes values from 0 up to 4 */
-    unsigned int nb_victim_cache_lines : 2;
+    /** V may takes values from 0 up to MAX_VICTIM_CACHE_LINES */
+    unsigned int nb_victim_cache_lines;
     /** Number of blocks per line. Victim cache has only one block (set = 0) per cache line */
     unsigned int nb_victim_cache_blocks_per_line : 1;
     /** Number of bytes per block */
     unsigned long int nb_bytes_per_data_block : 64;
+    /** FIFO ring index. Next line to be replaced when an l1 block is moved in the victim cache */
+    unsigned int fifo_head;
+    /** Open addressed (linear probing) table keyed on the victim cache tag. Holds the line number + 1, 0 when the slot is empty */
+    unsigned int *lookup_table;
+    /** Number of slots in the lookup table minus one. The table size is a power of two at least twice V */
+    unsigned long int lookup_table_mask : 64;
+    /** Shift applied to the multiplicative hash of a tag to get a slot (64 - log2(table size)) */
+    unsigned int lookup_table_shift : 7;
+    /** Block contents, 2^B1 bytes per line (data mode only, NULL otherwise) */
+    char *data_arena;
+};
+
+/** Translation lookaside buffer. Set associative, LRU replacement */
+struct tlb_struct {
+    /** Virtual page number + 1 of each entry, set after set. 0 for an invalid entry */
+    uint64_t *vpns;
+    /** Physical page number of each entry */
+    uint64_t *pfns;
+    /** Last use of each entry (value of clock), for the LRU replacement */
+    uint64_t *last_use;
+    /** Number of sets. Any value */
+    unsigned long int nb_sets : 64;
+    /** Number of entries per set */
+    unsigned long int nb_ways : 64;
+    /** Incremented on each lookup */
+    uint64_t clock;
+};
+
+/** Page table (address translation only). Pages get physical frames in first touch order, so that the
+mapping of a trace is always the same */
+struct page_table_struct {
+    /** Open addressed (linear probing) table of virtual page numbers + 1. 0 for an empty slot */
+    uint64_t *vpns;
+    /** For each slot of the table, the physical page number */
+    uint64_t *pfns;
+    /** Number of slots in the table minus one (power of two minus one) */
+    unsigned long int table_mask : 64;
+    /** Shift applied to the multiplicative hash of a page number to get a slot */
+    unsigned int table_shift : 7;
+    /** Number of pages mapped. The next page touched gets this frame number */
+    unsigned long int nb_pages : 64;
+};
+
+/** Memory content (data mode only). Holds the blocks written back by l2, every other byte of memory is 0 */
+struct memory_struct {
+    /** Open addressed (linear probing) table of block addresses + 1. 0 for an empty slot */
+    uint64_t *block_addresses;
+    /** For each slot of the table, the block number in the content arena */
+    uint64_t *block_numbers;
+    /** Number of slots in the table minus one (power of two minus one) */
+    unsigned long int table_mask : 64;
+    /** Shift applied to the multiplicative hash of a block address to get a slot */
+    unsigned int table_shift : 7;
+    /** Number of blocks stored */
+    unsigned long int nb_blocks : 64;
+    /** Blocks stored, one after the other. Grows by doubling */
+    char *content_arena;
+    /** Number of blocks the content arena can hold */
+    unsigned long int content_arena_capacity : 64;
+    /** Number of bytes per block (l2 block size) */
+    unsigned long int nb_bytes_per_data_block : 64;
 };
 
 /** Masks used to get tag index and offset from memory addresses (Only used by main cache,
@@ -139,4 +277,110 @@ struct cache_mask_struct {
     unsigned int offset_mask_bit_length : 6;
 };
 
+/** Size of the buffer receiving the markers of one access (see CacheHierarchy::markers). An l1 miss to an invalid
+block can go on with the full set path, so the longest markers are "M1Mv" and "M1MvM2\n", plus the null character */
+#define ACCESS_MARKERS_LENGTH 16
+
+class CacheHierarchy;
+/** Hit path of l1 specialized for one geometry. Returns false, without any side effect, if the access is not an l1 hit */
+typedef bool (*l1_hit_kernel_t)(CacheHierarchy *hierarchy, char type, uint64_t arg, cache_stats_t *p_stats);
+
+/** A cache hierarchy: l1, victim cache, optional instruction cache, l2, and the memory content in data mode. Each
+object holds its whole state, so that several hierarchies can be simulated in the same process (cachesim_api.h is
+the C interface) */
+class CacheHierarchy {
+public:
+    /** Creates a hierarchy. Same parameters as setup_cache(). Returns NULL if out of memory or if the miss trace
+    cannot be written */
+    static CacheHierarchy *create(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
+                                  uint64_t c2, uint64_t b2, uint64_t s2,
+                                  const cache_options_t *p_options = NULL);
+    /** Frees a hierarchy created by create() */
+    static void destroy(CacheHierarchy *hierarchy);
+    /** Simulates one trace event (READ, WRITE or FETCH) */
+    void access(char type, uint64_t arg);
+    /** Simulates one trace event of the instruction at pc (miss attribution to PCs) */
+    void access(char type, uint64_t arg, uint64_t pc);
+    /** Simulates one trace event of size bytes, split at the l1 sector boundaries. See cache_access_sized() */
+    void access(char type, uint64_t arg, uint64_t pc, unsigned int size);
+    /** Simulates one trace event whose set indexes and tags are given by decode(). See cache_access_decoded() */
+    void access_decoded(char type, uint64_t arg, const struct decoded_address_struct *decoded);
+    /** Computes the set indexes and tags of an address, and the geometry they depend on */
+    void decode(uint64_t arg, struct decoded_address_struct *decoded) const;
+    void decode(struct decode_geometry_struct *geometry) const;
+    /** Simulates more reads and writes to the l1 sector of the previous access. See cache_repeat_access() */
+    void repeat_access(uint64_t arg, unsigned int reads, unsigned int writes);
+    /** Writes the value of a store (data mode). See cache_store_value() */
+    void store_value(uint64_t arg, uint64_t value, unsigned int size);
+    /** Reads a value (data mode). See cache_load_value() */
+    uint64_t load_value(uint64_t arg, unsigned int size);
+    /** Markers of the last access (cache_options_t::access_markers is ACCESS_MARKERS_BUFFER), "" otherwise */
+    const char *access_markers() const { return (markers == marker_buffer) ? marker_buffer : ""; }
+    /** Computes the final statistics. Call it once, after the last access */
+    const cache_stats_t *finish();
+    /** Statistics so far */
+    const cache_stats_t *statistics() const { return &stats; }
+    /** Top-K of a miss attribution table (attribution_table_t). See attribution_top() */
+    unsigned int attribution_top(unsigned int table, unsigned int k, attribution_entry_t *entries) const;
+
+    // State of the hierarchy. The simulation subroutines of cachesim.cpp work on it directly
+    struct victim_cache_struct victim_cache;
+    struct cache_struct l1_cache;
+    struct cache_struct l2_cache;
+    struct cache_mask_struct l1_cache_mask;
+    struct cache_mask_struct l2_cache_mask;
+    struct memory_struct memory;
+    /** Seed of the random replacements, given in the options */
+    uint64_t random_seed;
+    /** Effective capacity of a compressed l2: number of samples, and valid blocks seen over all the samples */
+    uint64_t compression_samples;
+    uint64_t compression_sampled_blocks;
+    /** Number of blocks compressed since the last sample */
+    unsigned long int compressions_since_sample;
+    /** Address translation: pages are 2^page_bits bytes, 0 if the addresses are physical */
+    unsigned int page_bits;
+    struct tlb_struct dtlb;
+    struct tlb_struct stlb;
+    struct page_table_struct page_table;
+    /** Miss attribution: regions are 2^attribution_region_bits bytes, 0 if the misses are not attributed to regions */
+    unsigned int attribution_region_bits;
+    /** Set when the misses are attributed to PCs */
+    bool attribution_pc;
+    struct attribution_table_struct region_attribution;
+    struct attribution_table_struct pc_attribution;
+    /** Set when the misses are classified (3C). The shadows see the accesses of l1 and l2 */
+    bool miss_classification;
+    struct shadow_cache_struct l1_shadow;
+    struct shadow_cache_struct l2_shadow;
+    /** Set while the l2 accesses are written to a miss trace (closed by finish()) */
+    bool miss_trace;
+    struct miss_trace_writer_struct miss_trace_writer;
+    /** Set when the fetches go to an instruction cache, next to l1 and sharing l2. It only sees the fetches */
+    bool instruction_cache;
+    struct cache_struct l1i_cache;
+    struct cache_mask_struct l1i_cache_mask;
+    /** Block of the last fetch (NULL before the first one) and its block address. A fetch in the same block skips
+    the search: no other access can replace the block in between */
+    struct block_struct *l1i_last_block;
+    uint64_t l1i_last_block_address;
+    /** Number of low address bits the tags of every level tell apart (64 if none is cut, see BLOCK_TAG_BITS) */
+    unsigned int tag_address_bits;
+    /** Block of the last l1 hit (NULL if the last l1 access was not a hit) and its block address. An access to the
+    same block skips the search: only hits happened since, so the block is still there */
+    struct block_struct *l1_last_block;
+    uint64_t l1_last_block_address;
+    /** l1 hit path specialized for the l1 geometry, NULL if none was compiled for it (see setup_cache()) */
+    l1_hit_kernel_t l1_hit_kernel;
+    /** Buffer receiving the markers of the current access (ACCESS_MARKERS_LENGTH characters, null terminated) and
+    their length. NULL prints them on the standard output */
+    char *markers;
+    unsigned int markers_length;
+    /** Set when the markers are not produced (ACCESS_MARKERS_NONE) */
+    bool markers_silent;
+    /** Buffer of the markers of the last access (ACCESS_MARKERS_BUFFER) */
+    char marker_buffer[ACCESS_MARKERS_LENGTH];
+    /** Statistics of access() */
+    cache_stats_t stats;
+};
+
 #endif /* CACHESIM_HPP */
@@ -0,0 +1,55 @@
+#include "cachesim.hpp"
+#include <string.h>
+
+// C interface (cachesim_api.h). A handle is a CacheHierarchy.
+
+static inline CacheHierarchy *hierarchy_of(cachesim_hierarchy_t *hierarchy){
+    return reinterpret_cast<CacheHierarchy *>(hierarchy);
+}
+
+cachesim_hierarchy_t *cachesim_create(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
+                                      uint64_t c2, uint64_t b2, uint64_t s2,
+                                      const cache_options_t *p_options){
+    return reinterpret_cast<cachesim_hierarchy_t *>(CacheHierarchy::create(c1, b1, s1, v, c2, b2, s2, p_options));
+}
+
+void cachesim_access(cachesim_hierarchy_t *hierarchy, char type, uint64_t address){
+    hierarchy_of(hierarchy)->access(type, address);
+}
+
+void cachesim_access_pc(cachesim_hierarchy_t *hierarchy, char type, uint64_t address, uint64_t pc){
+    hierarchy_of(hierarchy)->access(type, address, pc);
+}
+
+void cachesim_access_sized(cachesim_hierarchy_t *hierarchy, char type, uint64_t address, unsigned int size, uint64_t pc){
+    hierarchy_of(hierarchy)->access(type, address, pc, size);
+}
+
+void cachesim_repeat_access(cachesim_hierarchy_t *hierarchy, uint64_t address, unsigned int reads, unsigned int writes){
+    hierarchy_of(hierarchy)->repeat_access(address, reads, writes);
+}
+
+void cachesim_store_value(cachesim_hierarchy_t *hierarchy, uint64_t address, uint64_t value, unsigned int size){
+    hierarchy_of(hierarchy)->store_value(address, value, size);
+}
+
+uint64_t cachesim_load_value(cachesim_hierarchy_t *hierarchy, uint64_t address, unsigned int size){
+    return hierarchy_of(hierarchy)->load_value(address, size);
+}
+
+const char *cachesim_access_markers(cachesim_hierarchy_t *hierarchy){
+    return hierarchy_of(hierarchy)->access_markers();
+}
+
+void cachesim_finish(cachesim_hierarchy_t *hierarchy, cache_stats_t *p_stats){
+    memcpy(p_stats, hierarchy_of(hierarchy)->finish(), sizeof(cache_stats_t));
+}
+
+unsigned int cachesim_attribution_top(cachesim_hierarchy_t *hierarchy, unsigned int table, unsigned int k,
+                                      attribution_entry_t *entries){
+    return hierarchy_of(hierarchy)->attribution_top(table, k, entries);
+}
+
+void cachesim_destroy(cachesim_hierarchy_t *hierarchy){
+    CacheHierarchy::destroy(hierarchy_of(hierarchy));
+}
@@ -0,0 +1,221 @@
+#ifndef CACHESIM_API_H
+#define CACHESIM_API_H
+
+/* C interface of the cache simulator, for tools that embed it (trace capture, ...).
+ * Each handle is an independent cache hierarchy: several of them can be simulated in the same process. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of buckets of the compressed size histograms. Bucket i counts the blocks compressed to at most (i+1)/8 of their size */
+#define COMPRESSION_HISTOGRAM_BUCKETS 8
+
+struct cache_stats_t {
+    uint64_t accesses;
+    uint64_t accesses_l2;
+    uint64_t accesses_vc;
+    uint64_t reads;
+    uint64_t read_misses_l1;
+    uint64_t read_misses_l2;
+    uint64_t writes;
+    uint64_t write_misses_l1;
+    uint64_t write_misses_l2;
+    uint64_t write_back_l1;
+    uint64_t write_back_l2;
+    uint64_t victim_hits;
+    double   avg_access_time_l1;
+    uint64_t sector_misses_l1;
+    uint64_t sector_misses_l2;
+    uint64_t bytes_filled_l1;
+    uint64_t bytes_filled_l2;
+    uint64_t bytes_written_back_l1;
+    uint64_t bytes_written_back_l2;
+    uint64_t silent_stores;
+    uint64_t compression_evictions_l2;
+    uint64_t compressed_size_histogram_l2[COMPRESSION_HISTOGRAM_BUCKETS];
+    uint64_t resident_size_histogram_l2[COMPRESSION_HISTOGRAM_BUCKETS];
+    double   effective_capacity_l2;
+    uint64_t dtlb_misses;
+    uint64_t page_walks;
+    uint64_t pages_allocated;
+    uint64_t vipt_index_mismatches;
+    uint64_t compulsory_misses_l1;
+    uint64_t capacity_misses_l1;
+    uint64_t conflict_misses_l1;
+    uint64_t compulsory_misses_l2;
+    uint64_t capacity_misses_l2;
+    uint64_t conflict_misses_l2;
+    uint64_t miss_trace_records;
+    /** Miss trace records that could not be written to the file (write errors). The trace is incomplete if not 0 */
+    uint64_t miss_trace_lost_records;
+    /** Extra l1 accesses of the sized accesses crossing an l1 sector or block boundary */
+    uint64_t split_accesses;
+    /** Instruction side: fetches, and their misses in the instruction cache and in the (unified) l2. The data side
+    counters above do not include them, except the l2 write backs and the 3C classes of l2 */
+    uint64_t fetches;
+    uint64_t fetch_misses_l1i;
+    uint64_t fetch_misses_l2;
+    /** Seed of the random replacements (cache_options_t::random_seed) */
+    uint64_t random_seed;
+    /** L2 searches ruled out by the presence filter (cache_options_t::l2_presence_filter) */
+    uint64_t filtered_lookups_l2;
+    /** Accesses to addresses too wide for the tags kept by the blocks (BLOCK_TAG_BITS): their blocks may alias with
+        the blocks of other addresses */
+    uint64_t truncated_tag_accesses;
+};
+typedef struct cache_stats_t cache_stats_t;
+
+/** Miss attribution counters of one address region or one PC */
+struct attribution_entry_t {
+    /** Region number (address >> attribution_region_bits) or PC */
+    uint64_t key;
+    uint64_t l1_misses;
+    /** L1 misses not served by the victim cache */
+    uint64_t vc_misses;
+    /** L2 misses, including the L1 write backs that missed in L2 */
+    uint64_t l2_misses;
+    /** L1 and L2 write backs */
+    uint64_t write_backs;
+};
+typedef struct attribution_entry_t attribution_entry_t;
+
+/** Miss attribution tables */
+enum attribution_table_t {
+    /** Misses per address region */
+    ATTRIBUTION_REGION = 0,
+    /** Misses per PC */
+    ATTRIBUTION_PC = 1
+};
+
+/** Set index functions. Any function other than INDEX_MODULO, or a number of sets that is not a power of two,
+makes the cache keep the whole block address as tag. */
+enum index_function_t {
+    /** Index bits taken from the address. Multiply-shift reduction of the block address if the number of sets is not a power of two */
+    INDEX_MODULO = 0,
+    /** Index bits XORed with the next two groups of block address bits */
+    INDEX_XOR = 1,
+    /** Skewed associative cache: each way uses its own hash function of the block address */
+    INDEX_SKEWED = 2
+};
+
+/** Block compression algorithms (compressed l2 only) */
+enum compression_t {
+    /** Uncompressed blocks */
+    COMPRESSION_NONE = 0,
+    /** Base-Delta-Immediate: one base and an implicit zero base, narrow deltas */
+    COMPRESSION_BDI = 1,
+    /** Frequent Pattern Compression: 3 bit prefix per 32 bit word */
+    COMPRESSION_FPC = 2
+};
+
+/** Where the markers of the accesses (H1****, M1MvM2, ...) go */
+enum access_markers_t {
+    /** Printed on the standard output */
+    ACCESS_MARKERS_STDOUT = 0,
+    /** Not produced */
+    ACCESS_MARKERS_NONE = 1,
+    /** Kept for the last access only, see cachesim_access_markers() */
+    ACCESS_MARKERS_BUFFER = 2
+};
+
+/** Optional cache settings. A zeroed structure gives the power of two, modulo indexed caches */
+struct cache_options_t {
+    /** Number of sets in L1. 0 means 2^(C1-B1-S1). Any other value overrides C1 */
+    uint64_t l1_sets;
+    /** Number of sets in L2. 0 means 2^(C2-B2-S2). Any other value overrides C2 */
+    uint64_t l2_sets;
+    /** L1 set index function (index_function_t) */
+    unsigned int l1_index_function;
+    /** L2 set index function (index_function_t) */
+    unsigned int l2_index_function;
+    /** L1 sectors are 2^l1_sector_bits bytes. 0 means one sector per block (no sub-blocking) */
+    unsigned int l1_sector_bits;
+    /** L2 sectors are 2^l2_sector_bits bytes. 0 means one sector per block (no sub-blocking) */
+    unsigned int l2_sector_bits;
+    /** Non zero to keep the block contents (data mode). Needed by cache_store_value() and cache_load_value() */
+    unsigned int data_mode;
+    /** L2 compression algorithm (compression_t). Any algorithm but COMPRESSION_NONE implies the data mode.
+    A compressed l2 has twice as many tags as 2^S2 per set, the blocks of a set sharing 2^(S2+B2) bytes */
+    unsigned int l2_compression;
+    /** Pages are 2^page_bits bytes (12 for 4KB, 21 for 2MB, 30 for 1GB). 0 means no address translation:
+    the trace addresses are physical. Otherwise they are virtual and go through the TLBs first */
+    unsigned int page_bits;
+    /** Number of entries of the first level data TLB. 0 means 64 */
+    unsigned int dtlb_entries;
+    /** Associativity of the data TLB. 0 means 4 */
+    unsigned int dtlb_ways;
+    /** Number of entries of the second level (shared) TLB. 0 means 1536 */
+    unsigned int stlb_entries;
+    /** Associativity of the second level TLB. 0 means 12 */
+    unsigned int stlb_ways;
+    /** Miss attribution to address regions of 2^attribution_region_bits bytes (12 for 4KB pages). 0 means no
+    attribution. The events of an access (misses and write backs) are counted for the region of its trace address */
+    unsigned int attribution_region_bits;
+    /** Non zero to attribute the events of the accesses to their PC (see cachesim_access_pc()) */
+    unsigned int attribution_pc;
+    /** Non zero to classify the l1 and l2 misses into compulsory, capacity and conflict misses (3C). Each level
+    is shadowed by a fully associative LRU cache of the same capacity */
+    unsigned int miss_classification;
+    /** Name of a binary file receiving the l1 and victim cache misses and the l1 write backs (miss_trace.hpp),
+    NULL for none. The file is complete after cachesim_finish() */
+    const char *miss_trace_file;
+    /** The instruction cache is 2^l1i_size_bits bytes, with blocks of 2^B1 bytes. 0 means no instruction cache:
+    the fetches are then reads of l1 */
+    unsigned int l1i_size_bits;
+    /** Number of blocks in each set of the instruction cache is 2^l1i_way_bits */
+    unsigned int l1i_way_bits;
+    /** Seed of the pseudo random generator of the hierarchy (random replacements). The same seed gives the same
+    results */
+    uint64_t random_seed;
+    /** Non zero to keep a presence filter of the l2 blocks (8 bytes per block). A search for a block that the filter
+    rules out only looks for the replacement candidates of the set. The results are the same */
+    unsigned int l2_presence_filter;
+    /** Where the markers of the accesses go (access_markers_t). A zeroed structure prints them on the standard output */
+    unsigned int access_markers;
+};
+typedef struct cache_options_t cache_options_t;
+
+/** Opaque handle on a cache hierarchy (CacheHierarchy in C++) */
+typedef struct cachesim_hierarchy cachesim_hierarchy_t;
+
+/** Creates a cache hierarchy. Same parameters as setup_cache(). p_options may be NULL. Returns NULL if out of
+    memory or if the miss trace cannot be written */
+cachesim_hierarchy_t *cachesim_create(uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
+                                      uint64_t c2, uint64_t b2, uint64_t s2,
+                                      const cache_options_t *p_options);
+/** Simulates one trace event. type is 'r', 'w' or 'i' (instruction fetch) */
+void cachesim_access(cachesim_hierarchy_t *hierarchy, char type, uint64_t address);
+/** Simulates one trace event of the instruction at pc (attribution_pc) */
+void cachesim_access_pc(cachesim_hierarchy_t *hierarchy, char type, uint64_t address, uint64_t pc);
+/** Simulates one trace event of size bytes. An access crossing l1 sector (or block) boundaries is simulated as
+    one access per sector. pc may be 0 */
+void cachesim_access_sized(cachesim_hierarchy_t *hierarchy, char type, uint64_t address, unsigned int size, uint64_t pc);
+/** Simulates reads and writes more accesses to the l1 sector of the previous access (a run of accesses to the
+    same block collapsed by the trace reader, within one page when page_bits is set). They are l1 hits, or are
+    simulated one by one if the block is not in l1 */
+void cachesim_repeat_access(cachesim_hierarchy_t *hierarchy, uint64_t address, unsigned int reads, unsigned int writes);
+/** Writes the value of a store (data mode), right after the cachesim_access() of the store */
+void cachesim_store_value(cachesim_hierarchy_t *hierarchy, uint64_t address, uint64_t value, unsigned int size);
+/** Reads a value (data mode), right after the cachesim_access() of the load */
+uint64_t cachesim_load_value(cachesim_hierarchy_t *hierarchy, uint64_t address, unsigned int size);
+/** Markers of the last access, null terminated (at most 15 characters: the first ones of a repeated access). Empty
+    unless the hierarchy was created with ACCESS_MARKERS_BUFFER */
+const char *cachesim_access_markers(cachesim_hierarchy_t *hierarchy);
+/** Computes the final statistics and copies them in p_stats. Call it once, after the last access */
+void cachesim_finish(cachesim_hierarchy_t *hierarchy, cache_stats_t *p_stats);
+/** Copies in entries the (at most) k regions or PCs (attribution_table_t) with the most misses and write backs,
+    sorted from the worst. Returns the number of entries copied */
+unsigned int cachesim_attribution_top(cachesim_hierarchy_t *hierarchy, unsigned int table, unsigned int k,
+                                      attribution_entry_t *entries);
+/** Frees a cache hierarchy */
+void cachesim_destroy(cachesim_hierarchy_t *hierarchy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CACHESIM_API_H */
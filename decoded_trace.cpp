@@ -0,0 +1,311 @@
+#include "decoded_trace.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** FNV-1a 64 bit offset basis and prime, applied to 8 byte words */
+static const uint64_t HASH_BASIS = 0xCBF29CE484222325UL;
+static const uint64_t HASH_PRIME = 0x100000001B3UL;
+
+/**
+ * Subroutine hashing bytes (FNV-1a on 8 byte words, then on the last bytes).
+ * @hash Hash so far
+ * @bytes The bytes
+ * @length Number of bytes
+ */
+static uint64_t hash_bytes(uint64_t hash, const unsigned char *bytes, size_t length){
+    size_t i = 0;
+    uint64_t word = 0;
+    for (i = 0; i + 8 <= length; i += 8){
+        memcpy(&word, &bytes[i], 8);
+        hash = (hash ^ word) * HASH_PRIME;
+    }
+    for (; i < length; i++){
+        hash = (hash ^ bytes[i]) * HASH_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * Subroutine to hash a trace file without reading it through the stream, which stays at its position.
+ * @trace The trace
+ * @trace_hash Set to the hash of the whole file
+ * Returns false if the trace is not a regular file (pipe) or cannot be mapped
+ */
+bool hash_trace_file(FILE *trace, uint64_t *trace_hash){
+    struct stat status;
+    int descriptor = fileno(trace);
+    if ((fstat(descriptor, &status) != 0) or (not S_ISREG(status.st_mode)))
+        return false;
+    size_t length = status.st_size;
+    *trace_hash = hash_bytes(HASH_BASIS, (const unsigned char *) &length, sizeof(length));
+    if (length == 0)
+        return true;
+    void *bytes = mmap(NULL, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    if (bytes == MAP_FAILED)
+        return false;
+    madvise(bytes, length, MADV_SEQUENTIAL);
+    *trace_hash = hash_bytes(*trace_hash, (const unsigned char *) bytes, length);
+    munmap(bytes, length);
+    return true;
+}
+
+/**
+ * Subroutine giving the file name of the pre-decoded trace of a trace and a geometry.
+ * @file_name Set to the file name
+ * @length Size of file_name
+ * @directory Directory of the pre-decoded traces
+ * @trace_hash Hash of the trace
+ * @geometry Geometry of l1 and l2
+ */
+void decoded_trace_file_name(char *file_name, size_t length, const char *directory, uint64_t trace_hash,
+                             const struct decode_geometry_struct *geometry){
+    uint64_t geometry_hash = hash_bytes(HASH_BASIS, (const unsigned char *) geometry, sizeof(*geometry));
+    snprintf(file_name, length, "%s/%016lx-%016lx.dec", directory, (unsigned long) trace_hash, (unsigned long) geometry_hash);
+}
+
+/**
+ * Subroutine giving the size of the types column, padded so that the next columns are aligned.
+ * @nb_records Number of records
+ */
+static inline size_t types_column_size(uint64_t nb_records){
+    return (nb_records + 7) & ~(uint64_t) 7;
+}
+
+/**
+ * Subroutine to map a pre-decoded trace.
+ * @trace Address of the trace
+ * @file_name Name of the pre-decoded trace
+ * @trace_hash Hash of the text trace it must come from
+ * @geometry Geometry it must be decoded for
+ * Returns false if the file is missing, truncated, or decoded from another trace or for another geometry
+ */
+bool open_decoded_trace(struct decoded_trace_struct *trace, const char *file_name, uint64_t trace_hash,
+                        const struct decode_geometry_struct *geometry){
+    struct stat status;
+    int descriptor = open(file_name, O_RDONLY);
+    if (descriptor < 0)
+        return false;
+    if ((fstat(descriptor, &status) != 0) or ((size_t) status.st_size < sizeof(struct decoded_trace_header_struct))){
+        close(descriptor);
+        return false;
+    }
+    trace->mapping_size = status.st_size;
+    trace->mapping = mmap(NULL, trace->mapping_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (trace->mapping == MAP_FAILED)
+        return false;
+    const struct decoded_trace_header_struct *header = (const struct decoded_trace_header_struct *) trace->mapping;
+    uint64_t nb_records = header->nb_records;
+    if ((memcmp(header->magic, DECODED_TRACE_MAGIC, sizeof(header->magic)) != 0) or
+        (header->version != DECODED_TRACE_VERSION) or (header->trace_hash != trace_hash) or
+        (memcmp(&header->geometry, geometry, sizeof(*geometry)) != 0) or
+        (trace->mapping_size != sizeof(*header) + types_column_size(nb_records) +
+                                DECODED_TRACE_COLUMNS * nb_records * sizeof(uint64_t))){
+        munmap(trace->mapping, trace->mapping_size);
+        return false;
+    }
+    madvise(trace->mapping, trace->mapping_size, MADV_SEQUENTIAL);
+    trace->nb_records = nb_records;
+    trace->types = (const char *) trace->mapping + sizeof(*header);
+    trace->addresses = (const uint64_t *)(trace->types + types_column_size(nb_records));
+    trace->index_l1 = trace->addresses + nb_records;
+    trace->tag_l1 = trace->index_l1 + nb_records;
+    trace->index_l2 = trace->tag_l1 + nb_records;
+    trace->tag_l2 = trace->index_l2 + nb_records;
+    return true;
+}
+
+/**
+ * Subroutine to unmap a pre-decoded trace.
+ * @trace Address of the trace
+ */
+void close_decoded_trace(struct decoded_trace_struct *trace){
+    munmap(trace->mapping, trace->mapping_size);
+    trace->mapping = NULL;
+}
+
+/**
+ * Subroutine to write bytes to a file descriptor, short writes included.
+ * @file The file descriptor
+ * @bytes The bytes
+ * @length Number of bytes
+ * Returns false if the bytes cannot be written
+ */
+static bool write_bytes(int file, const void *bytes, size_t length){
+    const char *next = (const char *) bytes;
+    while (length > 0){
+        ssize_t written = write(file, next, length);
+        if (written <= 0)
+            return false;
+        next += written;
+        length -= written;
+    }
+    return true;
+}
+
+/**
+ * Subroutine for initializing the column files and buffers of a pre-decoded trace.
+ * @writer Address of the writer
+ * @file_name Name of the pre-decoded trace. The column files are created next to it
+ * Returns false if a column file or a buffer cannot be created. Nothing is left to free then
+ */
+bool setup_decoded_trace_writer(struct decoded_trace_writer_struct *writer, const char *file_name){
+    unsigned int i = 0;
+    size_t length = strlen(file_name) + 16;
+    char *column_name = (char *) malloc(length);
+    writer->nb_buffered = 0;
+    writer->nb_records = 0;
+    writer->failed = false;
+    writer->types = (char *) malloc(DECODED_TRACE_BUFFER_LENGTH);
+    bool allocated = (column_name != NULL) and (writer->types != NULL);
+    for (i = 0; i < DECODED_TRACE_COLUMNS; i++){
+        writer->columns[i] = (uint64_t *) malloc(DECODED_TRACE_BUFFER_LENGTH * sizeof(uint64_t));
+        allocated = allocated and (writer->columns[i] != NULL);
+    }
+    for (i = 0; i <= DECODED_TRACE_COLUMNS; i++){
+        writer->files[i] = -1;
+        if (not allocated)
+            continue;
+        snprintf(column_name, length, "%s.%u.tmp", file_name, i);
+        writer->files[i] = open(column_name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (writer->files[i] < 0)
+            allocated = false;
+        else
+            unlink(column_name);
+    }
+    free(column_name);
+    if (not allocated){
+        free_decoded_trace_writer(writer);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Subroutine to write the buffered records to the column files.
+ * @writer Address of the writer
+ */
+static void flush_decoded_trace_writer(struct decoded_trace_writer_struct *writer){
+    unsigned int i = 0;
+    bool written = write_bytes(writer->files[0], writer->types, writer->nb_buffered);
+    for (i = 0; i < DECODED_TRACE_COLUMNS; i++){
+        written = written and write_bytes(writer->files[i + 1], writer->columns[i], writer->nb_buffered * sizeof(uint64_t));
+    }
+    writer->failed = writer->failed or (not written);
+    writer->nb_buffered = 0;
+}
+
+/**
+ * Subroutine to add a record to a pre-decoded trace.
+ * @writer Address of the writer
+ * @type The type of event
+ * @address The memory address
+ * @decoded Set indexes and tags of the address
+ */
+void decoded_trace_add(struct decoded_trace_writer_struct *writer, char type, uint64_t address,
+                       const struct decoded_address_struct *decoded){
+    unsigned int i = writer->nb_buffered;
+    writer->types[i] = type;
+    writer->columns[0][i] = address;
+    writer->columns[1][i] = decoded->index_l1;
+    writer->columns[2][i] = decoded->tag_l1;
+    writer->columns[3][i] = decoded->index_l2;
+    writer->columns[4][i] = decoded->tag_l2;
+    writer->nb_buffered += 1;
+    writer->nb_records += 1;
+    if (writer->nb_buffered == DECODED_TRACE_BUFFER_LENGTH)
+        flush_decoded_trace_writer(writer);
+}
+
+/**
+ * Subroutine to copy a column file at the end of a file.
+ * @column The column file, read from its start
+ * @file The file
+ * @buffer Copy buffer of DECODED_TRACE_BUFFER_LENGTH * sizeof(uint64_t) bytes
+ * @length Number of bytes of the column
+ * Returns false if the column cannot be read or copied
+ */
+static bool copy_column(int column, int file, char *buffer, uint64_t length){
+    if (lseek(column, 0, SEEK_SET) != 0)
+        return false;
+    while (length > 0){
+        size_t chunk = (length < DECODED_TRACE_BUFFER_LENGTH * sizeof(uint64_t)) ? length : DECODED_TRACE_BUFFER_LENGTH * sizeof(uint64_t);
+        ssize_t nb_read = read(column, buffer, chunk);
+        if ((nb_read <= 0) or (not write_bytes(file, buffer, nb_read)))
+            return false;
+        length -= nb_read;
+    }
+    return true;
+}
+
+/**
+ * Subroutine to write a pre-decoded trace: the header, then the column files. It is written under a temporary name
+ * first, so that a simulation never maps a partial file.
+ * @writer Address of the writer
+ * @file_name Name of the pre-decoded trace
+ * @trace_hash Hash of the text trace
+ * @geometry Geometry of the decoded addresses
+ * Returns false if a column file could not be written, or if the file cannot be written
+ */
+bool write_decoded_trace(struct decoded_trace_writer_struct *writer, const char *file_name, uint64_t trace_hash,
+                         const struct decode_geometry_struct *geometry){
+    struct decoded_trace_header_struct header;
+    static const char padding[8] = {0};
+    unsigned int i = 0;
+    flush_decoded_trace_writer(writer);
+    if (writer->failed)
+        return false;
+    size_t length = strlen(file_name) + 5;
+    char *temporary_name = (char *) malloc(length);
+    if (temporary_name == NULL)
+        return false;
+    snprintf(temporary_name, length, "%s.tmp", file_name);
+    int file = open(temporary_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file < 0){
+        free(temporary_name);
+        return false;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DECODED_TRACE_MAGIC, sizeof(header.magic));
+    header.version = DECODED_TRACE_VERSION;
+    header.trace_hash = trace_hash;
+    header.geometry = *geometry;
+    header.nb_records = writer->nb_records;
+    // The buffer of the addresses is free once the records are flushed
+    char *buffer = (char *) writer->columns[0];
+    bool written = write_bytes(file, &header, sizeof(header));
+    written = written and copy_column(writer->files[0], file, buffer, writer->nb_records);
+    written = written and write_bytes(file, padding, types_column_size(writer->nb_records) - writer->nb_records);
+    for (i = 0; i < DECODED_TRACE_COLUMNS; i++){
+        written = written and copy_column(writer->files[i + 1], file, buffer, writer->nb_records * sizeof(uint64_t));
+    }
+    written = (close(file) == 0) and written;
+    written = written and (rename(temporary_name, file_name) == 0);
+    if (not written)
+        remove(temporary_name);
+    free(temporary_name);
+    return written;
+}
+
+/**
+ * Subroutine to close the column files and free the buffers of a pre-decoded trace.
+ * @writer Address of the writer
+ */
+void free_decoded_trace_writer(struct decoded_trace_writer_struct *writer){
+    unsigned int i = 0;
+    free(writer->types);
+    writer->types = NULL;
+    for (i = 0; i < DECODED_TRACE_COLUMNS; i++){
+        free(writer->columns[i]);
+        writer->columns[i] = NULL;
+    }
+    for (i = 0; i <= DECODED_TRACE_COLUMNS; i++){
+        if (writer->files[i] >= 0)
+            close(writer->files[i]);
+        writer->files[i] = -1;
+    }
+}
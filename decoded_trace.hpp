@@ -0,0 +1,85 @@
+#ifndef DECODED_TRACE_HPP
+#define DECODED_TRACE_HPP
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "cachesim.hpp"
+
+/** Pre-decoded trace: a header, then one column per field, in the byte order of the host. The types column (one
+byte per record) is padded to 8 bytes, then come the addresses and the decoded_address_struct fields, 8 bytes per
+record each. A simulation streams the columns in order, so that the hardware prefetchers keep up */
+#define DECODED_TRACE_MAGIC "CSIMDECT"
+#define DECODED_TRACE_VERSION 1
+/** Number of uint64_t columns after the types: address, index_l1, tag_l1, index_l2 and tag_l2 */
+#define DECODED_TRACE_COLUMNS 5
+
+struct decoded_trace_header_struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    /** Hash of the text trace (hash_trace_file()) */
+    uint64_t trace_hash;
+    struct decode_geometry_struct geometry;
+    uint64_t nb_records;
+};
+
+/** Pre-decoded trace mapped in memory */
+struct decoded_trace_struct {
+    void *mapping;
+    size_t mapping_size;
+    unsigned long int nb_records : 64;
+    const char *types;
+    const uint64_t *addresses;
+    const uint64_t *index_l1;
+    const uint64_t *tag_l1;
+    const uint64_t *index_l2;
+    const uint64_t *tag_l2;
+};
+
+/** Number of records a writer buffers before they are written to the column files */
+#define DECODED_TRACE_BUFFER_LENGTH 8192
+
+/** Pre-decoded trace being built. Each column is streamed to its own temporary file (unlinked as soon as it is
+created, next to the pre-decoded trace), and the column files are copied one after the other behind the header by
+write_decoded_trace(). Only DECODED_TRACE_BUFFER_LENGTH records per column are in memory */
+struct decoded_trace_writer_struct {
+    /** Column files: the types, then the DECODED_TRACE_COLUMNS uint64_t columns */
+    int files[DECODED_TRACE_COLUMNS + 1];
+    char *types;
+    uint64_t *columns[DECODED_TRACE_COLUMNS];
+    /** Records in the buffers, and records in total */
+    unsigned int nb_buffered;
+    unsigned long int nb_records : 64;
+    /** Set when a column file could not be written */
+    bool failed;
+};
+
+bool hash_trace_file(FILE *trace, uint64_t *trace_hash);
+void decoded_trace_file_name(char *file_name, size_t length, const char *directory, uint64_t trace_hash,
+                             const struct decode_geometry_struct *geometry);
+bool open_decoded_trace(struct decoded_trace_struct *trace, const char *file_name, uint64_t trace_hash,
+                        const struct decode_geometry_struct *geometry);
+void close_decoded_trace(struct decoded_trace_struct *trace);
+bool setup_decoded_trace_writer(struct decoded_trace_writer_struct *writer, const char *file_name);
+void decoded_trace_add(struct decoded_trace_writer_struct *writer, char type, uint64_t address,
+                       const struct decoded_address_struct *decoded);
+bool write_decoded_trace(struct decoded_trace_writer_struct *writer, const char *file_name, uint64_t trace_hash,
+                         const struct decode_geometry_struct *geometry);
+void free_decoded_trace_writer(struct decoded_trace_writer_struct *writer);
+
+/**
+ * Subroutine giving the decoded address of a record of a pre-decoded trace.
+ * @trace Address of the trace
+ * @i Number of the record
+ * @decoded Set to the indexes and tags of the record
+ */
+static inline void decoded_trace_record(const struct decoded_trace_struct *trace, unsigned long int i,
+                                        struct decoded_address_struct *decoded){
+    decoded->index_l1 = trace->index_l1[i];
+    decoded->tag_l1 = trace->tag_l1[i];
+    decoded->index_l2 = trace->index_l2[i];
+    decoded->tag_l2 = trace->tag_l2[i];
+}
+
+#endif /* DECODED_TRACE_HPP */
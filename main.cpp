@@ -13,24 +13,130 @@
 
 #include <unistd.h>
 #include "cachesim.hpp"
+#include "trace_pipeline.hpp"
+#include "reuse_profiler.hpp"
+#include "snapshot_writer.hpp"
+#include "simpoint.hpp"
+#include "parallel_sim.hpp"
+#include "decoded_trace.hpp"
 
 void print_help_and_exit(void) {
     printf("cachesim [OPTIONS] < traces/file.trace\n");
     printf("-h\t\tThis helpful output\n");
+    printf("-d\t\tData mode: keep the block contents\n");
+    printf("-r R\t\tSeed of the random replacements (default 0). The same seed gives the same results\n");
+    printf("-W W\t\tSimulate on W threads, each one simulating a partition of the L1 and L2 sets. Same results\n");
+    printf("\t\t(each thread has its own -E filter). Serial with a victim cache, -l, -P, -M, -R, -Q, -O, -Z,\n");
+    printf("\t\t-a, -g, -f, -z, or set indexes other than mod on a power of two number of sets\n");
     printf("L1 parameters:\n");
     printf("  -c C1\t\tTotal size in bytes is 2^C1\n");
     printf("  -b B1\t\tSize of each block in bytes is 2^B1\n");
     printf("  -s S1\t\tNumber of blocks per set is 2^S1\n");
+    printf("  -n N1\t\tNumber of sets is N1, any value (overrides C1)\n");
+    printf("  -x F1\t\tSet index function: mod, xor or skew\n");
+    printf("  -k K1\t\tSectored blocks, each sector is 2^K1 bytes\n");
+    printf("Instruction cache parameters (fetches are \"i <address>\" events, reads of L1 without instruction cache):\n");
+    printf("  -l CI\t\tInstruction cache, total size in bytes is 2^CI. Blocks are 2^B1 bytes\n");
+    printf("  -y SI\t\tNumber of blocks per set is 2^SI (default S1)\n");
     printf("Victim cache parameters:\n");
-    printf("  -v V\t\tNumber of blocks per set is V\n");
+    printf("  -v V\t\tNumber of blocks in the fully associative VC is V (0 to %u)\n", MAX_VICTIM_CACHE_LINES);
     printf("L2 parameters:\n");
     printf("  -C C2\t\tTotal size in bytes is 2^C2\n");
     printf("  -B B2\t\tSize of each block in bytes is 2^B2\n");
     printf("  -S S2\t\tNumber of blocks per set is 2^S2\n");
+    printf("  -N N2\t\tNumber of sets is N2, any value (overrides C2)\n");
+    printf("  -X F2\t\tSet index function: mod, xor or skew\n");
+    printf("  -K K2\t\tSectored blocks, each sector is 2^K2 bytes\n");
+    printf("  -Z A2\t\tCompressed blocks (implies -d): bdi or fpc\n");
+    printf("  -E\t\tPresence filter of the L2 blocks: faster L2 misses, same results\n");
+    printf("Address translation (the trace addresses are then virtual):\n");
+    printf("  -P P\t\tPages are 2^P bytes (12 for 4KB, 21 for 2MB, 30 for 1GB)\n");
+    printf("  -t E1\t\tNumber of data TLB entries (4 way, default 64)\n");
+    printf("  -T E2\t\tNumber of second level TLB entries (12 way, default 1536)\n");
+    printf("-M\t\tClassify the misses into compulsory, capacity and conflict misses\n");
+    printf("Interval statistics:\n");
+    printf("  -f F\t\tWrite the statistics of each interval to the CSV file F\n");
+    printf("  -i I\t\tIntervals are I trace events long (default 1000000)\n");
+    printf("Trace pipeline (applied in this order):\n");
+    printf("  -G G[@P]\tInterleave the trace file G with the standard input (repeatable). Its period is P\n");
+    printf("  -j J\t\tInterleaving: rr (one event of each trace in turn) or time (each trace issues one event\n");
+    printf("\t\tevery P time units, 1 by default)\n");
+    printf("  -Y\t\tThe traces are binary miss traces (see -O)\n");
+    printf("  -A F:L\t\tOnly keep the events F to L - 1 (F: keeps the events from F to the end)\n");
+    printf("  -e E\t\tOnly keep one event out of E\n");
+    printf("  -F r|w|i\tOnly keep the reads, the writes or the fetches\n");
+    printf("  -m M\t\tMask the addresses with M\n");
+    printf("  -o O\t\tAdd O to the addresses (after the mask)\n");
+    printf("  -g\t\tCollapse the runs of reads and writes to the same L1 sector (or block) into one event\n");
+    printf("-O O\t\tWrite the L1 and VC misses and the L1 write backs to the binary miss trace O\n");
+    printf("-D D\t\tKeep the trace pre-decoded for the L1 and L2 geometry in the directory D. The next runs on\n");
+    printf("\t\tthe same trace file and geometry skip the parsing and the index and tag computations (the\n");
+    printf("\t\ttrace is read as text with -d, -Z, -P, -a, -Q, -W, -z or the trace pipeline options)\n");
+    printf("Sampling (the traces must be files):\n");
+    printf("  -z K\t\tOnly simulate K representative intervals (SimPoints) and extrapolate the statistics\n");
+    printf("  -I I\t\tIntervals are I trace events long (default 100000)\n");
+    printf("  -u U\t\tWarm up the caches with the U trace events before each interval (default 10000)\n");
+    printf("Reuse profile (no simulation, blocks of 2^B1 bytes):\n");
+    printf("  -p\t\tReuse distance histogram and working set sizes\n");
+    printf("  -w W\t\tWorking set windows are W accesses long (default 1000000)\n");
+    printf("Miss attribution:\n");
+    printf("  -R R\t\tAttribute misses to regions of 2^R bytes (12 for pages)\n");
+    printf("  -Q\t\tAttribute misses to PCs, the trace gives the PC as a third field: r <address> <pc>\n");
+    printf("  -L K\t\tNumber of regions and PCs in the reports (default 10)\n");
+    printf("-a\t\tThe trace gives the size of the accesses after the address: r <address> <size>. Accesses\n");
+    printf("\t\tcrossing L1 sectors or blocks are split\n");
+    printf("Traces may give the value of the stores as a last field: w <address> <value>\n");
     exit(0);
 }
 
 void print_statistics(cache_stats_t* p_stats);
+void print_fetch_statistics(cache_stats_t* p_stats);
+void print_compression_statistics(cache_stats_t* p_stats);
+void print_tlb_statistics(cache_stats_t* p_stats);
+void print_miss_classification(cache_stats_t* p_stats);
+void print_attribution_report(unsigned int table, unsigned int k, unsigned int shift);
+void print_reuse_profile(struct reuse_profiler_struct *profiler);
+void simulate_record(const struct trace_record_struct *record, bool with_pc, bool data_mode, cache_stats_t* p_stats);
+void simulate_simpoints(struct trace_pipeline_struct *pipeline, struct trace_batch_struct *batch, unsigned int k,
+                        uint64_t interval_length, uint64_t warmup, bool data_mode, cache_stats_t* p_stats);
+
+void check_sector_bits(const char *level, uint64_t block_bits, unsigned int sector_bits) {
+    if (sector_bits == 0)
+        return;
+    if (sector_bits > block_bits || (1UL << (block_bits - sector_bits)) > MAX_SECTORS_PER_BLOCK) {
+        fprintf(stderr, "%s sectors of 2^%u bytes do not fit 2^%" PRIu64 " byte blocks (at most %u sectors per block)\n",
+                level, sector_bits, block_bits, MAX_SECTORS_PER_BLOCK);
+        exit(1);
+    }
+}
+
+unsigned int parse_index_function(const char *name) {
+    if (strcmp(name, "mod") == 0)
+        return INDEX_MODULO;
+    if (strcmp(name, "xor") == 0)
+        return INDEX_XOR;
+    if (strcmp(name, "skew") == 0)
+        return INDEX_SKEWED;
+    print_help_and_exit();
+    return INDEX_MODULO;
+}
+
+const char *index_function_name(unsigned int index_function) {
+    if (index_function == INDEX_XOR)
+        return "xor";
+    if (index_function == INDEX_SKEWED)
+        return "skew";
+    return "mod";
+}
+
+unsigned int parse_compression(const char *name) {
+    if (strcmp(name, "bdi") == 0)
+        return COMPRESSION_BDI;
+    if (strcmp(name, "fpc") == 0)
+        return COMPRESSION_FPC;
+    print_help_and_exit();
+    return COMPRESSION_NONE;
+}
 
 int main(int argc, char* argv[]) {
     int opt;
@@ -41,9 +147,24 @@ int main(int argc, char* argv[]) {
     uint64_t b2 = DEFAULT_B2;
     uint64_t s2 = DEFAULT_S2;
     uint64_t v = DEFAULT_V;
+    int l1i_way_bits = -1;
+    unsigned int top_k = 10;
+    bool reuse_profile = false;
+    uint64_t window_length = 1000000;
+    const char *snapshot_file = NULL;
+    uint64_t snapshot_interval = 1000000;
+    unsigned int simpoint_clusters = 0;
+    uint64_t simpoint_interval = 100000;
+    uint64_t simpoint_warmup = 10000;
+    unsigned int nb_threads = 1;
+    const char *decoded_directory = NULL;
+    struct trace_pipeline_struct pipeline;
+    setup_trace_pipeline(&pipeline, stdin, false);
+    cache_options_t options;
+    memset(&options, 0, sizeof(cache_options_t));
 
     /* Read arguments */
-    while(-1 != (opt = getopt(argc, argv, "c:b:s:v:C:B:S:h"))) {
+    while(-1 != (opt = getopt(argc, argv, "c:b:s:n:x:k:l:y:v:C:B:S:N:X:K:Z:P:t:T:R:QL:Mpw:f:i:z:I:u:G:j:A:e:F:m:o:YO:gar:W:D:dEh"))) {
         switch(opt) {
         case 'c':
             c1 = atoi(optarg);
@@ -54,6 +175,21 @@ int main(int argc, char* argv[]) {
         case 's':
             s1 = atoi(optarg);
             break;
+        case 'n':
+            options.l1_sets = atoi(optarg);
+            break;
+        case 'x':
+            options.l1_index_function = parse_index_function(optarg);
+            break;
+        case 'k':
+            options.l1_sector_bits = atoi(optarg);
+            break;
+        case 'l':
+            options.l1i_size_bits = atoi(optarg);
+            break;
+        case 'y':
+            l1i_way_bits = atoi(optarg);
+            break;
         case 'v':
             v = atoi(optarg);
             break;
@@ -66,6 +202,128 @@ int main(int argc, char* argv[]) {
         case 'S':
             s2 = atoi(optarg);
             break;
+        case 'N':
+            options.l2_sets = atoi(optarg);
+            break;
+        case 'X':
+            options.l2_index_function = parse_index_function(optarg);
+            break;
+        case 'K':
+            options.l2_sector_bits = atoi(optarg);
+            break;
+        case 'Z':
+            options.l2_compression = parse_compression(optarg);
+            break;
+        case 'P':
+            options.page_bits = atoi(optarg);
+            break;
+        case 't':
+            options.dtlb_entries = atoi(optarg);
+            break;
+        case 'T':
+            options.stlb_entries = atoi(optarg);
+            break;
+        case 'R':
+            options.attribution_region_bits = atoi(optarg);
+            break;
+        case 'Q':
+            options.attribution_pc = 1;
+            break;
+        case 'L':
+            top_k = atoi(optarg);
+            break;
+        case 'M':
+            options.miss_classification = 1;
+            break;
+        case 'p':
+            reuse_profile = true;
+            break;
+        case 'w':
+            window_length = strtoull(optarg, NULL, 0);
+            break;
+        case 'f':
+            snapshot_file = optarg;
+            break;
+        case 'i':
+            snapshot_interval = strtoull(optarg, NULL, 0);
+            break;
+        case 'z':
+            simpoint_clusters = atoi(optarg);
+            break;
+        case 'I':
+            simpoint_interval = strtoull(optarg, NULL, 0);
+            break;
+        case 'u':
+            simpoint_warmup = strtoull(optarg, NULL, 0);
+            break;
+        case 'G': {
+            char *period = strchr(optarg, '@');
+            if (period != NULL)
+                *period = '\0';
+            FILE *trace = fopen(optarg, "r");
+            if (trace == NULL || !add_trace_source(&pipeline, trace, (period == NULL) ? 1 : strtoull(period + 1, NULL, 0))) {
+                fprintf(stderr, "Cannot interleave the trace %s\n", optarg);
+                exit(1);
+            }
+            break;
+        }
+        case 'j':
+            if (strcmp(optarg, "rr") == 0)
+                pipeline.interleave = INTERLEAVE_ROUND_ROBIN;
+            else if (strcmp(optarg, "time") == 0)
+                pipeline.interleave = INTERLEAVE_TIME;
+            else
+                print_help_and_exit();
+            break;
+        case 'A': {
+            char *last = NULL;
+            pipeline.slice_first_event = strtoull(optarg, &last, 0);
+            if (*last != ':')
+                print_help_and_exit();
+            pipeline.slice_last_event = strtoull(last + 1, NULL, 0);
+            break;
+        }
+        case 'e':
+            pipeline.sample_period = strtoull(optarg, NULL, 0);
+            break;
+        case 'F':
+            if (optarg[0] != READ && optarg[0] != WRITE && optarg[0] != FETCH)
+                print_help_and_exit();
+            pipeline.type_filter = optarg[0];
+            break;
+        case 'm':
+            pipeline.address_mask = strtoull(optarg, NULL, 16);
+            break;
+        case 'o':
+            pipeline.address_offset = strtoull(optarg, NULL, 16);
+            break;
+        case 'g':
+            pipeline.collapse_runs = true;
+            break;
+        case 'Y':
+            pipeline.binary = true;
+            break;
+        case 'O':
+            options.miss_trace_file = optarg;
+            break;
+        case 'a':
+            pipeline.with_size = true;
+            break;
+        case 'r':
+            options.random_seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'W':
+            nb_threads = atoi(optarg);
+            break;
+        case 'D':
+            decoded_directory = optarg;
+            break;
+        case 'd':
+            options.data_mode = 1;
+            break;
+        case 'E':
+            options.l2_presence_filter = 1;
+            break;
         case 'h':
             /* Fall through */
         default:
@@ -74,40 +332,360 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    if (v > MAX_VICTIM_CACHE_LINES) {
+        fprintf(stderr, "Victim cache size %" PRIu64 " is larger than %u blocks\n", v, MAX_VICTIM_CACHE_LINES);
+        exit(1);
+    }
+    options.l1i_way_bits = (l1i_way_bits < 0) ? s1 : l1i_way_bits;
+    if (options.l1i_size_bits != 0 && options.l1i_size_bits < b1 + options.l1i_way_bits) {
+        fprintf(stderr, "The instruction cache of 2^%u bytes cannot hold a set of 2^%u blocks of 2^%" PRIu64 " bytes\n",
+                options.l1i_size_bits, options.l1i_way_bits, b1);
+        exit(1);
+    }
+    check_sector_bits("L1", b1, options.l1_sector_bits);
+    check_sector_bits("L2", b2, options.l2_sector_bits);
+    if (options.l2_compression != COMPRESSION_NONE && b2 < 3) {
+        fprintf(stderr, "Compressed L2 blocks must be at least 8 bytes\n");
+        exit(1);
+    }
+    if (options.page_bits != 0 && (options.page_bits < b2 || options.page_bits > 30)) {
+        fprintf(stderr, "Pages of 2^%u bytes must hold an L2 block and be at most 1GB\n", options.page_bits);
+        exit(1);
+    }
+
+    if (snapshot_file != NULL && snapshot_interval == 0) {
+        fprintf(stderr, "Intervals must be at least one trace event long\n");
+        exit(1);
+    }
+    if (simpoint_clusters != 0 && (simpoint_interval == 0 || snapshot_file != NULL)) {
+        fprintf(stderr, "SimPoint intervals must be at least one trace event long, without interval statistics\n");
+        exit(1);
+    }
+    if (pipeline.slice_last_event != 0 && pipeline.slice_last_event <= pipeline.slice_first_event) {
+        fprintf(stderr, "The slice %" PRIu64 ":%" PRIu64 " is empty\n", pipeline.slice_first_event, pipeline.slice_last_event);
+        exit(1);
+    }
+    if (simpoint_clusters != 0 && pipeline.collapse_runs) {
+        fprintf(stderr, "SimPoint intervals need every trace event, without run length collapsing\n");
+        exit(1);
+    }
+    if (options.miss_trace_file != NULL && b1 < 2) {
+        fprintf(stderr, "Miss traces need L1 blocks of at least 4 bytes\n");
+        exit(1);
+    }
+    if (options.attribution_region_bits > 63) {
+        fprintf(stderr, "Regions of 2^%u bytes are too large\n", options.attribution_region_bits);
+        exit(1);
+    }
+
+    /* Traces are read in batches, through the pipeline stages. With -Q, the PC comes before the store value */
+    pipeline.with_pc = (options.attribution_pc != 0);
+    pipeline.run_block_bits = (options.l1_sector_bits != 0) ? options.l1_sector_bits : b1;
+    if (options.page_bits != 0 && options.page_bits < pipeline.run_block_bits) {
+        // The pages of one l1 block may be mapped apart: runs stay in one page
+        pipeline.run_block_bits = options.page_bits;
+    }
+    struct trace_batch_struct *batch = (struct trace_batch_struct *) malloc(sizeof(struct trace_batch_struct));
+
+    if (reuse_profile) {
+        // Each access has its reuse distance
+        pipeline.collapse_runs = false;
+        printf("Profile Settings\n");
+        printf("b: %" PRIu64 "\n", b1);
+        printf("w: %" PRIu64 "\n", window_length);
+        printf("\n");
+        struct reuse_profiler_struct profiler;
+        setup_reuse_profiler(&profiler, b1, window_length);
+        while (read_trace_batch(&pipeline, batch)) {
+            for (unsigned int i = 0; i < batch->nb_records; i++)
+                reuse_profile_access(&profiler, batch->records[i].address);
+        }
+        print_reuse_profile(&profiler);
+        free_reuse_profiler(&profiler);
+        free(batch);
+        return 0;
+    }
+
+    /* Parallel simulation: the records are simulated by the worker of their sets */
+    unsigned int nb_workers = 1;
+    unsigned int partition_shift = 0;
+    if (nb_threads > 1) {
+        if (!pipeline.with_size && !pipeline.collapse_runs && snapshot_file == NULL && simpoint_clusters == 0)
+            nb_workers = parallel_sim_workers(nb_threads, c1, b1, s1, v, c2, b2, s2, &options, &partition_shift);
+        if (nb_workers == 1)
+            fprintf(stderr, "This configuration cannot be simulated in parallel, simulating it on one thread\n");
+    }
+
     printf("Cache Settings\n");
     printf("c: %" PRIu64 "\n", c1);
     printf("b: %" PRIu64 "\n", b1);
     printf("s: %" PRIu64 "\n", s1);
     printf("v: %" PRIu64 "\n", v);
+    if (options.l1i_size_bits != 0)
+        printf("l: %u, y: %u\n", options.l1i_size_bits, options.l1i_way_bits);
     printf("C: %" PRIu64 "\n", c2);
     printf("B: %" PRIu64 "\n", b2);
     printf("S: %" PRIu64 "\n", s2);
+    if (options.l1_sets != 0 || options.l1_index_function != INDEX_MODULO)
+        printf("L1 sets: %" PRIu64 ", index function: %s\n", options.l1_sets, index_function_name(options.l1_index_function));
+    if (options.l2_sets != 0 || options.l2_index_function != INDEX_MODULO)
+        printf("L2 sets: %" PRIu64 ", index function: %s\n", options.l2_sets, index_function_name(options.l2_index_function));
+    if (options.l1_sector_bits != 0)
+        printf("k: %u\n", options.l1_sector_bits);
+    if (options.l2_sector_bits != 0)
+        printf("K: %u\n", options.l2_sector_bits);
+    if (options.l2_compression != COMPRESSION_NONE)
+        printf("Z: %s\n", (options.l2_compression == COMPRESSION_BDI) ? "bdi" : "fpc");
+    if (options.page_bits != 0)
+        printf("P: %u, t: %u, T: %u\n", options.page_bits, (options.dtlb_entries == 0) ? 64 : options.dtlb_entries,
+               (options.stlb_entries == 0) ? 1536 : options.stlb_entries);
+    if (options.miss_classification != 0)
+        printf("M: 1\n");
+    if (options.attribution_region_bits != 0 || options.attribution_pc != 0)
+        printf("R: %u, Q: %u, L: %u\n", options.attribution_region_bits, options.attribution_pc, top_k);
+    if (snapshot_file != NULL)
+        printf("f: %s, i: %" PRIu64 "\n", snapshot_file, snapshot_interval);
+    if (pipeline.nb_sources > 1)
+        printf("Traces: %u, j: %s\n", pipeline.nb_sources, (pipeline.interleave == INTERLEAVE_TIME) ? "time" : "rr");
+    if (pipeline.slice_first_event != 0 || pipeline.slice_last_event != 0)
+        printf("A: %" PRIu64 ":%" PRIu64 "\n", pipeline.slice_first_event, pipeline.slice_last_event);
+    if (pipeline.sample_period > 1)
+        printf("e: %" PRIu64 "\n", pipeline.sample_period);
+    if (pipeline.type_filter != 0)
+        printf("F: %c\n", pipeline.type_filter);
+    if (pipeline.address_mask != ~UINT64_C(0) || pipeline.address_offset != 0)
+        printf("m: %" PRIx64 ", o: %" PRIx64 "\n", pipeline.address_mask, pipeline.address_offset);
+    if (pipeline.binary)
+        printf("Y: 1\n");
+    if (pipeline.collapse_runs)
+        printf("g: 1\n");
+    if (pipeline.with_size)
+        printf("a: 1\n");
+    if (options.miss_trace_file != NULL)
+        printf("O: %s\n", options.miss_trace_file);
+    if (simpoint_clusters != 0)
+        printf("z: %u, I: %" PRIu64 ", u: %" PRIu64 "\n", simpoint_clusters, simpoint_interval, simpoint_warmup);
+    if (nb_workers > 1)
+        printf("W: %u\n", nb_workers);
+    if (decoded_directory != NULL)
+        printf("D: %s\n", decoded_directory);
     printf("\n");
 
     /* Setup the cache */
-    setup_cache(c1, b1, s1, v, c2, b2, s2);
+    struct parallel_sim_struct *parallel_sim = NULL;
+    if (nb_workers > 1) {
+        parallel_sim = (struct parallel_sim_struct *) malloc(sizeof(struct parallel_sim_struct));
+        if (!start_parallel_sim(parallel_sim, nb_workers, partition_shift, c1, b1, s1, v, c2, b2, s2, &options)) {
+            fprintf(stderr, "Cannot start %u simulation threads\n", nb_workers);
+            exit(1);
+        }
+    } else {
+        if (!setup_cache(c1, b1, s1, v, c2, b2, s2, &options)) {
+            if (options.miss_trace_file != NULL)
+                fprintf(stderr, "Cannot allocate the caches or write the miss trace to %s\n", options.miss_trace_file);
+            else
+                fprintf(stderr, "Cannot allocate the caches: out of memory\n");
+            exit(1);
+        }
+    }
 
     /* Setup statistics */
     cache_stats_t stats;
     memset(&stats, 0, sizeof(cache_stats_t));
 
+    /* Setup the interval statistics. The loop only compares the number of events with the end of the interval */
+    struct snapshot_writer_struct snapshots;
+    uint64_t events = 0;
+    uint64_t next_snapshot = 0;
+    if (snapshot_file != NULL) {
+        if (!setup_snapshot_writer(&snapshots, snapshot_file)) {
+            fprintf(stderr, "Cannot write the interval statistics to %s\n", snapshot_file);
+            exit(1);
+        }
+        next_snapshot = snapshot_interval;
+    }
+
     /* Begin reading the file */
-    char rw;
-    uint64_t address;
-    while (!feof(stdin)) {
-        int ret = fscanf(stdin, "%c %" PRIx64 "\n", &rw, &address);
-        if(ret == 2) {
-            cache_access(rw, address, &stats);
+    bool data_mode = (options.data_mode != 0) || (options.l2_compression != COMPRESSION_NONE);
+
+    /* Pre-decoded trace: a plain trace file is simulated from its decoded columns when they are in the directory,
+     * and they are written there otherwise */
+    struct decoded_trace_struct decoded_trace;
+    struct decoded_trace_writer_struct decoded_writer;
+    struct decode_geometry_struct geometry;
+    char decoded_file_name[4096];
+    uint64_t trace_hash = 0;
+    bool decoded_replay = false;
+    bool decoded_record = false;
+    if (decoded_directory != NULL) {
+        bool plain_trace = pipeline.nb_sources == 1 && !pipeline.binary && !pipeline.with_size && !pipeline.with_pc &&
+                           !pipeline.collapse_runs && pipeline.slice_first_event == 0 && pipeline.slice_last_event == 0 &&
+                           pipeline.sample_period <= 1 && pipeline.type_filter == 0 &&
+                           pipeline.address_mask == ~UINT64_C(0) && pipeline.address_offset == 0;
+        if (!plain_trace || data_mode || options.page_bits != 0 || simpoint_clusters != 0 || parallel_sim != NULL) {
+            fprintf(stderr, "The trace cannot be pre-decoded with these options, reading it as text\n");
+        } else if (!hash_trace_file(stdin, &trace_hash)) {
+            fprintf(stderr, "Only trace files can be pre-decoded, reading the trace as text\n");
+        } else {
+            cache_decode_geometry(&geometry);
+            decoded_trace_file_name(decoded_file_name, sizeof(decoded_file_name), decoded_directory, trace_hash, &geometry);
+            decoded_replay = open_decoded_trace(&decoded_trace, decoded_file_name, trace_hash, &geometry);
+            decoded_record = !decoded_replay;
+            if (decoded_record && !setup_decoded_trace_writer(&decoded_writer, decoded_file_name)) {
+                fprintf(stderr, "Cannot write the pre-decoded trace %s, reading the trace as text\n", decoded_file_name);
+                decoded_record = false;
+            }
+        }
+    }
+    for (uint64_t i = 0; decoded_replay && i < decoded_trace.nb_records; i++) {
+        struct decoded_address_struct decoded;
+        decoded_trace_record(&decoded_trace, i, &decoded);
+        cache_access_decoded(decoded_trace.types[i], decoded_trace.addresses[i], &decoded, &stats);
+        events += 1;
+        if (snapshot_file != NULL && events >= next_snapshot) {
+            queue_snapshot(&snapshots, events, &stats);
+            next_snapshot += snapshot_interval;
         }
     }
 
-    complete_cache(&stats);
+    if (simpoint_clusters != 0)
+        simulate_simpoints(&pipeline, batch, simpoint_clusters, simpoint_interval, simpoint_warmup, data_mode, &stats);
+    while (parallel_sim != NULL && read_trace_batch(&pipeline, batch)) {
+        parallel_sim_batch(parallel_sim, batch);
+    }
+    while (parallel_sim == NULL && simpoint_clusters == 0 && !decoded_replay && read_trace_batch(&pipeline, batch)) {
+        for (unsigned int i = 0; i < batch->nb_records; i++) {
+            if (decoded_record) {
+                struct decoded_address_struct decoded;
+                cache_decode_address(batch->records[i].address, &decoded);
+                decoded_trace_add(&decoded_writer, batch->records[i].type, batch->records[i].address, &decoded);
+            }
+            simulate_record(&batch->records[i], pipeline.with_pc, data_mode, &stats);
+            // A collapsed run ends the intervals it crosses
+            events += 1 + batch->records[i].run_reads + batch->records[i].run_writes;
+            if (snapshot_file != NULL && events >= next_snapshot) {
+                queue_snapshot(&snapshots, events, &stats);
+                next_snapshot += snapshot_interval * ((events - next_snapshot) / snapshot_interval + 1);
+            }
+        }
+    }
+    if (decoded_replay)
+        close_decoded_trace(&decoded_trace);
+    if (decoded_record) {
+        if (!write_decoded_trace(&decoded_writer, decoded_file_name, trace_hash, &geometry))
+            fprintf(stderr, "Cannot write the pre-decoded trace %s\n", decoded_file_name);
+        free_decoded_trace_writer(&decoded_writer);
+    }
+    if (snapshot_file != NULL) {
+        // Last, partial, interval
+        if (events + snapshot_interval != next_snapshot)
+            queue_snapshot(&snapshots, events, &stats);
+        finish_snapshot_writer(&snapshots);
+    }
+
+    if (parallel_sim != NULL) {
+        finish_parallel_sim(parallel_sim, &stats);
+        free(parallel_sim);
+    } else {
+        complete_cache(&stats);
+    }
 
     print_statistics(&stats);
+    if (stats.fetches != 0)
+        print_fetch_statistics(&stats);
+    if (options.l2_compression != COMPRESSION_NONE)
+        print_compression_statistics(&stats);
+    if (options.page_bits != 0)
+        print_tlb_statistics(&stats);
+    if (options.miss_classification != 0)
+        print_miss_classification(&stats);
+    if (options.miss_trace_file != NULL)
+        printf("Miss trace records: %" PRIu64 "\n", stats.miss_trace_records);
+    if (pipeline.with_size)
+        printf("Split accesses: %" PRIu64 "\n", stats.split_accesses);
+    if (pipeline.collapse_runs)
+        printf("Events folded into runs: %" PRIu64 "\n", pipeline.nb_collapsed_events);
+    if (options.l2_presence_filter != 0)
+        printf("L2 searches ruled out by the presence filter: %" PRIu64 "\n", stats.filtered_lookups_l2);
+    if (stats.truncated_tag_accesses != 0)
+        fprintf(stderr, "Warning: %" PRIu64 " accesses are too wide for the cache tags, their blocks may alias\n",
+                stats.truncated_tag_accesses);
+    if (options.attribution_region_bits != 0)
+        print_attribution_report(ATTRIBUTION_REGION, top_k, options.attribution_region_bits);
+    if (options.attribution_pc != 0)
+        print_attribution_report(ATTRIBUTION_PC, top_k, 0);
 
+    free(batch);
+    if (stats.miss_trace_lost_records != 0) {
+        fprintf(stderr, "Cannot write the miss trace to %s: %" PRIu64 " records lost\n", options.miss_trace_file,
+                stats.miss_trace_lost_records);
+        exit(1);
+    }
     return 0;
 }
 
+/* Simulates one trace event. Store values, when present, are only used in data mode */
+void simulate_record(const struct trace_record_struct *record, bool with_pc, bool data_mode, cache_stats_t* p_stats) {
+    if (record->size > 1) {
+        cache_access_sized(record->type, record->address, record->size, record->pc, p_stats);
+    } else if (with_pc) {
+        cache_access_pc(record->type, record->address, record->pc, p_stats);
+    } else {
+        cache_access(record->type, record->address, p_stats);
+    }
+    if (record->has_value && record->type == WRITE && data_mode) {
+        cache_store_value(record->address, record->value, (record->size == 0 || record->size > 8) ? 8 : record->size, p_stats);
+    }
+    if (record->run_reads != 0 || record->run_writes != 0) {
+        cache_repeat_access(record->address, record->run_reads, record->run_writes, p_stats);
+    }
+}
+
+/* Reads the traces twice: the first pass clusters the intervals, the second one simulates the representative
+ * intervals (with their warm up) and skips the others. p_stats gets the statistics extrapolated to the whole trace */
+void simulate_simpoints(struct trace_pipeline_struct *pipeline, struct trace_batch_struct *batch, unsigned int k,
+                        uint64_t interval_length, uint64_t warmup, bool data_mode, cache_stats_t* p_stats) {
+    struct simpoint_profile_struct profile;
+    setup_simpoint_profile(&profile, interval_length);
+    while (read_trace_batch(pipeline, batch)) {
+        for (unsigned int i = 0; i < batch->nb_records; i++)
+            simpoint_profile_event(&profile, pipeline->with_pc ? batch->records[i].pc : batch->records[i].address >> 12);
+    }
+    struct simpoint_struct *simpoints = (struct simpoint_struct *) calloc(k, sizeof(struct simpoint_struct));
+    unsigned int nb_simpoints = choose_simpoints(&profile, k, simpoints);
+    if (!rewind_trace_pipeline(pipeline)) {
+        fprintf(stderr, "SimPoints need trace files, not pipes\n");
+        exit(1);
+    }
+    printf("SimPoints (interval, weight):\n");
+    for (unsigned int i = 0; i < nb_simpoints; i++)
+        printf("  %" PRIu64 ": %f\n", simpoints[i].interval, (double) simpoints[i].cluster_events / profile.nb_events);
+
+    cache_stats_t running;
+    cache_stats_t start;
+    memset(&running, 0, sizeof(cache_stats_t));
+    memset(&start, 0, sizeof(cache_stats_t));
+    uint64_t event = 0;
+    unsigned int next = 0;
+    while (next < nb_simpoints && read_trace_batch(pipeline, batch)) {
+        for (unsigned int i = 0; i < batch->nb_records && next < nb_simpoints; i++, event++) {
+            uint64_t first = simpoints[next].interval * interval_length;
+            if (event + warmup < first)
+                continue;
+            if (event == first)
+                start = running;
+            simulate_record(&batch->records[i], pipeline->with_pc, data_mode, &running);
+            if (event + 1 == first + profile.interval_events[simpoints[next].interval]) {
+                add_simpoint_statistics(p_stats, &start, &running,
+                    (double) simpoints[next].cluster_events / profile.interval_events[simpoints[next].interval]);
+                next += 1;
+            }
+        }
+    }
+    free(simpoints);
+    free_simpoint_profile(&profile);
+}
+
 void print_statistics(cache_stats_t* p_stats) {
     printf("Cache Statistics\n");
     printf("Accesses: %" PRIu64 "\n", p_stats->accesses);
@@ -123,5 +701,78 @@ void print_statistics(cache_stats_t* p_stats) {
     printf("Write backs from L2: %" PRIu64 "\n", p_stats->write_back_l2);
     printf("L1 victims hit in victim cache: %" PRIu64 "\n", p_stats->victim_hits);
     printf("Average access time (AAT) for L1: %f\n", p_stats->avg_access_time_l1);
+    printf("Sector misses to L1: %" PRIu64 "\n", p_stats->sector_misses_l1);
+    printf("Sector misses to L2: %" PRIu64 "\n", p_stats->sector_misses_l2);
+    printf("Bytes filled in L1: %" PRIu64 "\n", p_stats->bytes_filled_l1);
+    printf("Bytes filled in L2: %" PRIu64 "\n", p_stats->bytes_filled_l2);
+    printf("Bytes written back from L1: %" PRIu64 "\n", p_stats->bytes_written_back_l1);
+    printf("Bytes written back from L2: %" PRIu64 "\n", p_stats->bytes_written_back_l2);
+    printf("Silent stores: %" PRIu64 "\n", p_stats->silent_stores);
+    printf("Random seed: %" PRIu64 "\n", p_stats->random_seed);
 }
 
+void print_fetch_statistics(cache_stats_t* p_stats) {
+    printf("Fetches: %" PRIu64 "\n", p_stats->fetches);
+    printf("Fetch misses to L1I: %" PRIu64 "\n", p_stats->fetch_misses_l1i);
+    printf("Fetch misses to L2: %" PRIu64 "\n", p_stats->fetch_misses_l2);
+}
+
+void print_compression_statistics(cache_stats_t* p_stats) {
+    printf("Compression evictions from L2: %" PRIu64 "\n", p_stats->compression_evictions_l2);
+    printf("Effective L2 capacity: %f\n", p_stats->effective_capacity_l2);
+    printf("Compressed size histogram (fills and write backs to L2):\n");
+    for (unsigned int i = 0; i < COMPRESSION_HISTOGRAM_BUCKETS; i++)
+        printf("  <= %u/%u: %" PRIu64 "\n", i + 1, COMPRESSION_HISTOGRAM_BUCKETS, p_stats->compressed_size_histogram_l2[i]);
+    printf("Compressed size histogram (blocks left in L2):\n");
+    for (unsigned int i = 0; i < COMPRESSION_HISTOGRAM_BUCKETS; i++)
+        printf("  <= %u/%u: %" PRIu64 "\n", i + 1, COMPRESSION_HISTOGRAM_BUCKETS, p_stats->resident_size_histogram_l2[i]);
+}
+
+void print_tlb_statistics(cache_stats_t* p_stats) {
+    printf("Data TLB misses: %" PRIu64 "\n", p_stats->dtlb_misses);
+    printf("Page walks: %" PRIu64 "\n", p_stats->page_walks);
+    printf("Pages allocated: %" PRIu64 "\n", p_stats->pages_allocated);
+    printf("Accesses with a different VIPT L1 set: %" PRIu64 "\n", p_stats->vipt_index_mismatches);
+}
+
+void print_miss_classification(cache_stats_t* p_stats) {
+    printf("Compulsory misses to L1: %" PRIu64 "\n", p_stats->compulsory_misses_l1);
+    printf("Capacity misses to L1: %" PRIu64 "\n", p_stats->capacity_misses_l1);
+    printf("Conflict misses to L1: %" PRIu64 "\n", p_stats->conflict_misses_l1);
+    printf("Compulsory misses to L2: %" PRIu64 "\n", p_stats->compulsory_misses_l2);
+    printf("Capacity misses to L2: %" PRIu64 "\n", p_stats->capacity_misses_l2);
+    printf("Conflict misses to L2: %" PRIu64 "\n", p_stats->conflict_misses_l2);
+}
+
+void print_attribution_report(unsigned int table, unsigned int k, unsigned int shift) {
+    attribution_entry_t *entries = (attribution_entry_t *) calloc((k == 0) ? 1 : k, sizeof(attribution_entry_t));
+    unsigned int nb_entries = cache_attribution_top(table, k, entries);
+    printf("Top %u %s (L1 misses, VC misses, L2 misses, write backs):\n", nb_entries,
+           (table == ATTRIBUTION_PC) ? "PCs" : "regions");
+    for (unsigned int i = 0; i < nb_entries; i++)
+        printf("  %" PRIx64 ": %" PRIu64 ", %" PRIu64 ", %" PRIu64 ", %" PRIu64 "\n", entries[i].key << shift,
+               entries[i].l1_misses, entries[i].vc_misses, entries[i].l2_misses, entries[i].write_backs);
+    free(entries);
+}
+
+void print_reuse_profile(struct reuse_profiler_struct *profiler) {
+    printf("Reuse Profile\n");
+    printf("Accesses: %" PRIu64 "\n", profiler->accesses);
+    printf("Distinct blocks (cold accesses): %" PRIu64 "\n", profiler->cold_accesses);
+    printf("Reuse distance histogram (distance, accesses, hit ratio of a fully associative LRU cache of that size):\n");
+    unsigned int last_bucket = 0;
+    for (unsigned int i = 0; i < REUSE_DISTANCE_BUCKETS; i++)
+        if (profiler->histogram[i] != 0)
+            last_bucket = i;
+    uint64_t hits = 0;
+    for (unsigned int i = 0; i <= last_bucket; i++) {
+        hits += profiler->histogram[i];
+        printf("  [%" PRIu64 ", %" PRIu64 "): %" PRIu64 ", %f\n", (i == 0) ? 0 : (UINT64_C(1) << (i - 1)), UINT64_C(1) << i,
+               profiler->histogram[i], (profiler->accesses == 0) ? 0.0 : (double) hits / profiler->accesses);
+    }
+    if (profiler->window_length != 0) {
+        printf("Working set (distinct blocks per window of %" PRIu64 " accesses):\n", profiler->window_length);
+        for (unsigned long int i = 0; i < profiler->nb_windows; i++)
+            printf("  %lu: %" PRIu64 "\n", i, profiler->window_blocks[i]);
+    }
+}
@@ -0,0 +1,206 @@
+#include "miss_classification.hpp"
+#include <stdlib.h>
+
+/**
+ * Subroutine giving the multiplicative hash slot of a block address in a table of 2^(64 - shift) slots.
+ * @block_address The block address
+ * @shift 64 minus the number of bits of a slot
+ * @mask Number of slots minus one
+ */
+static inline unsigned long int shadow_slot(uint64_t block_address, unsigned int shift, unsigned long int mask){
+    return (unsigned long int)((block_address * 0x9E3779B97F4A7C15UL) >> shift) & mask;
+}
+
+/**
+ * Subroutine for initializing the shadow of a cache level.
+ * @shadow Address of the shadow
+ * @nb_blocks Capacity of the cache level in blocks
+ * Returns false if out of memory. free_shadow_cache() frees what was allocated
+ */
+bool setup_shadow_cache(struct shadow_cache_struct *shadow, unsigned long int nb_blocks){
+    shadow->nb_entries = (nb_blocks == 0) ? 1 : nb_blocks;
+    shadow->nb_used_entries = 0;
+    shadow->blocks = (uint64_t *) calloc(shadow->nb_entries, sizeof(uint64_t));
+    shadow->previous = (unsigned int *) calloc(shadow->nb_entries, sizeof(unsigned int));
+    shadow->next = (unsigned int *) calloc(shadow->nb_entries, sizeof(unsigned int));
+    shadow->mru = shadow->nb_entries;
+    shadow->lru = shadow->nb_entries;
+    // At least twice as many slots as entries, so that the probe sequences stay short
+    unsigned long int table_size = 2;
+    shadow->lookup_table_shift = 63;
+    while (table_size < 2 * shadow->nb_entries){
+        table_size <<= 1;
+        shadow->lookup_table_shift -= 1;
+    }
+    shadow->lookup_table = (unsigned int *) calloc(table_size, sizeof(unsigned int));
+    shadow->lookup_table_mask = table_size - 1;
+    shadow->touched_table_shift = 64 - 10;
+    shadow->touched_table_mask = (1UL << 10) - 1;
+    shadow->touched_blocks = (uint64_t *) calloc(shadow->touched_table_mask + 1, sizeof(uint64_t));
+    shadow->nb_touched_blocks = 0;
+    return (shadow->blocks != NULL) and (shadow->previous != NULL) and (shadow->next != NULL) and
+           (shadow->lookup_table != NULL) and (shadow->touched_blocks != NULL);
+}
+
+/**
+ * Subroutine to free the shadow of a cache level.
+ * @shadow Address of the shadow
+ */
+void free_shadow_cache(struct shadow_cache_struct *shadow){
+    free(shadow->blocks);
+    free(shadow->previous);
+    free(shadow->next);
+    free(shadow->lookup_table);
+    free(shadow->touched_blocks);
+    shadow->blocks = NULL;
+    shadow->previous = NULL;
+    shadow->next = NULL;
+    shadow->lookup_table = NULL;
+    shadow->touched_blocks = NULL;
+}
+
+/**
+ * Subroutine to record a block in the first touch filter.
+ * @shadow Address of the shadow
+ * @block_address The block address
+ * Returns true if the block was not accessed before
+ */
+static bool touch_block(struct shadow_cache_struct *shadow, uint64_t block_address){
+    unsigned long int slot = shadow_slot(block_address, shadow->touched_table_shift, shadow->touched_table_mask);
+    while (shadow->touched_blocks[slot] != 0){
+        if (shadow->touched_blocks[slot] == block_address + 1)
+            return false;
+        slot = (slot + 1) & shadow->touched_table_mask;
+    }
+    if (2 * (shadow->nb_touched_blocks + 1) > shadow->touched_table_mask + 1){
+        // Table half full. Double it and insert every block again
+        unsigned long int old_size = shadow->touched_table_mask + 1;
+        uint64_t *old_blocks = shadow->touched_blocks;
+        shadow->touched_table_mask = 2 * old_size - 1;
+        shadow->touched_table_shift -= 1;
+        shadow->touched_blocks = (uint64_t *) calloc(2 * old_size, sizeof(uint64_t));
+        unsigned long int i = 0;
+        for (i = 0; i < old_size; i++){
+            if (old_blocks[i] == 0)
+                continue;
+            unsigned long int new_slot = shadow_slot(old_blocks[i] - 1, shadow->touched_table_shift,
+                                                     shadow->touched_table_mask);
+            while (shadow->touched_blocks[new_slot] != 0){
+                new_slot = (new_slot + 1) & shadow->touched_table_mask;
+            }
+            shadow->touched_blocks[new_slot] = old_blocks[i];
+        }
+        free(old_blocks);
+        slot = shadow_slot(block_address, shadow->touched_table_shift, shadow->touched_table_mask);
+        while (shadow->touched_blocks[slot] != 0){
+            slot = (slot + 1) & shadow->touched_table_mask;
+        }
+    }
+    shadow->touched_blocks[slot] = block_address + 1;
+    shadow->nb_touched_blocks += 1;
+    return true;
+}
+
+/**
+ * Subroutine to remove a block from the lookup table. The following entries of the probe sequence are shifted
+ * back, so that no tombstone is needed (same scheme as the victim cache lookup table).
+ * @shadow Address of the shadow
+ * @block_address The block address. Must be present in the table.
+ */
+static void shadow_lookup_remove(struct shadow_cache_struct *shadow, uint64_t block_address){
+    unsigned long int slot = shadow_slot(block_address, shadow->lookup_table_shift, shadow->lookup_table_mask);
+    while (shadow->blocks[shadow->lookup_table[slot] - 1] != block_address){
+        slot = (slot + 1) & shadow->lookup_table_mask;
+    }
+    unsigned long int next_slot = slot;
+    while (true){
+        next_slot = (next_slot + 1) & shadow->lookup_table_mask;
+        if (shadow->lookup_table[next_slot] == 0)
+            break;
+        // An entry can be moved in the hole only if its home slot is not between the hole and its current place
+        unsigned long int home = shadow_slot(shadow->blocks[shadow->lookup_table[next_slot] - 1],
+                                             shadow->lookup_table_shift, shadow->lookup_table_mask);
+        if (((next_slot - home) & shadow->lookup_table_mask) >= ((next_slot - slot) & shadow->lookup_table_mask)){
+            shadow->lookup_table[slot] = shadow->lookup_table[next_slot];
+            slot = next_slot;
+        }
+    }
+    shadow->lookup_table[slot] = 0;
+}
+
+/**
+ * Subroutine to unlink an entry from the LRU list.
+ * @shadow Address of the shadow
+ * @entry The entry
+ */
+static inline void shadow_unlink(struct shadow_cache_struct *shadow, unsigned int entry){
+    if (shadow->previous[entry] != shadow->nb_entries)
+        shadow->next[shadow->previous[entry]] = shadow->next[entry];
+    else
+        shadow->mru = shadow->next[entry];
+    if (shadow->next[entry] != shadow->nb_entries)
+        shadow->previous[shadow->next[entry]] = shadow->previous[entry];
+    else
+        shadow->lru = shadow->previous[entry];
+}
+
+/**
+ * Subroutine to link an entry at the head (most recently used end) of the LRU list.
+ * @shadow Address of the shadow
+ * @entry The entry
+ */
+static inline void shadow_push_mru(struct shadow_cache_struct *shadow, unsigned int entry){
+    shadow->previous[entry] = shadow->nb_entries;
+    shadow->next[entry] = shadow->mru;
+    if (shadow->mru != shadow->nb_entries)
+        shadow->previous[shadow->mru] = entry;
+    else
+        shadow->lru = entry;
+    shadow->mru = entry;
+}
+
+/**
+ * Subroutine to access a block in the shadow of a cache level. The block becomes the most recently used one.
+ * The result is the class the access has if the real cache level misses (a hit of the real cache level is not
+ * classified).
+ * @shadow Address of the shadow
+ * @block_address The block address accessed
+ * Returns MISS_COMPULSORY if the block was never accessed, MISS_CONFLICT if the fully associative LRU cache holds
+ * the block, MISS_CAPACITY otherwise (miss_class_t)
+ */
+unsigned int shadow_cache_access(struct shadow_cache_struct *shadow, uint64_t block_address){
+    bool first_touch = touch_block(shadow, block_address);
+    unsigned long int slot = shadow_slot(block_address, shadow->lookup_table_shift, shadow->lookup_table_mask);
+    if (not first_touch){
+        while (shadow->lookup_table[slot] != 0){
+            unsigned int entry = shadow->lookup_table[slot] - 1;
+            if (shadow->blocks[entry] == block_address){
+                if (shadow->mru != entry){
+                    shadow_unlink(shadow, entry);
+                    shadow_push_mru(shadow, entry);
+                }
+                return MISS_CONFLICT;
+            }
+            slot = (slot + 1) & shadow->lookup_table_mask;
+        }
+    }
+
+    // Miss of the fully associative cache: fill a free entry, or replace the LRU one
+    unsigned int entry = 0;
+    if (shadow->nb_used_entries < shadow->nb_entries){
+        entry = shadow->nb_used_entries;
+        shadow->nb_used_entries += 1;
+    } else {
+        entry = shadow->lru;
+        shadow_lookup_remove(shadow, shadow->blocks[entry]);
+        shadow_unlink(shadow, entry);
+    }
+    shadow->blocks[entry] = block_address;
+    shadow_push_mru(shadow, entry);
+    slot = shadow_slot(block_address, shadow->lookup_table_shift, shadow->lookup_table_mask);
+    while (shadow->lookup_table[slot] != 0){
+        slot = (slot + 1) & shadow->lookup_table_mask;
+    }
+    shadow->lookup_table[slot] = entry + 1;
+    return first_touch ? MISS_COMPULSORY : MISS_CAPACITY;
+}
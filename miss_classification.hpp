@@ -0,0 +1,49 @@
+#ifndef MISS_CLASSIFICATION_HPP
+#define MISS_CLASSIFICATION_HPP
+
+#include <stdint.h>
+
+/** Class of a miss (3C model) */
+enum miss_class_t {
+    /** First access to the block */
+    MISS_COMPULSORY = 0,
+    /** A fully associative LRU cache of the same capacity misses too */
+    MISS_CAPACITY = 1,
+    /** A fully associative LRU cache of the same capacity hits */
+    MISS_CONFLICT = 2
+};
+
+/** Shadow of a cache level for the 3C classification: a fully associative LRU cache of the same capacity, and the
+set of the blocks ever accessed (first touch filter). Both are open addressed (linear probing) tables, and the LRU
+order is a doubly linked list threaded through the entries, so that an access is O(1) */
+struct shadow_cache_struct {
+    /** Number of entries, the capacity of the cache level in blocks */
+    unsigned long int nb_entries : 64;
+    /** Number of entries in use. They are filled in order, then the LRU entry is replaced */
+    unsigned long int nb_used_entries : 64;
+    /** Block address held by each entry */
+    uint64_t *blocks;
+    /** LRU list: previous (more recently used) and next (less recently used) entry. nb_entries ends the list */
+    unsigned int *previous;
+    unsigned int *next;
+    /** Most and least recently used entries */
+    unsigned int mru;
+    unsigned int lru;
+    /** Lookup table: entry + 1 of each slot, 0 for an empty slot */
+    unsigned int *lookup_table;
+    /** Number of slots in the lookup table minus one (power of two minus one) */
+    unsigned long int lookup_table_mask : 64;
+    /** Shift applied to the multiplicative hash of a block address to get a lookup slot */
+    unsigned int lookup_table_shift : 7;
+    /** First touch filter: block address + 1 of each slot, 0 for an empty slot. The table grows when needed */
+    uint64_t *touched_blocks;
+    unsigned long int touched_table_mask : 64;
+    unsigned int touched_table_shift : 7;
+    unsigned long int nb_touched_blocks : 64;
+};
+
+bool setup_shadow_cache(struct shadow_cache_struct *shadow, unsigned long int nb_blocks);
+void free_shadow_cache(struct shadow_cache_struct *shadow);
+unsigned int shadow_cache_access(struct shadow_cache_struct *shadow, uint64_t block_address);
+
+#endif /* MISS_CLASSIFICATION_HPP */
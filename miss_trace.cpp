@@ -0,0 +1,121 @@
+#include "miss_trace.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Writer thread: writes the buffers handed by the simulation until the writer is closed.
+ * @argument Address of the writer
+ */
+static void *miss_trace_writer_thread(void *argument){
+    struct miss_trace_writer_struct *writer = (struct miss_trace_writer_struct *) argument;
+    pthread_mutex_lock(&writer->lock);
+    while (true){
+        while ((writer->pending == NULL) and (not writer->done)){
+            pthread_cond_wait(&writer->handed, &writer->lock);
+        }
+        if (writer->pending == NULL)
+            break;
+        uint64_t *buffer = writer->pending;
+        unsigned long int nb_records = writer->nb_pending;
+        pthread_mutex_unlock(&writer->lock);
+        unsigned long int written = fwrite(buffer, sizeof(uint64_t), nb_records, writer->file);
+        pthread_mutex_lock(&writer->lock);
+        writer->nb_lost_records += nb_records - written;
+        writer->pending = NULL;
+        pthread_cond_signal(&writer->idle);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+/**
+ * Subroutine to create a miss trace file, write its header and start the writer thread.
+ * @writer Address of the writer
+ * @file_name Name of the miss trace file
+ * @block_bits l1 blocks are 2^block_bits bytes (at least 4 bytes, so that the kind fits in the low bits)
+ * Returns false if the file cannot be created or the thread cannot be started
+ */
+bool open_miss_trace(struct miss_trace_writer_struct *writer, const char *file_name, unsigned int block_bits){
+    struct miss_trace_header_struct header;
+    writer->file = fopen(file_name, "wb");
+    if (writer->file == NULL)
+        return false;
+    // The buffers are written whole: without stdio buffering, fwrite() reports every write error
+    setvbuf(writer->file, NULL, _IONBF, 0);
+    memcpy(header.magic, MISS_TRACE_MAGIC, sizeof(header.magic));
+    header.version = MISS_TRACE_VERSION;
+    header.block_bits = block_bits;
+    writer->buffers[0] = (uint64_t *) malloc(MISS_TRACE_BUFFER_LENGTH * sizeof(uint64_t));
+    writer->buffers[1] = (uint64_t *) malloc(MISS_TRACE_BUFFER_LENGTH * sizeof(uint64_t));
+    if ((fwrite(&header, sizeof(header), 1, writer->file) != 1) or (writer->buffers[0] == NULL) or
+        (writer->buffers[1] == NULL)){
+        free(writer->buffers[0]);
+        free(writer->buffers[1]);
+        fclose(writer->file);
+        writer->file = NULL;
+        return false;
+    }
+    writer->current = 0;
+    writer->nb_records = 0;
+    writer->nb_lost_records = 0;
+    writer->pending = NULL;
+    writer->nb_pending = 0;
+    writer->done = false;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->handed, NULL);
+    pthread_cond_init(&writer->idle, NULL);
+    if (pthread_create(&writer->thread, NULL, miss_trace_writer_thread, writer) != 0){
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->handed);
+        pthread_cond_destroy(&writer->idle);
+        free(writer->buffers[0]);
+        free(writer->buffers[1]);
+        fclose(writer->file);
+        writer->file = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Subroutine to hand the current buffer to the writer thread and go on with the other one. Waits only if the
+ * writer thread has not written the other one yet.
+ * @writer Address of the writer
+ */
+void flush_miss_trace_buffer(struct miss_trace_writer_struct *writer){
+    pthread_mutex_lock(&writer->lock);
+    while (writer->pending != NULL){
+        pthread_cond_wait(&writer->idle, &writer->lock);
+    }
+    writer->pending = writer->buffers[writer->current];
+    writer->nb_pending = writer->nb_records;
+    pthread_cond_signal(&writer->handed);
+    pthread_mutex_unlock(&writer->lock);
+    writer->current ^= 1;
+    writer->nb_records = 0;
+}
+
+/**
+ * Subroutine to write the last records, stop the writer thread and close the file.
+ * @writer Address of the writer
+ * Returns the number of records that could not be written
+ */
+unsigned long int close_miss_trace(struct miss_trace_writer_struct *writer){
+    if (writer->file == NULL)
+        return 0;
+    if (writer->nb_records != 0)
+        flush_miss_trace_buffer(writer);
+    pthread_mutex_lock(&writer->lock);
+    writer->done = true;
+    pthread_cond_signal(&writer->handed);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->handed);
+    pthread_cond_destroy(&writer->idle);
+    fclose(writer->file);
+    free(writer->buffers[0]);
+    free(writer->buffers[1]);
+    writer->file = NULL;
+    return writer->nb_lost_records;
+}
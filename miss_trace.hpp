@@ -0,0 +1,70 @@
+#ifndef MISS_TRACE_HPP
+#define MISS_TRACE_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/** Binary miss trace: a header, then one 64 bit word per l2 access, in the byte order of the host. The word is the
+l1 block address shifted left by the l1 block bits, ored with the kind of the access (miss_trace_kind_t) */
+#define MISS_TRACE_MAGIC "CSIMMISS"
+#define MISS_TRACE_VERSION 1
+/** Number of records of each of the two buffers of a writer */
+#define MISS_TRACE_BUFFER_LENGTH 65536
+
+/** Kind of an access in a miss trace (stored in the low bits of its block address) */
+enum miss_trace_kind_t {
+    /** Read missing in l1 and the victim cache */
+    MISS_TRACE_READ = 0,
+    /** Write missing in l1 and the victim cache */
+    MISS_TRACE_WRITE = 1,
+    /** Write back of a dirty l1 block */
+    MISS_TRACE_WRITE_BACK = 2
+};
+#define MISS_TRACE_KIND_MASK 3
+
+struct miss_trace_header_struct {
+    char magic[8];
+    uint32_t version;
+    /** l1 blocks are 2^block_bits bytes */
+    uint32_t block_bits;
+};
+
+/** Buffered writer: the simulation fills one buffer while a writer thread writes the other one to the file */
+struct miss_trace_writer_struct {
+    FILE *file;
+    uint64_t *buffers[2];
+    /** Buffer being filled, and its number of records */
+    unsigned int current;
+    unsigned long int nb_records : 64;
+    /** Number of records the writer thread could not write (write errors) */
+    unsigned long int nb_lost_records : 64;
+    /** Buffer handed to the writer thread (NULL when it is idle), and its number of records */
+    uint64_t *pending;
+    unsigned long int nb_pending : 64;
+    /** Set when no buffer will be handed any more */
+    bool done;
+    pthread_mutex_t lock;
+    pthread_cond_t handed;
+    pthread_cond_t idle;
+    pthread_t thread;
+};
+
+bool open_miss_trace(struct miss_trace_writer_struct *writer, const char *file_name, unsigned int block_bits);
+void flush_miss_trace_buffer(struct miss_trace_writer_struct *writer);
+unsigned long int close_miss_trace(struct miss_trace_writer_struct *writer);
+
+/**
+ * Subroutine to add an access to a miss trace.
+ * @writer Address of the writer
+ * @block_address The l1 block address, shifted left by the l1 block bits
+ * @kind Kind of the access (miss_trace_kind_t)
+ */
+static inline void miss_trace_record(struct miss_trace_writer_struct *writer, uint64_t block_address, unsigned int kind){
+    writer->buffers[writer->current][writer->nb_records] = block_address | kind;
+    writer->nb_records += 1;
+    if (writer->nb_records == MISS_TRACE_BUFFER_LENGTH)
+        flush_miss_trace_buffer(writer);
+}
+
+#endif /* MISS_TRACE_HPP */
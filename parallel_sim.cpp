@@ -0,0 +1,257 @@
+#include "parallel_sim.hpp"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+
+/** Event counters of cache_stats_t added over the workers */
+static const size_t parallel_sim_counters[] = {
+    offsetof(cache_stats_t, accesses), offsetof(cache_stats_t, accesses_l2), offsetof(cache_stats_t, accesses_vc),
+    offsetof(cache_stats_t, reads), offsetof(cache_stats_t, read_misses_l1), offsetof(cache_stats_t, read_misses_l2),
+    offsetof(cache_stats_t, writes), offsetof(cache_stats_t, write_misses_l1), offsetof(cache_stats_t, write_misses_l2),
+    offsetof(cache_stats_t, write_back_l1), offsetof(cache_stats_t, write_back_l2), offsetof(cache_stats_t, victim_hits),
+    offsetof(cache_stats_t, sector_misses_l1), offsetof(cache_stats_t, sector_misses_l2),
+    offsetof(cache_stats_t, bytes_filled_l1), offsetof(cache_stats_t, bytes_filled_l2),
+    offsetof(cache_stats_t, bytes_written_back_l1), offsetof(cache_stats_t, bytes_written_back_l2),
+    offsetof(cache_stats_t, silent_stores), offsetof(cache_stats_t, fetches),
+    offsetof(cache_stats_t, filtered_lookups_l2),
+    offsetof(cache_stats_t, truncated_tag_accesses),
+};
+
+/**
+ * Subroutine giving the number of set index bits of a cache level, or -1 if its index is not a range of address bits.
+ * @c Total size is 2^c bytes
+ * @b Blocks are 2^b bytes
+ * @s Sets have 2^s blocks
+ * @sets Number of sets given in the options (0 if none)
+ * @index_function Set index function (index_function_t)
+ */
+static int index_bits(uint64_t c, uint64_t b, uint64_t s, uint64_t sets, unsigned int index_function){
+    int bits = 0;
+    if (index_function != INDEX_MODULO)
+        return -1;
+    if (sets == 0)
+        return (c > b + s) ? (int)(c - b - s) : 0;
+    if ((sets & (sets - 1)) != 0)
+        return -1;
+    while ((1UL << bits) < sets){
+        bits += 1;
+    }
+    return bits;
+}
+
+/**
+ * Subroutine giving the number of workers a configuration can be simulated on. The hierarchy must only have set
+ * local state: no victim cache (fully associative), no instruction cache, no address translation, no shadow caches,
+ * no attribution tables, no miss trace and no compression sampling. The address bits choosing the worker must be
+ * in the set index of l1 and of l2.
+ * @nb_threads Number of threads wanted
+ * @p_options Optional settings, see setup_cache() for the other parameters
+ * @partition_shift Set to the first address bit choosing the worker
+ * Returns the number of workers, a power of two. 1 means the configuration must be simulated serially
+ */
+unsigned int parallel_sim_workers(unsigned int nb_threads, uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
+                                  uint64_t c2, uint64_t b2, uint64_t s2, const cache_options_t *p_options,
+                                  unsigned int *partition_shift){
+    unsigned int nb_workers = 1;
+    unsigned int worker_bits = 0;
+    if ((v != 0) or (p_options->page_bits != 0) or (p_options->miss_classification != 0) or
+        (p_options->attribution_region_bits != 0) or (p_options->attribution_pc != 0) or
+        (p_options->miss_trace_file != NULL) or (p_options->l1i_size_bits != 0) or
+        (p_options->l2_compression != COMPRESSION_NONE))
+        return 1;
+    int l1_index_bits = index_bits(c1, b1, s1, p_options->l1_sets, p_options->l1_index_function);
+    int l2_index_bits = index_bits(c2, b2, s2, p_options->l2_sets, p_options->l2_index_function);
+    if ((l1_index_bits < 0) or (l2_index_bits < 0))
+        return 1;
+    // The worker bits are the lowest index bits common to l1 and l2
+    uint64_t shift = (b1 > b2) ? b1 : b2;
+    uint64_t top = (b1 + l1_index_bits < b2 + l2_index_bits) ? b1 + l1_index_bits : b2 + l2_index_bits;
+    while ((nb_workers * 2 <= nb_threads) and (nb_workers * 2 <= PARALLEL_SIM_MAX_WORKERS) and
+           (shift + worker_bits + 1 <= top)){
+        nb_workers *= 2;
+        worker_bits += 1;
+    }
+    *partition_shift = shift;
+    return nb_workers;
+}
+
+/**
+ * Subroutine for a thread waiting for another one: yields the processor for the first PARALLEL_SIM_SPINS polls,
+ * then sleeps between polls, so that idle workers do not take the processors of the others.
+ * @polls Address of the number of polls so far
+ */
+static inline void parallel_sim_wait(unsigned int *polls){
+    if (*polls < PARALLEL_SIM_SPINS){
+        *polls += 1;
+        sched_yield();
+    } else {
+        usleep(50);
+    }
+}
+
+/**
+ * Worker thread: simulates the records of its ring as they are added, until the simulation is finished and the ring
+ * is empty.
+ * @argument Address of the worker
+ */
+static void *parallel_worker_thread(void *argument){
+    struct parallel_worker_struct *worker = (struct parallel_worker_struct *) argument;
+    struct parallel_sim_struct *sim = worker->sim;
+    struct parallel_ring_struct *ring = &worker->ring;
+    CacheHierarchy *hierarchy = worker->hierarchy;
+    uint64_t simulated = 0;
+    unsigned int polls = 0;
+    while (true){
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head == simulated){
+            // Records added before done is set are seen after it
+            if (__atomic_load_n(&sim->done, __ATOMIC_ACQUIRE) and (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == simulated))
+                break;
+            parallel_sim_wait(&polls);
+            continue;
+        }
+        polls = 0;
+        for (; simulated != head; simulated++){
+            struct parallel_slot_struct *slot = &ring->slots[simulated & (PARALLEL_SIM_RING_LENGTH - 1)];
+            const struct trace_record_struct *record = &slot->record;
+            hierarchy->markers = slot->markers;
+            hierarchy->markers_length = 0;
+            hierarchy->access(record->type, record->address);
+            if (record->has_value and (record->type == WRITE) and sim->data_mode)
+                hierarchy->store_value(record->address, record->value, ((record->size == 0) or (record->size > 8)) ? 8 : record->size);
+            __atomic_store_n(&ring->simulated, simulated + 1, __ATOMIC_RELEASE);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Subroutine to stop the workers and free the simulation.
+ * @sim Address of the simulation
+ * @nb_threads Number of workers whose thread is started
+ */
+static void stop_parallel_sim(struct parallel_sim_struct *sim, unsigned int nb_threads){
+    unsigned int i = 0;
+    __atomic_store_n(&sim->done, true, __ATOMIC_RELEASE);
+    for (i = 0; i < nb_threads; i++){
+        pthread_join(sim->workers[i].thread, NULL);
+    }
+    for (i = 0; i < sim->nb_workers; i++){
+        CacheHierarchy::destroy(sim->workers[i].hierarchy);
+        free(sim->workers[i].ring.slots);
+    }
+    free(sim->order);
+}
+
+/**
+ * Subroutine to create the hierarchy and the ring of each worker and start the workers.
+ * @sim Address of the simulation
+ * @nb_workers Number of workers, given by parallel_sim_workers()
+ * @partition_shift First address bit choosing the worker, given by parallel_sim_workers()
+ * @p_options Optional settings, see setup_cache() for the other parameters
+ * Returns false if out of memory or if a thread cannot be started
+ */
+bool start_parallel_sim(struct parallel_sim_struct *sim, unsigned int nb_workers, unsigned int partition_shift,
+                        uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v, uint64_t c2, uint64_t b2, uint64_t s2,
+                        const cache_options_t *p_options){
+    unsigned int i = 0;
+    sim->nb_workers = nb_workers;
+    sim->partition_shift = partition_shift;
+    sim->data_mode = (p_options->data_mode != 0);
+    sim->next_sequence = 0;
+    sim->next_printed = 0;
+    sim->done = false;
+    sim->order = (uint8_t *) malloc(nb_workers * PARALLEL_SIM_RING_LENGTH);
+    bool created = (sim->order != NULL);
+    for (i = 0; i < nb_workers; i++){
+        struct parallel_worker_struct *worker = &sim->workers[i];
+        worker->sim = sim;
+        worker->id = i;
+        worker->ring.head = 0;
+        worker->ring.printed = 0;
+        worker->ring.simulated = 0;
+        worker->ring.slots = (struct parallel_slot_struct *) malloc(PARALLEL_SIM_RING_LENGTH * sizeof(struct parallel_slot_struct));
+        worker->hierarchy = CacheHierarchy::create(c1, b1, s1, v, c2, b2, s2, p_options);
+        created = created and (worker->ring.slots != NULL) and (worker->hierarchy != NULL);
+    }
+    if (not created){
+        stop_parallel_sim(sim, 0);
+        return false;
+    }
+    for (i = 0; i < nb_workers; i++){
+        if (pthread_create(&sim->workers[i].thread, NULL, parallel_worker_thread, &sim->workers[i]) != 0){
+            stop_parallel_sim(sim, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Subroutine to print the markers of the next record in trace order, once its worker has simulated it. Its slot
+ * can then be reused.
+ * @sim Address of the simulation
+ */
+static void print_next_markers(struct parallel_sim_struct *sim){
+    unsigned int worker = sim->order[sim->next_printed & (sim->nb_workers * PARALLEL_SIM_RING_LENGTH - 1)];
+    struct parallel_ring_struct *ring = &sim->workers[worker].ring;
+    unsigned int polls = 0;
+    while (__atomic_load_n(&ring->simulated, __ATOMIC_ACQUIRE) == ring->printed){
+        parallel_sim_wait(&polls);
+    }
+    fputs(ring->slots[ring->printed & (PARALLEL_SIM_RING_LENGTH - 1)].markers, stdout);
+    ring->printed += 1;
+    sim->next_printed += 1;
+}
+
+/**
+ * Subroutine to simulate a batch of records. Each record goes to the ring of its worker. When that ring is full,
+ * the markers of the oldest records are printed (in trace order) until one of its slots is free.
+ * @sim Address of the simulation
+ * @batch Address of the batch
+ */
+void parallel_sim_batch(struct parallel_sim_struct *sim, const struct trace_batch_struct *batch){
+    unsigned int i = 0;
+    for (i = 0; i < batch->nb_records; i++){
+        unsigned int worker = (batch->records[i].address >> sim->partition_shift) & (sim->nb_workers - 1);
+        struct parallel_ring_struct *ring = &sim->workers[worker].ring;
+        while (ring->head - ring->printed == PARALLEL_SIM_RING_LENGTH){
+            print_next_markers(sim);
+        }
+        struct parallel_slot_struct *slot = &ring->slots[ring->head & (PARALLEL_SIM_RING_LENGTH - 1)];
+        slot->record = batch->records[i];
+        slot->markers[0] = '\0';
+        sim->order[sim->next_sequence & (sim->nb_workers * PARALLEL_SIM_RING_LENGTH - 1)] = worker;
+        sim->next_sequence += 1;
+        __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * Subroutine to simulate the last records, print the last markers and add the statistics of the workers. The
+ * simulation is freed.
+ * @sim Address of the simulation
+ * @p_stats Pointer to the statistics structure
+ */
+void finish_parallel_sim(struct parallel_sim_struct *sim, cache_stats_t *p_stats){
+    unsigned int i = 0;
+    unsigned int j = 0;
+    __atomic_store_n(&sim->done, true, __ATOMIC_RELEASE);
+    while (sim->next_printed != sim->next_sequence){
+        print_next_markers(sim);
+    }
+    for (i = 0; i < sim->nb_workers; i++){
+        pthread_join(sim->workers[i].thread, NULL);
+    }
+    for (i = 0; i < sim->nb_workers; i++){
+        const cache_stats_t *stats = sim->workers[i].hierarchy->finish();
+        for (j = 0; j < sizeof(parallel_sim_counters) / sizeof(parallel_sim_counters[0]); j++){
+            *(uint64_t *)((char *) p_stats + parallel_sim_counters[j]) +=
+                *(const uint64_t *)((const char *) stats + parallel_sim_counters[j]);
+        }
+        p_stats->random_seed = stats->random_seed;
+    }
+    stop_parallel_sim(sim, 0);
+}
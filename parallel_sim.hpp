@@ -0,0 +1,77 @@
+#ifndef PARALLEL_SIM_HPP
+#define PARALLEL_SIM_HPP
+
+#include <stdint.h>
+#include <pthread.h>
+#include "cachesim.hpp"
+#include "trace_pipeline.hpp"
+
+/** Maximum number of worker threads of a parallel simulation */
+#define PARALLEL_SIM_MAX_WORKERS 64
+/** Number of slots of the ring of a worker (a power of two) */
+#define PARALLEL_SIM_RING_LENGTH 4096
+/** Number of polls of an empty (or full) ring before a waiting thread sleeps between polls */
+#define PARALLEL_SIM_SPINS 256
+
+/** Slot of a ring: a record, and the markers (H1****, ...) of the record, printed in trace order */
+struct parallel_slot_struct {
+    struct trace_record_struct record;
+    char markers[ACCESS_MARKERS_LENGTH];
+};
+
+/** Lock-free single producer single consumer ring of the records of one worker. The simulation adds the records at
+head, the worker simulates them up to simulated, and the simulation prints their markers up to printed, then reuses
+their slots. Each index is written by one thread only: head (release) is read by the worker (acquire), simulated
+(release) by the simulation (acquire), and printed by the simulation only. The indexes written by the two threads
+are in different cache lines */
+struct parallel_ring_struct {
+    struct parallel_slot_struct *slots;
+    /** Written by the simulation */
+    uint64_t head;
+    uint64_t printed;
+    char padding[64];
+    /** Written by the worker */
+    uint64_t simulated;
+    char padding_end[64];
+};
+
+struct parallel_sim_struct;
+
+/** A worker simulates the records of its partition of the sets in its own hierarchy */
+struct parallel_worker_struct {
+    struct parallel_sim_struct *sim;
+    CacheHierarchy *hierarchy;
+    /** The worker simulates the records with (address >> partition_shift) & (nb_workers - 1) == id */
+    unsigned int id;
+    pthread_t thread;
+    struct parallel_ring_struct ring;
+};
+
+/** Set partitioned simulation of one configuration. The sets of l1 and l2 are independent when a range of address
+bits is in both indexes: the records with the same value of those bits only touch the sets of one worker. Each
+record goes to the ring of its worker only, and gets the next sequence number */
+struct parallel_sim_struct {
+    struct parallel_worker_struct workers[PARALLEL_SIM_MAX_WORKERS];
+    unsigned int nb_workers;
+    unsigned int partition_shift;
+    bool data_mode;
+    /** Worker of each record whose markers are not printed yet, by sequence number (nb_workers *
+    PARALLEL_SIM_RING_LENGTH entries, as many as the rings hold) */
+    uint8_t *order;
+    /** Sequence number of the next record, and of the next record whose markers are printed */
+    uint64_t next_sequence;
+    uint64_t next_printed;
+    /** Set when no record will be added any more (release, read by the workers with acquire) */
+    bool done;
+};
+
+unsigned int parallel_sim_workers(unsigned int nb_threads, uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v,
+                                  uint64_t c2, uint64_t b2, uint64_t s2, const cache_options_t *p_options,
+                                  unsigned int *partition_shift);
+bool start_parallel_sim(struct parallel_sim_struct *sim, unsigned int nb_workers, unsigned int partition_shift,
+                        uint64_t c1, uint64_t b1, uint64_t s1, uint64_t v, uint64_t c2, uint64_t b2, uint64_t s2,
+                        const cache_options_t *p_options);
+void parallel_sim_batch(struct parallel_sim_struct *sim, const struct trace_batch_struct *batch);
+void finish_parallel_sim(struct parallel_sim_struct *sim, cache_stats_t *p_stats);
+
+#endif /* PARALLEL_SIM_HPP */
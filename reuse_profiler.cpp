@@ -0,0 +1,232 @@
+#include "reuse_profiler.hpp"
+#include <stdlib.h>
+
+/** Initial number of times of the Fenwick tree, and of slots of the block table */
+static const unsigned long int REUSE_INITIAL_SIZE = 1UL << 16;
+
+/**
+ * Subroutine giving the block table slot where the search for a block starts.
+ * @profiler Address of the profiler
+ * @block_address The block address
+ */
+static inline unsigned long int reuse_slot(const struct reuse_profiler_struct *profiler, uint64_t block_address){
+    return (unsigned long int)((block_address * 0x9E3779B97F4A7C15UL) >> profiler->table_shift) & profiler->table_mask;
+}
+
+/**
+ * Subroutine to add a value at a time of the Fenwick tree.
+ * @profiler Address of the profiler
+ * @time The time, from 1 to fenwick_size
+ * @value The value added (+1 or -1)
+ */
+static inline void fenwick_add(struct reuse_profiler_struct *profiler, uint64_t time, int value){
+    for (; time <= profiler->fenwick_size; time += time & (~time + 1)){
+        profiler->fenwick[time] += value;
+    }
+}
+
+/**
+ * Subroutine giving the sum of the Fenwick tree from the time 1 to a time.
+ * @profiler Address of the profiler
+ * @time The time, from 0 to fenwick_size
+ */
+static inline uint64_t fenwick_prefix(const struct reuse_profiler_struct *profiler, uint64_t time){
+    uint64_t sum = 0;
+    for (; time > 0; time -= time & (~time + 1)){
+        sum += profiler->fenwick[time];
+    }
+    return sum;
+}
+
+/**
+ * Subroutine for initializing a profiler.
+ * @profiler Address of the profiler
+ * @block_bits Blocks are 2^block_bits bytes
+ * @window_length Working set windows are window_length accesses long (0 for no windows)
+ */
+void setup_reuse_profiler(struct reuse_profiler_struct *profiler, unsigned int block_bits, uint64_t window_length){
+    unsigned int i = 0;
+    profiler->block_bits = block_bits;
+    profiler->window_length = window_length;
+    profiler->table_shift = 64 - 16;
+    profiler->table_mask = REUSE_INITIAL_SIZE - 1;
+    profiler->blocks = (uint64_t *) calloc(REUSE_INITIAL_SIZE, sizeof(uint64_t));
+    profiler->last_access = (uint64_t *) calloc(REUSE_INITIAL_SIZE, sizeof(uint64_t));
+    profiler->last_window = (uint64_t *) calloc(REUSE_INITIAL_SIZE, sizeof(uint64_t));
+    profiler->nb_blocks = 0;
+    profiler->fenwick_size = REUSE_INITIAL_SIZE;
+    profiler->fenwick = (unsigned int *) calloc(REUSE_INITIAL_SIZE + 1, sizeof(unsigned int));
+    profiler->time = 0;
+    profiler->accesses = 0;
+    profiler->cold_accesses = 0;
+    for (i = 0; i < REUSE_DISTANCE_BUCKETS; i++){
+        profiler->histogram[i] = 0;
+    }
+    profiler->window_capacity = 64;
+    profiler->window_blocks = (uint64_t *) calloc(profiler->window_capacity, sizeof(uint64_t));
+    profiler->nb_windows = 0;
+}
+
+/**
+ * Subroutine to free a profiler.
+ * @profiler Address of the profiler
+ */
+void free_reuse_profiler(struct reuse_profiler_struct *profiler){
+    free(profiler->blocks);
+    free(profiler->last_access);
+    free(profiler->last_window);
+    free(profiler->fenwick);
+    free(profiler->window_blocks);
+    profiler->blocks = NULL;
+    profiler->last_access = NULL;
+    profiler->last_window = NULL;
+    profiler->fenwick = NULL;
+    profiler->window_blocks = NULL;
+}
+
+/**
+ * Subroutine to double the block table when it is half full. Every block is inserted again.
+ * @profiler Address of the profiler
+ */
+static void grow_block_table(struct reuse_profiler_struct *profiler){
+    unsigned long int old_size = profiler->table_mask + 1;
+    uint64_t *old_blocks = profiler->blocks;
+    uint64_t *old_last_access = profiler->last_access;
+    uint64_t *old_last_window = profiler->last_window;
+    profiler->table_mask = 2 * old_size - 1;
+    profiler->table_shift -= 1;
+    profiler->blocks = (uint64_t *) calloc(2 * old_size, sizeof(uint64_t));
+    profiler->last_access = (uint64_t *) calloc(2 * old_size, sizeof(uint64_t));
+    profiler->last_window = (uint64_t *) calloc(2 * old_size, sizeof(uint64_t));
+    unsigned long int i = 0;
+    for (i = 0; i < old_size; i++){
+        if (old_blocks[i] == 0)
+            continue;
+        unsigned long int slot = reuse_slot(profiler, old_blocks[i] - 1);
+        while (profiler->blocks[slot] != 0){
+            slot = (slot + 1) & profiler->table_mask;
+        }
+        profiler->blocks[slot] = old_blocks[i];
+        profiler->last_access[slot] = old_last_access[i];
+        profiler->last_window[slot] = old_last_window[i];
+    }
+    free(old_blocks);
+    free(old_last_access);
+    free(old_last_window);
+}
+
+/** Time of the last access of a block and its slot in the block table, sorted to renumber the times */
+struct reuse_time_struct {
+    uint64_t time;
+    unsigned long int slot;
+};
+
+/**
+ * Subroutine to compare two last accesses by time, for qsort().
+ */
+static int compare_reuse_times(const void *first, const void *second){
+    uint64_t a = ((const struct reuse_time_struct *) first)->time;
+    uint64_t b = ((const struct reuse_time_struct *) second)->time;
+    return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+/**
+ * Subroutine to renumber the times when the Fenwick tree is full. The last accesses of the blocks get the times
+ * 1 to nb_blocks, in the same order, and the tree is sized to at least twice the number of blocks, so that the
+ * renumbering cost is amortized over at least nb_blocks accesses.
+ * @profiler Address of the profiler
+ */
+static void renumber_times(struct reuse_profiler_struct *profiler){
+    unsigned long int i = 0;
+    unsigned long int j = 0;
+    struct reuse_time_struct *times = (struct reuse_time_struct *) malloc(profiler->nb_blocks * sizeof(struct reuse_time_struct));
+    for (i = 0; i <= profiler->table_mask; i++){
+        if (profiler->blocks[i] == 0)
+            continue;
+        times[j].time = profiler->last_access[i];
+        times[j].slot = i;
+        j++;
+    }
+    qsort(times, profiler->nb_blocks, sizeof(struct reuse_time_struct), compare_reuse_times);
+    for (i = 0; i < profiler->nb_blocks; i++){
+        profiler->last_access[times[i].slot] = i + 1;
+    }
+    free(times);
+
+    if (profiler->fenwick_size < 2 * profiler->nb_blocks){
+        profiler->fenwick_size = 2 * profiler->nb_blocks;
+        free(profiler->fenwick);
+        profiler->fenwick = (unsigned int *) malloc((profiler->fenwick_size + 1) * sizeof(unsigned int));
+    }
+    // Times 1 to nb_blocks are marked: node t covers the times (t - lowbit(t), t]
+    for (i = 1; i <= profiler->fenwick_size; i++){
+        unsigned long int first = i - (i & (~i + 1));
+        unsigned long int last = (i < profiler->nb_blocks) ? i : profiler->nb_blocks;
+        profiler->fenwick[i] = (last > first) ? last - first : 0;
+    }
+    profiler->time = profiler->nb_blocks;
+}
+
+/**
+ * Subroutine giving the histogram bucket of a reuse distance.
+ * @distance The reuse distance
+ */
+static inline unsigned int reuse_bucket(uint64_t distance){
+    unsigned int bucket = 0;
+    while (distance != 0){
+        distance >>= 1;
+        bucket += 1;
+    }
+    return bucket;
+}
+
+/**
+ * Subroutine to profile one trace event.
+ * @profiler Address of the profiler
+ * @address The memory address accessed
+ */
+void reuse_profile_access(struct reuse_profiler_struct *profiler, uint64_t address){
+    uint64_t block_address = address >> profiler->block_bits;
+    uint64_t window = (profiler->window_length == 0) ? 0 : profiler->accesses / profiler->window_length;
+    profiler->accesses += 1;
+    if (window >= profiler->nb_windows){
+        if (window >= profiler->window_capacity){
+            profiler->window_capacity *= 2;
+            profiler->window_blocks = (uint64_t *) realloc(profiler->window_blocks,
+                                                           profiler->window_capacity * sizeof(uint64_t));
+        }
+        profiler->window_blocks[window] = 0;
+        profiler->nb_windows = window + 1;
+    }
+    if (profiler->time == profiler->fenwick_size)
+        renumber_times(profiler);
+    profiler->time += 1;
+
+    unsigned long int slot = reuse_slot(profiler, block_address);
+    while ((profiler->blocks[slot] != 0) and (profiler->blocks[slot] != block_address + 1)){
+        slot = (slot + 1) & profiler->table_mask;
+    }
+    if (profiler->blocks[slot] != 0){
+        // Blocks accessed since the last access of this one: their last access is after it
+        uint64_t distance = profiler->nb_blocks - fenwick_prefix(profiler, profiler->last_access[slot]);
+        profiler->histogram[reuse_bucket(distance)] += 1;
+        fenwick_add(profiler, profiler->last_access[slot], -1);
+        if (profiler->last_window[slot] != window)
+            profiler->window_blocks[window] += 1;
+    } else {
+        profiler->cold_accesses += 1;
+        profiler->window_blocks[window] += 1;
+        if (2 * (profiler->nb_blocks + 1) > profiler->table_mask + 1){
+            grow_block_table(profiler);
+            slot = reuse_slot(profiler, block_address);
+            while (profiler->blocks[slot] != 0){
+                slot = (slot + 1) & profiler->table_mask;
+            }
+        }
+        profiler->blocks[slot] = block_address + 1;
+        profiler->nb_blocks += 1;
+    }
+    profiler->last_access[slot] = profiler->time;
+    profiler->last_window[slot] = window;
+    fenwick_add(profiler, profiler->time, 1);
+}
@@ -0,0 +1,47 @@
+#ifndef REUSE_PROFILER_HPP
+#define REUSE_PROFILER_HPP
+
+#include <stdint.h>
+
+/** Number of buckets of the reuse distance histogram. Bucket 0 counts the distance 0, bucket k > 0 the distances
+in [2^(k-1), 2^k) */
+#define REUSE_DISTANCE_BUCKETS 64
+
+/** Reuse distance and working set profiler, independent of any cache configuration. The reuse distance of an access
+is the number of distinct blocks accessed since the previous access to its block: a fully associative LRU cache of
+N blocks hits exactly the accesses with a distance below N. The distances are counted with a Fenwick tree that marks
+the time of the last access of each block */
+struct reuse_profiler_struct {
+    /** Blocks are 2^block_bits bytes */
+    unsigned int block_bits : 6;
+    /** Working set windows are window_length accesses long. 0 means no windows */
+    uint64_t window_length;
+    /** Block address + 1, time of the last access and window of the last access of each slot, in an open addressed
+    (linear probing) table. 0 is an empty slot */
+    uint64_t *blocks;
+    uint64_t *last_access;
+    uint64_t *last_window;
+    unsigned long int table_mask : 64;
+    unsigned int table_shift : 7;
+    /** Number of distinct blocks accessed so far */
+    unsigned long int nb_blocks : 64;
+    /** Fenwick tree over the times 1 to fenwick_size: 1 at the time of the last access of each block */
+    unsigned int *fenwick;
+    unsigned long int fenwick_size : 64;
+    /** Time of the last access. The times are renumbered when the tree is full */
+    uint64_t time;
+    /** Results */
+    uint64_t accesses;
+    uint64_t cold_accesses;
+    uint64_t histogram[REUSE_DISTANCE_BUCKETS];
+    /** Number of distinct blocks of each window so far */
+    uint64_t *window_blocks;
+    unsigned long int nb_windows : 64;
+    unsigned long int window_capacity : 64;
+};
+
+void setup_reuse_profiler(struct reuse_profiler_struct *profiler, unsigned int block_bits, uint64_t window_length);
+void free_reuse_profiler(struct reuse_profiler_struct *profiler);
+void reuse_profile_access(struct reuse_profiler_struct *profiler, uint64_t address);
+
+#endif /* REUSE_PROFILER_HPP */
@@ -0,0 +1,255 @@
+#include "simpoint.hpp"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** Maximum number of k-means iterations */
+static const unsigned int SIMPOINT_MAX_ITERATIONS = 100;
+
+/**
+ * Subroutine for initializing an interval profile.
+ * @profile Address of the profile
+ * @interval_length Intervals are interval_length trace events long
+ */
+void setup_simpoint_profile(struct simpoint_profile_struct *profile, uint64_t interval_length){
+    profile->interval_length = interval_length;
+    profile->nb_events = 0;
+    profile->nb_intervals = 0;
+    profile->capacity = 64;
+    profile->vectors = (double *) calloc(profile->capacity * SIMPOINT_DIMENSIONS, sizeof(double));
+    profile->interval_events = (uint64_t *) calloc(profile->capacity, sizeof(uint64_t));
+}
+
+/**
+ * Subroutine to free an interval profile.
+ * @profile Address of the profile
+ */
+void free_simpoint_profile(struct simpoint_profile_struct *profile){
+    free(profile->vectors);
+    free(profile->interval_events);
+    profile->vectors = NULL;
+    profile->interval_events = NULL;
+}
+
+/**
+ * Subroutine to count one trace event in the vector of its interval.
+ * @profile Address of the profile
+ * @key Address region or PC of the event
+ */
+void simpoint_profile_event(struct simpoint_profile_struct *profile, uint64_t key){
+    uint64_t interval = profile->nb_events / profile->interval_length;
+    if (interval == profile->nb_intervals){
+        if (profile->nb_intervals == profile->capacity){
+            profile->capacity *= 2;
+            profile->vectors = (double *) realloc(profile->vectors, profile->capacity * SIMPOINT_DIMENSIONS * sizeof(double));
+            profile->interval_events = (uint64_t *) realloc(profile->interval_events, profile->capacity * sizeof(uint64_t));
+        }
+        memset(&profile->vectors[interval * SIMPOINT_DIMENSIONS], 0, SIMPOINT_DIMENSIONS * sizeof(double));
+        profile->interval_events[interval] = 0;
+        profile->nb_intervals += 1;
+    }
+    // Multiplicative hash of the key: its top bits give the dimension
+    unsigned int dimension = (unsigned int)((key * 0x9E3779B97F4A7C15UL) >> 58);
+    profile->vectors[interval * SIMPOINT_DIMENSIONS + dimension] += 1.0;
+    profile->interval_events[interval] += 1;
+    profile->nb_events += 1;
+}
+
+/**
+ * Subroutine giving the squared euclidean distance between two vectors.
+ * @a First vector (SIMPOINT_DIMENSIONS values)
+ * @b Second vector (SIMPOINT_DIMENSIONS values)
+ */
+static inline double simpoint_distance(const double *a, const double *b){
+    double distance = 0.0;
+    unsigned int i = 0;
+    for (i = 0; i < SIMPOINT_DIMENSIONS; i++){
+        distance += (a[i] - b[i]) * (a[i] - b[i]);
+    }
+    return distance;
+}
+
+/**
+ * Subroutine giving a pseudo random number in [0, 1) (xorshift64*). The k-means seeding uses a fixed seed, so
+ * that the same trace always gives the same simulation points.
+ * @state Address of the generator state (non zero)
+ */
+static inline double simpoint_random(uint64_t *state){
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return (double)((*state * 0x2545F4914F6CDD1DUL) >> 11) / (double)(1UL << 53);
+}
+
+/**
+ * Subroutine to cluster the intervals with k-means (k-means++ seeding) and choose one simulation point per
+ * cluster: the interval closest to the centroid of the cluster.
+ * @profile Address of the profile
+ * @k Number of clusters
+ * @simpoints Array of at least k simulation points, filled with the result in trace order
+ * Returns the number of simulation points (less than k if there are fewer distinct intervals)
+ */
+unsigned int choose_simpoints(const struct simpoint_profile_struct *profile, unsigned int k,
+                              struct simpoint_struct *simpoints){
+    unsigned long int n = profile->nb_intervals;
+    unsigned long int i = 0;
+    unsigned int c = 0;
+    unsigned int d = 0;
+    if ((n == 0) or (k == 0))
+        return 0;
+    if (k > n)
+        k = n;
+
+    // Each vector is normalized by the number of events of its interval
+    double *points = (double *) malloc(n * SIMPOINT_DIMENSIONS * sizeof(double));
+    for (i = 0; i < n; i++){
+        for (d = 0; d < SIMPOINT_DIMENSIONS; d++){
+            points[i * SIMPOINT_DIMENSIONS + d] = profile->vectors[i * SIMPOINT_DIMENSIONS + d] / profile->interval_events[i];
+        }
+    }
+    double *centroids = (double *) calloc(k * SIMPOINT_DIMENSIONS, sizeof(double));
+    double *distances = (double *) malloc(n * sizeof(double));
+    unsigned int *clusters = (unsigned int *) calloc(n, sizeof(unsigned int));
+    unsigned long int *members = (unsigned long int *) calloc(k, sizeof(unsigned long int));
+
+    // k-means++ seeding: each new centroid is an interval drawn with a probability proportional to its squared
+    // distance to the closest centroid so far
+    uint64_t state = 0x9E3779B97F4A7C15UL;
+    unsigned long int chosen = (unsigned long int)(simpoint_random(&state) * n);
+    memcpy(centroids, &points[chosen * SIMPOINT_DIMENSIONS], SIMPOINT_DIMENSIONS * sizeof(double));
+    for (i = 0; i < n; i++){
+        distances[i] = simpoint_distance(&points[i * SIMPOINT_DIMENSIONS], centroids);
+    }
+    unsigned int nb_clusters = 1;
+    while (nb_clusters < k){
+        double total = 0.0;
+        for (i = 0; i < n; i++){
+            total += distances[i];
+        }
+        if (total == 0.0)
+            break;
+        double target = simpoint_random(&state) * total;
+        for (chosen = 0; chosen < n - 1; chosen++){
+            target -= distances[chosen];
+            if (target < 0.0)
+                break;
+        }
+        double *centroid = &centroids[nb_clusters * SIMPOINT_DIMENSIONS];
+        memcpy(centroid, &points[chosen * SIMPOINT_DIMENSIONS], SIMPOINT_DIMENSIONS * sizeof(double));
+        for (i = 0; i < n; i++){
+            double distance = simpoint_distance(&points[i * SIMPOINT_DIMENSIONS], centroid);
+            if (distance < distances[i])
+                distances[i] = distance;
+        }
+        nb_clusters += 1;
+    }
+
+    // Lloyd iterations
+    unsigned int iteration = 0;
+    for (iteration = 0; iteration < SIMPOINT_MAX_ITERATIONS; iteration++){
+        bool changed = false;
+        for (i = 0; i < n; i++){
+            unsigned int closest = 0;
+            double closest_distance = simpoint_distance(&points[i * SIMPOINT_DIMENSIONS], centroids);
+            for (c = 1; c < nb_clusters; c++){
+                double distance = simpoint_distance(&points[i * SIMPOINT_DIMENSIONS], &centroids[c * SIMPOINT_DIMENSIONS]);
+                if (distance < closest_distance){
+                    closest = c;
+                    closest_distance = distance;
+                }
+            }
+            changed = changed or (clusters[i] != closest) or (iteration == 0);
+            clusters[i] = closest;
+            distances[i] = closest_distance;
+        }
+        if (not changed)
+            break;
+        // A cluster left empty keeps its centroid
+        memset(members, 0, nb_clusters * sizeof(unsigned long int));
+        for (i = 0; i < n; i++){
+            if (members[clusters[i]] == 0)
+                memset(&centroids[clusters[i] * SIMPOINT_DIMENSIONS], 0, SIMPOINT_DIMENSIONS * sizeof(double));
+            members[clusters[i]] += 1;
+            for (d = 0; d < SIMPOINT_DIMENSIONS; d++){
+                centroids[clusters[i] * SIMPOINT_DIMENSIONS + d] += points[i * SIMPOINT_DIMENSIONS + d];
+            }
+        }
+        for (c = 0; c < nb_clusters; c++){
+            for (d = 0; (members[c] != 0) and (d < SIMPOINT_DIMENSIONS); d++){
+                centroids[c * SIMPOINT_DIMENSIONS + d] /= members[c];
+            }
+        }
+    }
+
+    // One simulation point per non empty cluster, weighted by the events of the cluster
+    unsigned int nb_simpoints = 0;
+    for (c = 0; c < nb_clusters; c++){
+        bool found = false;
+        double best_distance = 0.0;
+        struct simpoint_struct simpoint = {0, 0};
+        for (i = 0; i < n; i++){
+            if (clusters[i] != c)
+                continue;
+            simpoint.cluster_events += profile->interval_events[i];
+            if ((not found) or (distances[i] < best_distance)){
+                found = true;
+                best_distance = distances[i];
+                simpoint.interval = i;
+            }
+        }
+        if (not found)
+            continue;
+        // Insertion in trace order
+        unsigned int position = nb_simpoints;
+        while ((position > 0) and (simpoints[position - 1].interval > simpoint.interval)){
+            simpoints[position] = simpoints[position - 1];
+            position -= 1;
+        }
+        simpoints[position] = simpoint;
+        nb_simpoints += 1;
+    }
+
+    free(points);
+    free(centroids);
+    free(distances);
+    free(clusters);
+    free(members);
+    return nb_simpoints;
+}
+
+/** Event counters of cache_stats_t extrapolated from the simulation points */
+static const size_t simpoint_counters[] = {
+    offsetof(cache_stats_t, accesses), offsetof(cache_stats_t, accesses_l2), offsetof(cache_stats_t, accesses_vc),
+    offsetof(cache_stats_t, reads), offsetof(cache_stats_t, read_misses_l1), offsetof(cache_stats_t, read_misses_l2),
+    offsetof(cache_stats_t, writes), offsetof(cache_stats_t, write_misses_l1), offsetof(cache_stats_t, write_misses_l2),
+    offsetof(cache_stats_t, write_back_l1), offsetof(cache_stats_t, write_back_l2), offsetof(cache_stats_t, victim_hits),
+    offsetof(cache_stats_t, sector_misses_l1), offsetof(cache_stats_t, sector_misses_l2),
+    offsetof(cache_stats_t, bytes_filled_l1), offsetof(cache_stats_t, bytes_filled_l2),
+    offsetof(cache_stats_t, bytes_written_back_l1), offsetof(cache_stats_t, bytes_written_back_l2),
+    offsetof(cache_stats_t, silent_stores), offsetof(cache_stats_t, compression_evictions_l2),
+    offsetof(cache_stats_t, dtlb_misses), offsetof(cache_stats_t, page_walks),
+    offsetof(cache_stats_t, vipt_index_mismatches),
+    offsetof(cache_stats_t, compulsory_misses_l1), offsetof(cache_stats_t, capacity_misses_l1),
+    offsetof(cache_stats_t, conflict_misses_l1), offsetof(cache_stats_t, compulsory_misses_l2),
+    offsetof(cache_stats_t, capacity_misses_l2), offsetof(cache_stats_t, conflict_misses_l2),
+    offsetof(cache_stats_t, miss_trace_records), offsetof(cache_stats_t, split_accesses),
+    offsetof(cache_stats_t, fetches), offsetof(cache_stats_t, fetch_misses_l1i), offsetof(cache_stats_t, fetch_misses_l2),
+    offsetof(cache_stats_t, truncated_tag_accesses),
+};
+
+/**
+ * Subroutine to add the events of a simulation point, scaled to its cluster, to the estimate of the whole trace.
+ * @estimate Statistics estimated for the whole trace
+ * @start Statistics at the start of the simulation point (after its warm up)
+ * @end Statistics at the end of the simulation point
+ * @scale Events of the cluster divided by the events of the simulation point
+ */
+void add_simpoint_statistics(cache_stats_t *estimate, const cache_stats_t *start, const cache_stats_t *end,
+                             double scale){
+    unsigned int i = 0;
+    for (i = 0; i < sizeof(simpoint_counters) / sizeof(simpoint_counters[0]); i++){
+        uint64_t delta = *(const uint64_t *)((const char *) end + simpoint_counters[i])
+                         - *(const uint64_t *)((const char *) start + simpoint_counters[i]);
+        *(uint64_t *)((char *) estimate + simpoint_counters[i]) += (uint64_t)(delta * scale + 0.5);
+    }
+}
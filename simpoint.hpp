@@ -0,0 +1,39 @@
+#ifndef SIMPOINT_HPP
+#define SIMPOINT_HPP
+
+#include <stdint.h>
+#include "cachesim_api.h"
+
+/** Size of the interval vectors. The keys (address regions or PCs) are hashed to that many dimensions */
+#define SIMPOINT_DIMENSIONS 64
+
+/** A representative interval (simulation point) */
+struct simpoint_struct {
+    /** Number of the interval in the trace */
+    uint64_t interval;
+    /** Trace events of all the intervals of its cluster */
+    uint64_t cluster_events;
+};
+
+/** Interval vectors of a trace: for each interval, the fraction of its events that fall in each dimension */
+struct simpoint_profile_struct {
+    /** Intervals are interval_length trace events long (the last one may be shorter) */
+    uint64_t interval_length;
+    uint64_t nb_events;
+    unsigned long int nb_intervals : 64;
+    unsigned long int capacity : 64;
+    /** SIMPOINT_DIMENSIONS values per interval */
+    double *vectors;
+    /** Number of events of each interval */
+    uint64_t *interval_events;
+};
+
+void setup_simpoint_profile(struct simpoint_profile_struct *profile, uint64_t interval_length);
+void free_simpoint_profile(struct simpoint_profile_struct *profile);
+void simpoint_profile_event(struct simpoint_profile_struct *profile, uint64_t key);
+unsigned int choose_simpoints(const struct simpoint_profile_struct *profile, unsigned int k,
+                              struct simpoint_struct *simpoints);
+void add_simpoint_statistics(cache_stats_t *estimate, const cache_stats_t *start, const cache_stats_t *end,
+                             double scale);
+
+#endif /* SIMPOINT_HPP */
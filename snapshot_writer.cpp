@@ -0,0 +1,161 @@
+#include "snapshot_writer.hpp"
+#include <stddef.h>
+#include <string.h>
+#include <inttypes.h>
+
+/** A CSV column: a counter of cache_stats_t, written as its delta over the interval */
+struct snapshot_column_struct {
+    const char *name;
+    size_t offset;
+};
+
+static const struct snapshot_column_struct snapshot_columns[] = {
+    {"accesses", offsetof(cache_stats_t, accesses)},
+    {"reads", offsetof(cache_stats_t, reads)},
+    {"writes", offsetof(cache_stats_t, writes)},
+    {"read_misses_l1", offsetof(cache_stats_t, read_misses_l1)},
+    {"write_misses_l1", offsetof(cache_stats_t, write_misses_l1)},
+    {"accesses_vc", offsetof(cache_stats_t, accesses_vc)},
+    {"victim_hits", offsetof(cache_stats_t, victim_hits)},
+    {"accesses_l2", offsetof(cache_stats_t, accesses_l2)},
+    {"read_misses_l2", offsetof(cache_stats_t, read_misses_l2)},
+    {"write_misses_l2", offsetof(cache_stats_t, write_misses_l2)},
+    {"write_back_l1", offsetof(cache_stats_t, write_back_l1)},
+    {"write_back_l2", offsetof(cache_stats_t, write_back_l2)},
+    {"bytes_filled_l1", offsetof(cache_stats_t, bytes_filled_l1)},
+    {"bytes_filled_l2", offsetof(cache_stats_t, bytes_filled_l2)},
+    {"bytes_written_back_l1", offsetof(cache_stats_t, bytes_written_back_l1)},
+    {"bytes_written_back_l2", offsetof(cache_stats_t, bytes_written_back_l2)},
+    {"dtlb_misses", offsetof(cache_stats_t, dtlb_misses)},
+    {"page_walks", offsetof(cache_stats_t, page_walks)},
+    {"compulsory_misses_l1", offsetof(cache_stats_t, compulsory_misses_l1)},
+    {"capacity_misses_l1", offsetof(cache_stats_t, capacity_misses_l1)},
+    {"conflict_misses_l1", offsetof(cache_stats_t, conflict_misses_l1)},
+    {"compulsory_misses_l2", offsetof(cache_stats_t, compulsory_misses_l2)},
+    {"capacity_misses_l2", offsetof(cache_stats_t, capacity_misses_l2)},
+    {"conflict_misses_l2", offsetof(cache_stats_t, conflict_misses_l2)},
+    {"fetches", offsetof(cache_stats_t, fetches)},
+    {"fetch_misses_l1i", offsetof(cache_stats_t, fetch_misses_l1i)},
+    {"fetch_misses_l2", offsetof(cache_stats_t, fetch_misses_l2)},
+};
+static const unsigned int NB_SNAPSHOT_COLUMNS = sizeof(snapshot_columns) / sizeof(snapshot_columns[0]);
+
+/**
+ * Subroutine giving a counter of a statistics structure.
+ * @p_stats Pointer to the statistics structure
+ * @column The column of the counter
+ */
+static inline uint64_t snapshot_counter(const cache_stats_t *p_stats, unsigned int column){
+    return *(const uint64_t *)((const char *) p_stats + snapshot_columns[column].offset);
+}
+
+/**
+ * Subroutine to write the CSV line of an interval.
+ * @writer Address of the writer
+ * @events Number of trace events at the end of the interval
+ * @p_stats Statistics at the end of the interval
+ */
+static void write_snapshot(struct snapshot_writer_struct *writer, uint64_t events, const cache_stats_t *p_stats){
+    unsigned int i = 0;
+    fprintf(writer->csv, "%" PRIu64, events);
+    for (i = 0; i < NB_SNAPSHOT_COLUMNS; i++){
+        fprintf(writer->csv, ",%" PRIu64, snapshot_counter(p_stats, i) - snapshot_counter(&writer->previous, i));
+    }
+    uint64_t accesses = p_stats->accesses - writer->previous.accesses;
+    uint64_t misses_l1 = p_stats->read_misses_l1 + p_stats->write_misses_l1
+                         - writer->previous.read_misses_l1 - writer->previous.write_misses_l1;
+    fprintf(writer->csv, ",%f\n", (accesses == 0) ? 0.0 : (double) misses_l1 / accesses);
+    writer->previous = *p_stats;
+}
+
+/**
+ * Writer thread: writes the queued snapshots until the writer is finished.
+ * @argument Address of the writer
+ */
+static void *snapshot_writer_thread(void *argument){
+    struct snapshot_writer_struct *writer = (struct snapshot_writer_struct *) argument;
+    pthread_mutex_lock(&writer->lock);
+    while (true){
+        while ((writer->nb_queued == 0) and (not writer->done)){
+            pthread_cond_wait(&writer->queued, &writer->lock);
+        }
+        if (writer->nb_queued == 0)
+            break;
+        unsigned int slot = writer->head;
+        // The slot is not reused until nb_queued goes down, so it is written without the lock
+        pthread_mutex_unlock(&writer->lock);
+        write_snapshot(writer, writer->events[slot], &writer->stats[slot]);
+        pthread_mutex_lock(&writer->lock);
+        writer->head = (writer->head + 1) % SNAPSHOT_QUEUE_LENGTH;
+        writer->nb_queued -= 1;
+        pthread_cond_signal(&writer->written);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+/**
+ * Subroutine to open the CSV file, write its header and start the writer thread.
+ * @writer Address of the writer
+ * @file_name Name of the CSV file
+ * Returns false if the file cannot be opened or the thread cannot be started
+ */
+bool setup_snapshot_writer(struct snapshot_writer_struct *writer, const char *file_name){
+    unsigned int i = 0;
+    writer->csv = fopen(file_name, "w");
+    if (writer->csv == NULL)
+        return false;
+    fprintf(writer->csv, "events");
+    for (i = 0; i < NB_SNAPSHOT_COLUMNS; i++){
+        fprintf(writer->csv, ",%s", snapshot_columns[i].name);
+    }
+    fprintf(writer->csv, ",miss_rate_l1\n");
+    memset(&writer->previous, 0, sizeof(cache_stats_t));
+    writer->head = 0;
+    writer->nb_queued = 0;
+    writer->done = false;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->queued, NULL);
+    pthread_cond_init(&writer->written, NULL);
+    if (pthread_create(&writer->thread, NULL, snapshot_writer_thread, writer) != 0){
+        fclose(writer->csv);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Subroutine to queue the statistics at the end of an interval. Waits only if the writer thread is
+ * SNAPSHOT_QUEUE_LENGTH intervals late.
+ * @writer Address of the writer
+ * @events Number of trace events so far
+ * @p_stats Pointer to the statistics structure
+ */
+void queue_snapshot(struct snapshot_writer_struct *writer, uint64_t events, const cache_stats_t *p_stats){
+    pthread_mutex_lock(&writer->lock);
+    while (writer->nb_queued == SNAPSHOT_QUEUE_LENGTH){
+        pthread_cond_wait(&writer->written, &writer->lock);
+    }
+    unsigned int slot = (writer->head + writer->nb_queued) % SNAPSHOT_QUEUE_LENGTH;
+    writer->events[slot] = events;
+    writer->stats[slot] = *p_stats;
+    writer->nb_queued += 1;
+    pthread_cond_signal(&writer->queued);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/**
+ * Subroutine to wait until every queued snapshot is written, then stop the writer thread and close the file.
+ * @writer Address of the writer
+ */
+void finish_snapshot_writer(struct snapshot_writer_struct *writer){
+    pthread_mutex_lock(&writer->lock);
+    writer->done = true;
+    pthread_cond_signal(&writer->queued);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->queued);
+    pthread_cond_destroy(&writer->written);
+    fclose(writer->csv);
+}
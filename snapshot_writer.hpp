@@ -0,0 +1,35 @@
+#ifndef SNAPSHOT_WRITER_HPP
+#define SNAPSHOT_WRITER_HPP
+
+#include <stdio.h>
+#include <pthread.h>
+#include "cachesim_api.h"
+
+/** Number of snapshots waiting to be written before the simulation waits for the writer thread */
+#define SNAPSHOT_QUEUE_LENGTH 64
+
+/** Interval statistics: the simulation queues a copy of the statistics at the end of each interval, and a writer
+thread turns the copies into one CSV line of deltas per interval, so that the simulation never formats anything */
+struct snapshot_writer_struct {
+    FILE *csv;
+    /** Totals of the last interval written (writer thread only) */
+    cache_stats_t previous;
+    /** Queued snapshots: number of trace events at the end of the interval, and statistics at that point */
+    uint64_t events[SNAPSHOT_QUEUE_LENGTH];
+    cache_stats_t stats[SNAPSHOT_QUEUE_LENGTH];
+    /** Next snapshot to write and number of queued snapshots */
+    unsigned int head;
+    unsigned int nb_queued;
+    /** Set when no snapshot will be queued any more */
+    bool done;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t written;
+    pthread_t thread;
+};
+
+bool setup_snapshot_writer(struct snapshot_writer_struct *writer, const char *file_name);
+void queue_snapshot(struct snapshot_writer_struct *writer, uint64_t events, const cache_stats_t *p_stats);
+void finish_snapshot_writer(struct snapshot_writer_struct *writer);
+
+#endif /* SNAPSHOT_WRITER_HPP */
@@ -0,0 +1,247 @@
+#include "trace_pipeline.hpp"
+
+/**
+ * Subroutine for initializing a pipeline that reads one trace and keeps every event unchanged.
+ * @pipeline Address of the pipeline
+ * @trace The first trace
+ * @with_pc Set when the traces have a PC column
+ */
+void setup_trace_pipeline(struct trace_pipeline_struct *pipeline, FILE *trace, bool with_pc){
+    pipeline->nb_sources = 0;
+    pipeline->interleave = INTERLEAVE_ROUND_ROBIN;
+    pipeline->with_size = false;
+    pipeline->with_pc = with_pc;
+    pipeline->binary = false;
+    pipeline->slice_first_event = 0;
+    pipeline->slice_last_event = 0;
+    pipeline->sample_period = 0;
+    pipeline->type_filter = 0;
+    pipeline->address_mask = ~(uint64_t) 0;
+    pipeline->address_offset = 0;
+    pipeline->collapse_runs = false;
+    pipeline->run_block_bits = 0;
+    add_trace_source(pipeline, trace, 1);
+    rewind_trace_pipeline(pipeline);
+}
+
+/**
+ * Subroutine to add a trace to interleave with the others.
+ * @pipeline Address of the pipeline
+ * @trace The trace
+ * @period Time units between two events of the trace (INTERLEAVE_TIME only)
+ * Returns false if there are already TRACE_PIPELINE_MAX_SOURCES traces
+ */
+bool add_trace_source(struct trace_pipeline_struct *pipeline, FILE *trace, uint64_t period){
+    if (pipeline->nb_sources == TRACE_PIPELINE_MAX_SOURCES)
+        return false;
+    struct trace_source_struct *source = &pipeline->sources[pipeline->nb_sources];
+    source->trace = trace;
+    source->period = (period == 0) ? 1 : period;
+    source->next_time = 0;
+    source->finished = false;
+    pipeline->nb_sources += 1;
+    return true;
+}
+
+/**
+ * Subroutine to go back to the start of the traces, so that the same stream can be read again.
+ * @pipeline Address of the pipeline
+ * Returns false if a trace cannot be rewound (pipe)
+ */
+bool rewind_trace_pipeline(struct trace_pipeline_struct *pipeline){
+    bool rewound = true;
+    unsigned int i = 0;
+    for (i = 0; i < pipeline->nb_sources; i++){
+        rewound = (fseek(pipeline->sources[i].trace, 0, SEEK_SET) == 0) and rewound;
+        pipeline->sources[i].next_time = 0;
+        pipeline->sources[i].finished = false;
+    }
+    pipeline->headers_read = false;
+    pipeline->next_source = 0;
+    pipeline->nb_events = 0;
+    pipeline->nb_sliced_events = 0;
+    pipeline->nb_collapsed_events = 0;
+    pipeline->finished = false;
+    return rewound;
+}
+
+/**
+ * Subroutine choosing the trace of the next event, according to the interleaving policy.
+ * @pipeline Address of the pipeline
+ * Returns NULL when every trace is finished
+ */
+static struct trace_source_struct *next_trace_source(struct trace_pipeline_struct *pipeline){
+    struct trace_source_struct *chosen = NULL;
+    unsigned int i = 0;
+    if (pipeline->interleave == INTERLEAVE_TIME){
+        for (i = 0; i < pipeline->nb_sources; i++){
+            if ((not pipeline->sources[i].finished) and ((chosen == NULL) or (pipeline->sources[i].next_time < chosen->next_time)))
+                chosen = &pipeline->sources[i];
+        }
+        if (chosen != NULL)
+            chosen->next_time += chosen->period;
+        return chosen;
+    }
+    for (i = 0; i < pipeline->nb_sources; i++){
+        struct trace_source_struct *source = &pipeline->sources[(pipeline->next_source + i) % pipeline->nb_sources];
+        if (not source->finished){
+            pipeline->next_source = (pipeline->next_source + i + 1) % pipeline->nb_sources;
+            return source;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Source stage: reads the interleaved traces directly in the batch, and stops at the end of the slice.
+ * @pipeline Address of the pipeline
+ * @batch Address of the batch
+ */
+static void fill_batch(struct trace_pipeline_struct *pipeline, struct trace_batch_struct *batch){
+    unsigned int length = TRACE_BATCH_LENGTH;
+    batch->nb_records = 0;
+    batch->first_event = pipeline->nb_events;
+    if ((pipeline->slice_last_event != 0) and (pipeline->nb_events + length > pipeline->slice_last_event))
+        length = (pipeline->slice_last_event > pipeline->nb_events) ? pipeline->slice_last_event - pipeline->nb_events : 0;
+    while (batch->nb_records < length){
+        struct trace_source_struct *source = next_trace_source(pipeline);
+        if (source == NULL)
+            break;
+        struct trace_record_struct *record = &batch->records[batch->nb_records];
+        bool read = pipeline->binary ? read_miss_trace_record(source->trace, record)
+                                     : read_trace_record(source->trace, pipeline->with_size, pipeline->with_pc, record);
+        if (read)
+            batch->nb_records += 1;
+        else
+            source->finished = true;
+    }
+    pipeline->nb_events += batch->nb_records;
+    if (batch->nb_records < TRACE_BATCH_LENGTH)
+        pipeline->finished = true;
+}
+
+/**
+ * Slice and sampling stage: drops the events before the slice, then keeps one event out of sample_period.
+ * @pipeline Address of the pipeline
+ * @batch Address of the batch
+ */
+static void slice_and_sample_batch(struct trace_pipeline_struct *pipeline, struct trace_batch_struct *batch){
+    unsigned int i = 0;
+    unsigned int kept = 0;
+    if ((batch->first_event >= pipeline->slice_first_event) and (pipeline->sample_period <= 1)){
+        pipeline->nb_sliced_events += batch->nb_records;
+        return;
+    }
+    for (i = 0; i < batch->nb_records; i++){
+        if (batch->first_event + i < pipeline->slice_first_event)
+            continue;
+        pipeline->nb_sliced_events += 1;
+        if ((pipeline->sample_period > 1) and ((pipeline->nb_sliced_events - 1) % pipeline->sample_period != 0))
+            continue;
+        if (kept != i)
+            batch->records[kept] = batch->records[i];
+        kept += 1;
+    }
+    batch->nb_records = kept;
+}
+
+/**
+ * Type filter stage: keeps only the reads or only the writes.
+ * @pipeline Address of the pipeline
+ * @batch Address of the batch
+ */
+static void filter_batch(const struct trace_pipeline_struct *pipeline, struct trace_batch_struct *batch){
+    unsigned int i = 0;
+    unsigned int kept = 0;
+    if (pipeline->type_filter == 0)
+        return;
+    for (i = 0; i < batch->nb_records; i++){
+        if (batch->records[i].type != pipeline->type_filter)
+            continue;
+        if (kept != i)
+            batch->records[kept] = batch->records[i];
+        kept += 1;
+    }
+    batch->nb_records = kept;
+}
+
+/**
+ * Remapping stage: masks the addresses, then relocates them.
+ * @pipeline Address of the pipeline
+ * @batch Address of the batch
+ */
+static void remap_batch(const struct trace_pipeline_struct *pipeline, struct trace_batch_struct *batch){
+    unsigned int i = 0;
+    if ((pipeline->address_mask == ~(uint64_t) 0) and (pipeline->address_offset == 0))
+        return;
+    for (i = 0; i < batch->nb_records; i++){
+        batch->records[i].address = (batch->records[i].address & pipeline->address_mask) + pipeline->address_offset;
+    }
+}
+
+/**
+ * Subroutine telling whether an event can be folded into the run of another one.
+ * @pipeline Address of the pipeline
+ * @head The first event of the run
+ * @record The event
+ */
+static inline bool same_run(const struct trace_pipeline_struct *pipeline, const struct trace_record_struct *head,
+                            const struct trace_record_struct *record){
+    return ((head->address ^ record->address) >> pipeline->run_block_bits == 0) and
+           ((record->type == 'r') or (record->type == 'w')) and (record->size <= 1) and (not record->has_value) and
+           ((head->type == 'r') or (head->type == 'w')) and (head->size <= 1);
+}
+
+/**
+ * Run length collapsing stage: folds the runs of reads and writes to the same block into their first event.
+ * Runs do not cross batches.
+ * @pipeline Address of the pipeline
+ * @batch Address of the batch
+ */
+static void collapse_batch(struct trace_pipeline_struct *pipeline, struct trace_batch_struct *batch){
+    unsigned int i = 0;
+    unsigned int kept = 0;
+    if (not pipeline->collapse_runs)
+        return;
+    for (i = 0; i < batch->nb_records; i++){
+        if ((kept != 0) and same_run(pipeline, &batch->records[kept - 1], &batch->records[i])){
+            if (batch->records[i].type == 'w')
+                batch->records[kept - 1].run_writes += 1;
+            else
+                batch->records[kept - 1].run_reads += 1;
+            continue;
+        }
+        if (kept != i)
+            batch->records[kept] = batch->records[i];
+        kept += 1;
+    }
+    pipeline->nb_collapsed_events += batch->nb_records - kept;
+    batch->nb_records = kept;
+}
+
+/**
+ * Subroutine to read the next batch of events through every stage of the pipeline. The records are read in the
+ * batch, and the stages only move the kept records down in it.
+ * @pipeline Address of the pipeline
+ * @batch Address of the batch, filled with at least one record
+ * Returns false at the end of the stream
+ */
+bool read_trace_batch(struct trace_pipeline_struct *pipeline, struct trace_batch_struct *batch){
+    unsigned int i = 0;
+    batch->nb_records = 0;
+    if (pipeline->binary and (not pipeline->headers_read)){
+        // A trace that is not a miss trace is finished from the start
+        for (i = 0; i < pipeline->nb_sources; i++){
+            pipeline->sources[i].finished = not read_miss_trace_header(pipeline->sources[i].trace);
+        }
+        pipeline->headers_read = true;
+    }
+    while ((batch->nb_records == 0) and (not pipeline->finished)){
+        fill_batch(pipeline, batch);
+        slice_and_sample_batch(pipeline, batch);
+        filter_batch(pipeline, batch);
+        remap_batch(pipeline, batch);
+        collapse_batch(pipeline, batch);
+    }
+    return batch->nb_records != 0;
+}
@@ -0,0 +1,82 @@
+#ifndef TRACE_PIPELINE_HPP
+#define TRACE_PIPELINE_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include "trace_reader.hpp"
+
+/** Number of records of a batch */
+#define TRACE_BATCH_LENGTH 1024
+/** Maximum number of interleaved traces */
+#define TRACE_PIPELINE_MAX_SOURCES 16
+
+/** Interleaving policy of several traces */
+enum trace_interleave_t {
+    /** One event of each trace in turn */
+    INTERLEAVE_ROUND_ROBIN = 0,
+    /** Each trace issues one event every period time units (see trace_source_struct). The event with the smallest
+    time goes first, the first trace first on a tie */
+    INTERLEAVE_TIME = 1
+};
+
+/** Records read from the traces. The stages of the pipeline work on it in place */
+struct trace_batch_struct {
+    struct trace_record_struct records[TRACE_BATCH_LENGTH];
+    unsigned int nb_records;
+    /** Number of the first record in the interleaved stream, before any stage */
+    uint64_t first_event;
+};
+
+/** A trace read by the pipeline */
+struct trace_source_struct {
+    FILE *trace;
+    /** Time units between two events of the trace (INTERLEAVE_TIME only) */
+    uint64_t period;
+    /** Time of the next event of the trace */
+    uint64_t next_time;
+    bool finished;
+};
+
+/** Streaming stages between the trace reader and the simulator, applied in this order to each batch:
+the traces are interleaved, then the stream is sliced, sampled, filtered by type, its addresses remapped and its
+runs collapsed */
+struct trace_pipeline_struct {
+    struct trace_source_struct sources[TRACE_PIPELINE_MAX_SOURCES];
+    unsigned int nb_sources;
+    /** Interleaving policy (trace_interleave_t) and next trace in round robin order */
+    unsigned int interleave;
+    unsigned int next_source;
+    /** Set when the traces have a size column, and when they have a PC column */
+    bool with_size;
+    bool with_pc;
+    /** Set when the traces are binary miss traces (miss_trace.hpp), and once their headers are read */
+    bool binary;
+    bool headers_read;
+    /** Slice: events first_event to last_event - 1 of the interleaved stream. last_event = 0 means no end */
+    uint64_t slice_first_event;
+    uint64_t slice_last_event;
+    /** Sampling: one event out of sample_period in the slice. 0 or 1 keeps every event */
+    uint64_t sample_period;
+    /** Type filter: only the events of this type (READ or WRITE) are kept. 0 keeps every event */
+    char type_filter;
+    /** Address remapping: address = (address & address_mask) + address_offset */
+    uint64_t address_mask;
+    uint64_t address_offset;
+    /** Run length collapsing: the reads and writes following an event in the same 2^run_block_bits byte block are
+    folded into it (trace_record_struct::run_reads and run_writes). Sized events, fetches and events with a store
+    value are never folded */
+    bool collapse_runs;
+    unsigned int run_block_bits;
+    /** Events read so far from the traces, events of the slice so far, and events folded into a run so far */
+    uint64_t nb_events;
+    uint64_t nb_sliced_events;
+    uint64_t nb_collapsed_events;
+    bool finished;
+};
+
+void setup_trace_pipeline(struct trace_pipeline_struct *pipeline, FILE *trace, bool with_pc);
+bool add_trace_source(struct trace_pipeline_struct *pipeline, FILE *trace, uint64_t period);
+bool rewind_trace_pipeline(struct trace_pipeline_struct *pipeline);
+bool read_trace_batch(struct trace_pipeline_struct *pipeline, struct trace_batch_struct *batch);
+
+#endif /* TRACE_PIPELINE_HPP */
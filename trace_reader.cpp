@@ -0,0 +1,85 @@
+#include "trace_reader.hpp"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "miss_trace.hpp"
+
+/**
+ * Subroutine to read the next hexadecimal field of a line.
+ * @fields Address of the rest of the line, moved after the field
+ * @value Address of the value to fill
+ * Returns false if there is no field left
+ */
+static inline bool read_hex_field(const char **fields, uint64_t *value){
+    char *end = NULL;
+    uint64_t field = strtoull(*fields, &end, 16);
+    if (end == *fields)
+        return false;
+    *value = field;
+    *fields = end;
+    return true;
+}
+
+/**
+ * Subroutine to read the next event of a trace. The lines that do not hold at least a type and an address are
+ * skipped.
+ * @trace The trace file
+ * @with_size Set when the trace has a size column, right after the address
+ * @with_pc Set when the trace has a PC column, between the address (or size) and the store value
+ * @record Address of the record to fill
+ * Returns false at the end of the trace
+ */
+bool read_trace_record(FILE *trace, bool with_size, bool with_pc, struct trace_record_struct *record){
+    char line[128];
+    while (fgets(line, sizeof(line), trace) != NULL){
+        int consumed = 0;
+        if (sscanf(line, "%c %" SCNx64 "%n", &record->type, &record->address, &consumed) < 2)
+            continue;
+        const char *fields = line + consumed;
+        uint64_t size = 0;
+        record->size = 0;
+        record->pc = 0;
+        record->run_reads = 0;
+        record->run_writes = 0;
+        if (with_size and read_hex_field(&fields, &size))
+            record->size = (unsigned int) size;
+        if (with_pc)
+            read_hex_field(&fields, &record->pc);
+        record->has_value = read_hex_field(&fields, &record->value);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Subroutine to read the header of a binary miss trace (miss_trace.hpp).
+ * @trace The miss trace file
+ * Returns false if the file is not a miss trace
+ */
+bool read_miss_trace_header(FILE *trace){
+    struct miss_trace_header_struct header;
+    if (fread(&header, sizeof(header), 1, trace) != 1)
+        return false;
+    return (memcmp(header.magic, MISS_TRACE_MAGIC, sizeof(header.magic)) == 0) and (header.version == MISS_TRACE_VERSION);
+}
+
+/**
+ * Subroutine to read the next access of a binary miss trace. Misses replay as the access that missed, and write
+ * backs as writes.
+ * @trace The miss trace file, after its header
+ * @record Address of the record to fill
+ * Returns false at the end of the trace
+ */
+bool read_miss_trace_record(FILE *trace, struct trace_record_struct *record){
+    uint64_t word = 0;
+    if (fread(&word, sizeof(word), 1, trace) != 1)
+        return false;
+    record->type = ((word & MISS_TRACE_KIND_MASK) == MISS_TRACE_READ) ? 'r' : 'w';
+    record->address = word & ~(uint64_t) MISS_TRACE_KIND_MASK;
+    record->size = 0;
+    record->pc = 0;
+    record->has_value = false;
+    record->run_reads = 0;
+    record->run_writes = 0;
+    return true;
+}
@@ -0,0 +1,29 @@
+#ifndef TRACE_READER_HPP
+#define TRACE_READER_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+
+/** One trace event: "r|w <address> [size] [pc] [value]", all numbers in hexadecimal */
+struct trace_record_struct {
+    /** READ or WRITE */
+    char type;
+    uint64_t address;
+    /** Number of bytes accessed, 0 if the trace has no size column (a single access) */
+    unsigned int size;
+    /** Address of the instruction, 0 if the trace has no PC column */
+    uint64_t pc;
+    /** Value of a store, valid only if has_value is set */
+    uint64_t value;
+    bool has_value;
+    /** Run length collapsing (see trace_pipeline_struct): reads and writes to the same l1 sector that followed this
+    event, folded into it. 0 for the readers */
+    unsigned int run_reads;
+    unsigned int run_writes;
+};
+
+bool read_trace_record(FILE *trace, bool with_size, bool with_pc, struct trace_record_struct *record);
+bool read_miss_trace_header(FILE *trace);
+bool read_miss_trace_record(FILE *trace, struct trace_record_struct *record);
+
+#endif /* TRACE_READER_HPP */